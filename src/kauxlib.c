@@ -37,3 +37,8 @@ klisp_State *klispL_newstate (void)
     return K;
 }
 
+klisp_State *klispL_newstate_image (const char *name, const char **msg)
+{
+    return klisp_newstate_image(k_alloc, NULL, name, msg);
+}
+
@@ -22,5 +22,6 @@
 ** Create a new state with the default allocator
 */
 klisp_State *klispL_newstate (void);
+klisp_State *klispL_newstate_image (const char *name, const char **msg);
 
 #endif
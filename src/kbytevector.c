@@ -25,16 +25,10 @@ TValue kbytevector_new_bs_g(klisp_State *K, bool m, const uint8_t *buf,
 }
 
 /* LOCK: GIL should be acquired */
-static uint32_t get_bytevector_hash(const uint8_t *buf, uint32_t size)
+static inline uint32_t get_bytevector_hash(klisp_State *K, 
+                                           const uint8_t *buf, uint32_t size)
 {
-    uint32_t h = size; /* seed */
-    size_t step = (size>>5)+1; /* if bytevector is too long, don't hash all 
-                                  its bytes */
-    size_t size1;
-    for (size1 = size; size1 >= step; size1 -= step)  /* compute hash */
-        h = h ^ ((h<<5)+(h>>2)+ buf[size1-1]);
-
-    return h;
+    return klispS_hash(buf, size, G(K)->seed);
 }
 
 /* Looks for a bytevector in the stringtable and returns a pointer
@@ -43,18 +37,22 @@ static Bytevector *search_in_bb_table(klisp_State *K, const uint8_t *buf,
                                       uint32_t size, uint32_t h)
 {
 
-    for (GCObject *o = G(K)->strt.hash[lmod(h, G(K)->strt.size)];
-         o != NULL; o = o->gch.next) {
-        klisp_assert(o->gch.tt == K_TKEYWORD || o->gch.tt == K_TSYMBOL || 
-                     o->gch.tt == K_TSTRING || o->gch.tt == K_TBYTEVECTOR);
-		        
-        if (o->gch.tt != K_TBYTEVECTOR) continue;
-
-        Bytevector *tb = (Bytevector *) o;
-        if (tb->size == size && (memcmp(buf, tb->b, size) == 0)) {
-            /* bytevector may be dead */
-            if (isdead(G(K), o)) changewhite(o);
-            return tb;
+    GCObject *chains[2];
+    klispS_chains(K, h, chains);
+    for (int32_t i = 0; i < 2; i++) {
+        for (GCObject *o = chains[i]; o != NULL; o = o->gch.next) {
+            klisp_assert(o->gch.tt == K_TKEYWORD || o->gch.tt == K_TSYMBOL || 
+                         o->gch.tt == K_TSTRING || o->gch.tt == K_TBYTEVECTOR);
+
+            if (o->gch.tt != K_TBYTEVECTOR) continue;
+
+            Bytevector *tb = (Bytevector *) o;
+            if (tb->hash == h && tb->size == size && 
+                (memcmp(buf, tb->b, size) == 0)) {
+                /* bytevector may be dead */
+                if (isdead(G(K), o)) changewhite(o);
+                return tb;
+            }
         }
     }
     return NULL;
@@ -68,7 +66,7 @@ static Bytevector *search_in_bb_table(klisp_State *K, const uint8_t *buf,
 /* main constructor for immutable bytevectors */
 TValue kbytevector_new_bs_imm(klisp_State *K, const uint8_t *buf, uint32_t size)
 {
-    uint32_t h = get_bytevector_hash(buf, size);
+    uint32_t h = get_bytevector_hash(K, buf, size);
 
     /* first check to see if it's in the stringtable */
     Bytevector *new_bb = search_in_bb_table(K, buf, size, h);
@@ -103,18 +101,10 @@ TValue kbytevector_new_bs_imm(klisp_State *K, const uint8_t *buf, uint32_t size)
     }
     
     /* add to the string/symbol table (and link it) */
-    stringtable *tb;
-    tb = &G(K)->strt;
-    h = lmod(h, tb->size);
-    new_bb->next = tb->hash[h];  /* chain new entry */
-    tb->hash[h] = (GCObject *)(new_bb);
-    tb->nuse++;
     TValue ret_tv = gc2bytevector(new_bb);
-    if (tb->nuse > ((uint32_t) tb->size) && tb->size <= INT32_MAX / 2) {
-        krooted_tvs_push(K, ret_tv); /* save in case of gc */
-        klispS_resize(K, tb->size*2);  /* too crowded */
-        krooted_tvs_pop(K);
-    }
+    krooted_tvs_push(K, ret_tv); /* save in case of gc */
+    klispS_add(K, (GCObject *) new_bb, h);
+    krooted_tvs_pop(K);
 
     return ret_tv;
 }
@@ -181,7 +171,13 @@ bool kbytevector_equalp(klisp_State *K, TValue obj1, TValue obj2)
     Bytevector *bytevector1 = tv2bytevector(obj1);
     Bytevector *bytevector2 = tv2bytevector(obj2);
 
-    if (bytevector1->size == bytevector2->size) {
+    if (bytevector1 == bytevector2) {
+        return true;
+    } else if (kis_immutable(obj1) && kis_immutable(obj2)) {
+        /* all immutable bytevectors are in the string table, so two
+           different ones can't have the same contents */
+        return false;
+    } else if (bytevector1->size == bytevector2->size) {
         return (bytevector1->size == 0) ||
             (memcmp(bytevector1->b, bytevector2->b, bytevector1->size) == 0);
     } else {
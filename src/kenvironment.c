@@ -153,7 +153,7 @@ void ktry_set_name(klisp_State *K, TValue obj, TValue sym)
 TValue kget_name(klisp_State *K, TValue obj)
 {
     /* LOCK: klispH_get will acquire the GIL */
-    const TValue *node = klispH_get(tv2table(G(K)->name_table),
+    const TValue *node = klispH_get(K, tv2table(G(K)->name_table),
                                     obj);
     klisp_assert(node != &kfree);
     return *node;
@@ -328,10 +328,16 @@ TValue kget_keyed_static_var(klisp_State *K, TValue env, TValue key)
 /* environments with hashtable bindings */
 /* TEMP: for now only for ground & std environments */
 TValue kmake_table_environment(klisp_State *K, TValue parents)
+{
+    return kmake_table_environment_s(K, parents, ENVTABSIZE);
+}
+
+TValue kmake_table_environment_s(klisp_State *K, TValue parents, 
+                                 int32_t size)
 {
     TValue new_env = kmake_environment(K, parents);
     krooted_tvs_push(K, new_env);
-    TValue new_table = klispH_new(K, 0, ENVTABSIZE, K_FLAG_WEAK_NOTHING);
+    TValue new_table = klispH_new(K, 0, size, K_FLAG_WEAK_NOTHING);
     tv2env(new_env)->bindings = new_table;
     krooted_tvs_pop(K);
     return new_env;
@@ -29,6 +29,9 @@ TValue kget_keyed_static_var(klisp_State *K, TValue env, TValue key);
    or should add code to add binding to at certain point move over to 
    hashtable */
 TValue kmake_table_environment(klisp_State *K, TValue parents);
+/* the same but with an explicit starting size for the hashtable */
+TValue kmake_table_environment_s(klisp_State *K, TValue parents, 
+                                 int32_t size);
 
 #if KTRACK_NAMES
 void ktry_set_name(klisp_State *K, TValue obj, TValue sym);
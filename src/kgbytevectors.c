@@ -18,6 +18,9 @@
 #include "kcontinuation.h"
 #include "kerror.h"
 #include "kbytevector.h"
+#include "kinteger.h"
+#include "kreal.h"
+#include "ksymbol.h"
 
 #include "kghelpers.h"
 #include "kgbytevectors.h"
@@ -186,6 +189,352 @@ void bytevector_u8_setB(klisp_State *K)
     kapply_cc(K, KINERT);
 }
 
+/* Helpers for the typed accessors */
+
+/* 
+** xparams[0] & xparams[1] are the symbols big & little, returns true
+** for big endian and false for little endian 
+*/
+static inline bool get_endianness(klisp_State *K, TValue *xparams, TValue e)
+{
+    if (ttissymbol(e)) {
+        if (tv_sym_equal(e, xparams[0]))
+            return true;
+        else if (tv_sym_equal(e, xparams[1]))
+            return false;
+    }
+    klispE_throw_simple_with_irritants(K, "Bad endianness (expected big "
+                                       "or little)", 1, e);
+    return false;
+}
+
+/* returns the index of the first of size bytes starting at tv_k */
+static inline int32_t get_typed_index(klisp_State *K, TValue bytevector,
+                                      TValue tv_k, int32_t size)
+{
+    if (!ttisfixint(tv_k) || ivalue(tv_k) < 0 || 
+        ivalue(tv_k) > kbytevector_size(bytevector) - size) {
+        /* TODO show index */
+        klispE_throw_simple(K, "index out of bounds");
+        return 0;
+    }
+    return ivalue(tv_k);
+}
+
+/* the shifts don't depend on the byte order of the host */
+static inline uint64_t bytes_to_uint64(const uint8_t *buf, int32_t size,
+                                       bool bigp)
+{
+    uint64_t res = 0;
+    if (bigp) {
+        for (int32_t i = 0; i < size; ++i)
+            res = (res << 8) | buf[i];
+    } else {
+        for (int32_t i = size - 1; i >= 0; --i)
+            res = (res << 8) | buf[i];
+    }
+    return res;
+}
+
+static inline void uint64_to_bytes(uint8_t *buf, int32_t size, bool bigp,
+                                   uint64_t x)
+{
+    if (bigp) {
+        for (int32_t i = size - 1; i >= 0; --i, x >>= 8)
+            buf[i] = (uint8_t) x;
+    } else {
+        for (int32_t i = 0; i < size; ++i, x >>= 8)
+            buf[i] = (uint8_t) x;
+    }
+}
+
+static inline TValue decode_integer(klisp_State *K, const uint8_t *buf, 
+                                    int32_t size, bool signedp, bool bigp)
+{
+    uint64_t x = bytes_to_uint64(buf, size, bigp);
+    if (signedp) {
+        /* sign extend */
+        int32_t shift = 64 - 8 * size;
+        return kinteger_new_int64(K, ((int64_t) (x << shift)) >> shift);
+    } else {
+        return kinteger_new_uint64(K, x);
+    }
+}
+
+/* returns false if n doesn't fit in size bytes */
+static inline bool encode_integer(TValue n, int32_t size, bool signedp, 
+                                  uint64_t *x)
+{
+    int32_t bits = 8 * size;
+    if (signedp) {
+        int64_t i;
+        if (!kinteger_to_int64(n, &i))
+            return false;
+        if (bits < 64) {
+            int64_t limit = ((int64_t) 1) << (bits - 1);
+            if (i < -limit || i >= limit)
+                return false;
+        }
+        *x = (uint64_t) i;
+        return true;
+    } else {
+        if (!kinteger_to_uint64(n, x))
+            return false;
+        return bits == 64 || *x < (((uint64_t) 1) << bits);
+    }
+}
+
+/* size for the list conversions, only 1 to 8 bytes are supported */
+static inline int32_t get_element_size(klisp_State *K, TValue tv_size)
+{
+    if (!ttisfixint(tv_size) || ivalue(tv_size) < 1 || ivalue(tv_size) > 8) {
+        klispE_throw_simple_with_irritants(K, "Bad element size (expected "
+                                           "1 to 8)", 1, tv_size);
+        return 0;
+    }
+    return ivalue(tv_size);
+}
+
+/* ?.? bytevector-u16-ref, bytevector-s16-ref, bytevector-u32-ref, 
+   bytevector-s32-ref, bytevector-u64-ref, bytevector-s64-ref */
+void bytevector_integer_ref(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    /*
+    ** xparams[0]: symbol big
+    ** xparams[1]: symbol little
+    ** xparams[2]: size in bytes
+    ** xparams[3]: signedp
+    */
+    UNUSED(denv);
+    bind_3tp(K, ptree, "bytevector", ttisbytevector, bytevector,
+             "exact integer", keintegerp, tv_k, 
+             "symbol", ttissymbol, endianness);
+
+    bool bigp = get_endianness(K, xparams, endianness);
+    int32_t size = ivalue(xparams[2]);
+    int32_t k = get_typed_index(K, bytevector, tv_k, size);
+
+    TValue res = decode_integer(K, kbytevector_buf(bytevector) + k, size,
+                                bvalue(xparams[3]), bigp);
+    kapply_cc(K, res);
+}
+
+/* ?.? bytevector-u16-set!, bytevector-s16-set!, bytevector-u32-set!, 
+   bytevector-s32-set!, bytevector-u64-set!, bytevector-s64-set! */
+void bytevector_integer_setB(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    /*
+    ** xparams[0]: symbol big
+    ** xparams[1]: symbol little
+    ** xparams[2]: size in bytes
+    ** xparams[3]: signedp
+    */
+    UNUSED(denv);
+    bind_al3tp(K, ptree, "bytevector", ttisbytevector, bytevector,
+               "exact integer", keintegerp, tv_k, 
+               "exact integer", keintegerp, n, rest);
+    /* XXX: this will send wrong error msgs (bad number of arg) */
+    bind_1tp(K, rest, "symbol", ttissymbol, endianness);
+
+    if (kbytevector_immutablep(bytevector)) {
+        klispE_throw_simple(K, "immutable bytevector");
+        return;
+    } 
+
+    bool bigp = get_endianness(K, xparams, endianness);
+    int32_t size = ivalue(xparams[2]);
+    int32_t k = get_typed_index(K, bytevector, tv_k, size);
+
+    uint64_t x;
+    if (!encode_integer(n, size, bvalue(xparams[3]), &x)) {
+        klispE_throw_simple_with_irritants(K, "value out of range", 1, n);
+        return;
+    }
+    uint64_to_bytes(kbytevector_buf(bytevector) + k, size, bigp, x);
+    kapply_cc(K, KINERT);
+}
+
+/* ?.? bytevector-ieee-single-ref, bytevector-ieee-double-ref */
+void bytevector_ieee_ref(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    /*
+    ** xparams[0]: symbol big
+    ** xparams[1]: symbol little
+    ** xparams[2]: size in bytes (4 or 8)
+    */
+    UNUSED(denv);
+    bind_3tp(K, ptree, "bytevector", ttisbytevector, bytevector,
+             "exact integer", keintegerp, tv_k, 
+             "symbol", ttissymbol, endianness);
+
+    bool bigp = get_endianness(K, xparams, endianness);
+    int32_t size = ivalue(xparams[2]);
+    int32_t k = get_typed_index(K, bytevector, tv_k, size);
+
+    uint64_t x = bytes_to_uint64(kbytevector_buf(bytevector) + k, size, bigp);
+    double d;
+    if (size == 4) {
+        uint32_t x32 = (uint32_t) x;
+        float f;
+        memcpy(&f, &x32, sizeof(f));
+        d = f;
+    } else {
+        memcpy(&d, &x, sizeof(d));
+    }
+    /* NaNs & infinities are converted to the klisp objects */
+    kapply_cc(K, ktag_double(d));
+}
+
+/* ?.? bytevector-ieee-single-set!, bytevector-ieee-double-set! */
+void bytevector_ieee_setB(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    /*
+    ** xparams[0]: symbol big
+    ** xparams[1]: symbol little
+    ** xparams[2]: size in bytes (4 or 8)
+    */
+    UNUSED(denv);
+    bind_al3tp(K, ptree, "bytevector", ttisbytevector, bytevector,
+               "exact integer", keintegerp, tv_k, 
+               "real", krealp, n, rest);
+    /* XXX: this will send wrong error msgs (bad number of arg) */
+    bind_1tp(K, rest, "symbol", ttissymbol, endianness);
+
+    if (kbytevector_immutablep(bytevector)) {
+        klispE_throw_simple(K, "immutable bytevector");
+        return;
+    } 
+
+    bool bigp = get_endianness(K, xparams, endianness);
+    int32_t size = ivalue(xparams[2]);
+    int32_t k = get_typed_index(K, bytevector, tv_k, size);
+
+    double d;
+    n = kexact_to_inexact(K, n); /* this is a no-op for inexact reals */
+    if (ttisdouble(n)) {
+        d = dvalue(n);
+    } else if (ttisiinf(n)) {
+        d = tv_equal(n, KIPINF)? INFINITY : -INFINITY;
+    } else if (ttisrwnpv(n)) {
+        d = NAN;
+    } else {
+        klispE_throw_simple_with_irritants(K, "no primary value", 1, n);
+        return;
+    }
+
+    uint64_t x;
+    if (size == 4) {
+        float f = (float) d;
+        uint32_t x32;
+        memcpy(&x32, &f, sizeof(x32));
+        x = x32;
+    } else {
+        memcpy(&x, &d, sizeof(x));
+    }
+    uint64_to_bytes(kbytevector_buf(bytevector) + k, size, bigp, x);
+    kapply_cc(K, KINERT);
+}
+
+/* ?.? bytevector->uint-list, bytevector->sint-list */
+void bytevector_to_integer_list(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    /*
+    ** xparams[0]: symbol big
+    ** xparams[1]: symbol little
+    ** xparams[2]: signedp
+    */
+    UNUSED(denv);
+    bind_3tp(K, ptree, "bytevector", ttisbytevector, bytevector,
+             "symbol", ttissymbol, endianness, 
+             "exact integer", keintegerp, tv_size);
+
+    bool bigp = get_endianness(K, xparams, endianness);
+    int32_t size = get_element_size(K, tv_size);
+    bool signedp = bvalue(xparams[2]);
+    
+    if (kbytevector_size(bytevector) % size != 0) {
+        klispE_throw_simple(K, "bytevector length is not a multiple of "
+                            "the element size");
+        return;
+    }
+
+    int32_t n = kbytevector_size(bytevector) / size;
+    const uint8_t *buf = kbytevector_buf(bytevector) + n * size;
+    TValue tail = KNIL;
+    krooted_vars_push(K, &tail);
+    while(n-- > 0) {
+        buf -= size;
+        TValue elem = decode_integer(K, buf, size, signedp, bigp);
+        krooted_tvs_push(K, elem);
+        tail = kcons(K, elem, tail);
+        krooted_tvs_pop(K);
+    }
+    krooted_vars_pop(K);
+    kapply_cc(K, tail);
+}
+
+/* ?.? uint-list->bytevector, sint-list->bytevector */
+void integer_list_to_bytevector(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    /*
+    ** xparams[0]: symbol big
+    ** xparams[1]: symbol little
+    ** xparams[2]: signedp
+    */
+    UNUSED(denv);
+    bind_3tp(K, ptree, "any", anytype, ls,
+             "symbol", ttissymbol, endianness, 
+             "exact integer", keintegerp, tv_size);
+
+    bool bigp = get_endianness(K, xparams, endianness);
+    int32_t size = get_element_size(K, tv_size);
+    bool signedp = bvalue(xparams[2]);
+
+    /* don't allow cycles */
+    int32_t pairs;
+    check_typed_list(K, keintegerp, false, ls, &pairs, NULL);
+    int32_t bsize = kcheck32(K, "resulting bytevector is too big", 
+                             (int64_t) pairs * size);
+    
+    TValue res = kbytevector_new_s(K, bsize);
+    uint8_t *buf = kbytevector_buf(res);
+    for (; pairs > 0; --pairs, ls = kcdr(ls), buf += size) {
+        TValue n = kcar(ls);
+        uint64_t x;
+        if (!encode_integer(n, size, signedp, &x)) {
+            klispE_throw_simple_with_irritants(K, "value out of range", 
+                                               1, n);
+            return;
+        }
+        uint64_to_bytes(buf, size, bigp, x);
+    }
+    kapply_cc(K, res);
+}
+
 /* ?.? bytevector-copy */
 /* TEMP: at least for now this always returns mutable bytevectors */
 void bytevector_copy(klisp_State *K)
@@ -196,15 +545,18 @@ void bytevector_copy(klisp_State *K)
     klisp_assert(ttisenvironment(K->next_env));
     UNUSED(xparams);
     UNUSED(denv);
-    bind_1tp(K, ptree, "bytevector", ttisbytevector, bytevector);
+    bind_al1tp(K, ptree, "bytevector", ttisbytevector, bytevector, rest);
+
+    int32_t start, end;
+    get_opt_range(K, rest, kbytevector_size(bytevector), &start, &end);
 
     TValue new_bytevector;
     /* the if isn't strictly necessary but it's clearer this way */
-    if (tv_equal(bytevector, G(K)->empty_bytevector)) {
-        new_bytevector = bytevector; 
+    if (start == end) {
+        new_bytevector = G(K)->empty_bytevector; 
     } else {
-        new_bytevector = kbytevector_new_bs(K, kbytevector_buf(bytevector),
-                                            kbytevector_size(bytevector));
+        new_bytevector = kbytevector_new_bs(K, kbytevector_buf(bytevector)
+                                            + start, end - start);
     }
     kapply_cc(K, new_bytevector);
 }
@@ -231,9 +583,9 @@ void bytevector_copyB(klisp_State *K)
 
     if (!tv_equal(bytevector1, bytevector2) && 
         !tv_equal(bytevector1, G(K)->empty_bytevector)) {
-        memcpy(kbytevector_buf(bytevector2),
-               kbytevector_buf(bytevector1),
-               kbytevector_size(bytevector1));
+        memmove(kbytevector_buf(bytevector2),
+                kbytevector_buf(bytevector1),
+                kbytevector_size(bytevector1));
     }
     kapply_cc(K, KINERT);
 }
@@ -351,10 +703,11 @@ void bytevector_copy_partialB(klisp_State *K)
         return;
     }
 
+    /* the ranges may overlap if both bytevectors are the same */
     if (size > 0) {
-        memcpy(kbytevector_buf(bytevector2) + start2,
-               kbytevector_buf(bytevector1) + start,
-               size);
+        memmove(kbytevector_buf(bytevector2) + start2,
+                kbytevector_buf(bytevector1) + start,
+                size);
     }
     kapply_cc(K, KINERT);
 }
@@ -368,19 +721,19 @@ void bytevector_u8_fillB(klisp_State *K)
     klisp_assert(ttisenvironment(K->next_env));
     UNUSED(xparams);
     UNUSED(denv);
-    bind_2tp(K, ptree, "bytevector", ttisbytevector, bytevector,
-             "u8", ttisu8, tv_byte);
+    bind_al2tp(K, ptree, "bytevector", ttisbytevector, bytevector,
+               "u8", ttisu8, tv_byte, rest);
 
     if (kbytevector_immutablep(bytevector)) {
         klispE_throw_simple(K, "immutable bytevector");
         return;
     } 
 
-    uint32_t size = kbytevector_size(bytevector);
-    uint8_t *buf = kbytevector_buf(bytevector);
-    while(size-- > 0) {
-        *buf++ = (uint8_t) ivalue(tv_byte);
-    }
+    int32_t start, end;
+    get_opt_range(K, rest, kbytevector_size(bytevector), &start, &end);
+
+    memset(kbytevector_buf(bytevector) + start, (uint8_t) ivalue(tv_byte), 
+           end - start);
     kapply_cc(K, KINERT);
 }
 
@@ -443,6 +796,62 @@ void kinit_bytevectors_ground_env(klisp_State *K)
     add_applicative(K, ground_env, "bytevector-u8-set!", bytevector_u8_setB, 
                     0);
 
+    /* ??.? bytevector-{u,s}{16,32,64}-{ref,set!} */
+    TValue big = ksymbol_new_b(K, "big", KNIL);
+    krooted_tvs_push(K, big);
+    TValue little = ksymbol_new_b(K, "little", KNIL);
+    krooted_tvs_push(K, little);
+
+    add_applicative(K, ground_env, "bytevector-u16-ref", 
+                    bytevector_integer_ref, 4, big, little, i2tv(2), KFALSE);
+    add_applicative(K, ground_env, "bytevector-s16-ref", 
+                    bytevector_integer_ref, 4, big, little, i2tv(2), KTRUE);
+    add_applicative(K, ground_env, "bytevector-u32-ref", 
+                    bytevector_integer_ref, 4, big, little, i2tv(4), KFALSE);
+    add_applicative(K, ground_env, "bytevector-s32-ref", 
+                    bytevector_integer_ref, 4, big, little, i2tv(4), KTRUE);
+    add_applicative(K, ground_env, "bytevector-u64-ref", 
+                    bytevector_integer_ref, 4, big, little, i2tv(8), KFALSE);
+    add_applicative(K, ground_env, "bytevector-s64-ref", 
+                    bytevector_integer_ref, 4, big, little, i2tv(8), KTRUE);
+
+    add_applicative(K, ground_env, "bytevector-u16-set!", 
+                    bytevector_integer_setB, 4, big, little, i2tv(2), KFALSE);
+    add_applicative(K, ground_env, "bytevector-s16-set!", 
+                    bytevector_integer_setB, 4, big, little, i2tv(2), KTRUE);
+    add_applicative(K, ground_env, "bytevector-u32-set!", 
+                    bytevector_integer_setB, 4, big, little, i2tv(4), KFALSE);
+    add_applicative(K, ground_env, "bytevector-s32-set!", 
+                    bytevector_integer_setB, 4, big, little, i2tv(4), KTRUE);
+    add_applicative(K, ground_env, "bytevector-u64-set!", 
+                    bytevector_integer_setB, 4, big, little, i2tv(8), KFALSE);
+    add_applicative(K, ground_env, "bytevector-s64-set!", 
+                    bytevector_integer_setB, 4, big, little, i2tv(8), KTRUE);
+
+    /* ??.? bytevector-ieee-{single,double}-{ref,set!} */
+    add_applicative(K, ground_env, "bytevector-ieee-single-ref", 
+                    bytevector_ieee_ref, 3, big, little, i2tv(4));
+    add_applicative(K, ground_env, "bytevector-ieee-double-ref", 
+                    bytevector_ieee_ref, 3, big, little, i2tv(8));
+    add_applicative(K, ground_env, "bytevector-ieee-single-set!", 
+                    bytevector_ieee_setB, 3, big, little, i2tv(4));
+    add_applicative(K, ground_env, "bytevector-ieee-double-set!", 
+                    bytevector_ieee_setB, 3, big, little, i2tv(8));
+
+    /* ??.? bytevector->uint-list, bytevector->sint-list, 
+       uint-list->bytevector, sint-list->bytevector */
+    add_applicative(K, ground_env, "bytevector->uint-list", 
+                    bytevector_to_integer_list, 3, big, little, KFALSE);
+    add_applicative(K, ground_env, "bytevector->sint-list", 
+                    bytevector_to_integer_list, 3, big, little, KTRUE);
+    add_applicative(K, ground_env, "uint-list->bytevector", 
+                    integer_list_to_bytevector, 3, big, little, KFALSE);
+    add_applicative(K, ground_env, "sint-list->bytevector", 
+                    integer_list_to_bytevector, 3, big, little, KTRUE);
+
+    krooted_tvs_pop(K);
+    krooted_tvs_pop(K);
+
     /* ??.1.?? bytevector-copy */
     add_applicative(K, ground_env, "bytevector-copy", bytevector_copy, 0);
     /* ??.1.?? bytevector-copy! */
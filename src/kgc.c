@@ -24,18 +24,47 @@
 #include "imath.h"
 #include "imrat.h"
 #include "ktable.h"
+#include "kpair.h"
 #include "kstring.h"
 #include "kbytevector.h"
 #include "kvector.h"
 #include "kmutex.h"
 #include "kcondvar.h"
 #include "kerror.h"
+#include "ksystem.h"
+#include "kprofile.h"
 
 #define GCSTEPSIZE	1024u
 #define GCSWEEPMAX	40
 #define GCSWEEPCOST	10
 #define GCFINALIZECOST	100 /* klisp: NOT USED YET */
 
+/* names of the types of collectable objects, by type tag */
+const char *const klispC_type_names[KGC_NTYPES] = {
+    [K_TBIGINT] = "bigint",
+    [K_TBIGRAT] = "bigrat",
+    [K_TPAIR] = "pair",
+    [K_TSTRING] = "string",
+    [K_TSYMBOL] = "symbol",
+    [K_TENVIRONMENT] = "environment",
+    [K_TCONTINUATION] = "continuation",
+    [K_TOPERATIVE] = "operative",
+    [K_TAPPLICATIVE] = "applicative",
+    [K_TENCAPSULATION] = "encapsulation",
+    [K_TPROMISE] = "promise",
+    [K_TTABLE] = "hash-table",
+    [K_TERROR] = "error-object",
+    [K_TBYTEVECTOR] = "bytevector",
+    [K_TFPORT] = "file-port",
+    [K_TMPORT] = "memory-port",
+    [K_TVECTOR] = "vector",
+    [K_TKEYWORD] = "keyword",
+    [K_TLIBRARY] = "library",
+    [K_TTHREAD] = "thread",
+    [K_TMUTEX] = "mutex",
+    [K_TCONDVAR] = "condition-variable",
+};
+
 
 
 #define maskmarks	cast(uint16_t, ~(bitmask(BLACKBIT)|WHITEBITS))
@@ -75,7 +104,12 @@
             reallymarkobject(k, obj2gco(t)); }
 
 
-#define setthreshold(g)  (g->GCthreshold = (g->estimate/100) * g->gcpause)
+/* klisp: avoid overflows with big pauses (see gc-set-pause!) */
+#define setthreshold(g)  ({                                             \
+            kmem_t e_ = g->estimate/100;                                \
+            kmem_t p_ = (kmem_t) g->gcpause;                            \
+            g->GCthreshold = (p_ != 0 && e_ > MAX_KMEM / p_)?           \
+                MAX_KMEM : e_ * p_; })
 
 static void removeentry (Node *n) {
     klisp_assert(ttisfree(gval(n)));
@@ -182,11 +216,30 @@ size_t klispC_separateudata (lua_State *L, int all) {
 
 #endif
 
+/*
+** klisp: symbols, keywords and immutable strings & bytevectors can be
+** found again from their contents (they are interned, or in the case of
+** symbols with source info, compared by name), so like strings in lua
+** they are treated as values and never removed from weak tables. The
+** exception are the ones registered in a guardian, otherwise they would
+** be kept alive by G(K)->guarded and never found unreachable
+*/
+static inline bool isinterned (TValue o) {
+    return (ttissymbol(o) || ttiskeyword(o) ||
+            ((ttisstring(o) || ttisbytevector(o)) && kis_immutable(o))) &&
+        !testbit(gcvalue(o)->gch.gct, GUARDEDBIT);
+}
+
+#define ismarked(o) (!iscollectable(o) || !iswhite(gcvalue(o)))
+
 static int32_t traversetable (global_State *g, Table *h) {
     int32_t i;
     TValue tv = gc2table(h);
     int32_t weakkey = ktable_has_weak_keys(tv)? 1 : 0;
     int32_t weakvalue = ktable_has_weak_values(tv)? 1 : 0;
+    /* in ephemeron tables the values are only marked if their keys 
+       are (see convergeephemerons) */
+    bool ephemeron = weakkey && !weakvalue && ktable_is_ephemeron(tv);
 
     if (weakkey || weakvalue) {  /* is really weak? */
         h->gct &= ~(KEYWEAK | VALUEWEAK);  /* clear bits */
@@ -195,10 +248,9 @@ static int32_t traversetable (global_State *g, Table *h) {
         h->gclist = g->weak;  /* must be cleared after GC, ... */
         g->weak = obj2gco(h);  /* ... so put in the appropriate list */
     }
-    if (weakkey && weakvalue) return 1;
-    if (!weakvalue) {
-        i = h->sizearray;
-        while (i--)
+    i = h->sizearray;
+    while (i--) {
+        if (!weakvalue || isinterned(h->array[i]))
             markvalue(g, h->array[i]);
     }
     i = sizenode(h);
@@ -209,9 +261,13 @@ static int32_t traversetable (global_State *g, Table *h) {
         if (ttisfree(gval(n)))
             removeentry(n);  /* remove empty entries */
         else {
-            klisp_assert(!ttisfree(gkey(n)->this));
-            if (!weakkey) markvalue(g, gkey(n)->this);
-            if (!weakvalue) markvalue(g, gval(n));
+            TValue key = gkey(n)->this;
+            klisp_assert(!ttisfree(key));
+            if (!weakkey || isinterned(key)) 
+                markvalue(g, key);
+            if ((!weakvalue && (!ephemeron || ismarked(key))) ||
+                isinterned(gval(n)))
+                markvalue(g, gval(n));
         }
     }
     return weakkey || weakvalue;
@@ -252,8 +308,8 @@ static int32_t propagatemark (global_State *g) {
     g->gray = o->gch.gclist;
     klisp_assert(isgray(o));
     gray2black(o);
-    /* all types have si pointers */
-    if (o->gch.si != NULL) {
+    /* all types have si pointers (packed source info isn't a pointer) */
+    if (o->gch.si != NULL && !ksi_packedp(o->gch.si)) {
         markobject(g, o->gch.si);
     }
     uint8_t type = o->gch.tt;
@@ -356,7 +412,8 @@ static int32_t propagatemark (global_State *g) {
         Vector *v = cast(Vector *, o);
         markvalue(g, v->mark);
         markvaluearray(g, v->array, v->sizearray);
-        return sizeof(Vector) + v->sizearray * sizeof(TValue);
+        return sizeof(Vector) + v->sizeinline * sizeof(TValue) +
+            (v->array != v->inlinearray? v->capacity * sizeof(TValue) : 0);
     }
     case K_TLIBRARY: {
         Library *l = cast(Library *, o);
@@ -415,6 +472,72 @@ static size_t propagateall (global_State *g) {
     return m;
 }
 
+/*
+** klisp: mark the values of the ephemeron tables in the weak list
+** whose keys were marked. This may mark other keys, so it's repeated
+** until there are no more changes
+*/
+static void convergeephemerons (global_State *g) {
+    bool changed;
+    do {
+        changed = false;
+        /* this may add more tables to the weak list */
+        propagateall(g);
+        for (GCObject *l = g->weak; l != NULL; l = ((Table *) l)->gclist) {
+            Table *h = (Table *) l;
+            if (testbit(h->gct, VALUEWEAKBIT) || 
+                !ktable_is_ephemeron(gc2table(h)))
+                continue;
+            int32_t i = sizenode(h);
+            while (i--) {
+                Node *n = gnode(h, i);
+                if (!ttisfree(gval(n)) && ismarked(gkey(n)->this) &&
+                    !ismarked(gval(n))) {
+                    reallymarkobject(g, gcvalue(gval(n)));
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+}
+
+/*
+** klisp: guardians (see make-guardian in kggc.c)
+** G(K)->guarded is a weak keys table, object -> list of nodes, one
+** for each time the object was registered. Each node is a pair 
+** (state . ()), where state is the pair whose car is the list of 
+** objects the guardian has ready to be returned. When a guarded object
+** becomes unreachable, it is marked again and the node is reused to
+** add it to that list, so this doesn't allocate. Returns true if any
+** object was found
+*/
+static bool separateguarded (global_State *g) {
+    if (!ttistable(g->guarded))  /* still initializing */
+        return false;
+    Table *h = tv2table(g->guarded);
+    bool found = false;
+    int32_t i = sizenode(h);
+    while (i--) {
+        Node *n = gnode(h, i);
+        TValue obj = key2tval(n);
+        if (ttisfree(gval(n)) || ismarked(obj))
+            continue;
+        found = true;
+        reallymarkobject(g, gcvalue(obj));  /* resurrect it */
+        for (TValue ls = gval(n); ttispair(ls); ls = kcdr(ls)) {
+            TValue node = kcar(ls);
+            TValue state = kcar(node);
+            kset_car(node, obj);
+            kset_cdr(node, kcar(state));
+            kset_car(state, node);
+        }
+        resetbit(gcvalue(obj)->gch.gct, GUARDEDBIT);
+        gval(n) = KFREE;  /* remove value ... */
+        removeentry(n);  /* remove entry from table */
+    }
+    return found;
+}
+
 /*
 ** The next function tells whether a key or value can be cleared from
 ** a weak table. Non-collectable objects are never removed from weak
@@ -469,6 +592,19 @@ static void cleartable (GCObject *l) {
     }
 }
 
+/*
+** drop the heap profiler samples of collected objects
+*/
+static void clearheapsamples (global_State *g) {
+    int32_t i = 0;
+    while (i < g->hprof_nsamples) {
+        if (iswhite(g->hprof_samples[i].obj))
+            g->hprof_samples[i] = g->hprof_samples[--g->hprof_nsamples];
+        else
+            ++i;
+    }
+}
+
 static void freeobj (klisp_State *K, GCObject *o) {
     /* TODO use specific functions like in bigint, bigrat & table */
     uint8_t type = o->gch.tt;
@@ -551,7 +687,10 @@ static void freeobj (klisp_State *K, GCObject *o) {
         klispM_free(K, (MPort *)o);
         break;
     case K_TVECTOR:
-        klispM_freemem(K, o, sizeof(Vector) + sizeof(TValue) * o->vector.sizearray);
+        if (o->vector.array != o->vector.inlinearray)
+            klispM_freearray(K, o->vector.array, o->vector.capacity, TValue);
+        klispM_freemem(K, o, sizeof(Vector) + sizeof(TValue) * 
+                       o->vector.sizeinline);
         break;
     case K_TLIBRARY:
         klispM_free(K, (Library *)o);
@@ -581,7 +720,7 @@ static void freeobj (klisp_State *K, GCObject *o) {
 }
 
 
-/* klisp can't have more than 4gb */
+/* klisp can't have more than 4g objects in a list */
 #define sweepwholelist(K,p)	sweeplist(K,p,UINT32_MAX)
 
 
@@ -591,15 +730,18 @@ static GCObject **sweeplist (klisp_State *K, GCObject **p, uint32_t count)
     global_State *g = G(K);
     int deadmask = otherwhite(g);
     while ((curr = *p) != NULL && count-- > 0) {
+        klisp_assert(curr->gch.tt < KGC_NTYPES);
         if ((curr->gch.gct ^ WHITEBITS) & deadmask) {  /* not dead? */
             klisp_assert(!isdead(g, curr) || testbit(curr->gch.gct, FIXEDBIT));
             makewhite(g, curr);  /* make it white (for next cycle) */
+            g->gc_live[curr->gch.tt]++;
             p = &curr->gch.next;
         } else {  /* must erase `curr' */
             klisp_assert(isdead(g, curr) || deadmask == bitmask(SFIXEDBIT));
             *p = curr->gch.next;
             if (curr == g->rootgc)  /* is the first element of the list? */
                 g->rootgc = curr->gch.next;  /* adjust first */
+            g->gc_freed[curr->gch.tt]++;
             freeobj(K, curr);
         }
     }
@@ -609,9 +751,14 @@ static GCObject **sweeplist (klisp_State *K, GCObject **p, uint32_t count)
 static void checkSizes (klisp_State *K) {
     global_State *g = G(K);
     /* check size of string/symbol hash */
+    /* with the lazy sweep this runs in the middle of an allocation, so
+       the elements aren't moved here, the rehash is done a little at a
+       time (see klispS_rehash_step), and a pending one (that would be
+       finished at once by klispS_resize) delays the shrink */
     if (g->strt.nuse < cast(uint32_t , g->strt.size/4) &&
-	    g->strt.size > MINSTRTABSIZE*2)
+	    g->strt.size > MINSTRTABSIZE*2 && g->strt.oldhash == NULL) {
         klispS_resize(K, g->strt.size/2);  /* table is too big */
+    }
 #if 0 /* not used in klisp */
     /* check size of buffer */
     if (luaZ_sizebuffer(&g->buff) > LUA_MINBUFFER*2) {  /* buffer too big? */
@@ -670,6 +817,9 @@ void klispC_freeall (klisp_State *K) {
     /* free all keyword/symbol/string/bytevectors lists */
     for (int32_t i = 0; i < g->strt.size; i++)  
         sweepwholelist(K, &g->strt.hash[i]);
+    /* including those not yet moved by a resize in progress */
+    for (int32_t i = 0; i < g->strt.oldsize; i++)  
+        sweepwholelist(K, &g->strt.oldhash[i]);
 }
 
 /* mark root set */
@@ -684,6 +834,7 @@ static void markroot (klisp_State *K) {
     markvalue(g, g->name_table);
     markvalue(g, g->cont_name_table);
     markvalue(g, g->thread_table);
+    markvalue(g, g->guarded);
 
     markvalue(g, g->eval_op);
     markvalue(g, g->list_app);
@@ -701,6 +852,17 @@ static void markroot (klisp_State *K) {
     markvalue(g, g->empty_string);
     markvalue(g, g->empty_bytevector);
     markvalue(g, g->empty_vector);
+    markvalue(g, g->si_files);
+    markvalue(g, g->prof_samples);
+    for (int32_t i = 0; i < g->hprof_nsamples; i++) {
+        markvalue(g, g->hprof_samples[i].si);
+        markvalue(g, g->hprof_samples[i].name);
+    }
+#ifdef KPROFILE
+    markvalue(g, g->prof_index);
+    for (int32_t i = 0; i < g->prof_ncounters; i++)
+        markvalue(g, g->prof_counters[i].name);
+#endif
 
     markvalue(g, g->ktok_lparen);
     markvalue(g, g->ktok_rparen);
@@ -731,6 +893,12 @@ static void atomic (klisp_State *K) {
     g->grayagain = NULL;
     propagateall(g);
 
+    /* mark the values of ephemerons with live keys */
+    convergeephemerons(g);
+    /* resurrect the unreachable guarded objects (& all they reference) */
+    if (separateguarded(g))
+        convergeephemerons(g);
+
     udsize = 0; /* to init var 'till we add user data */
 #if 0 /* keep around */
     udsize = klispC_separateudata(L, 0);  /* separate userdata to be finalized */
@@ -738,6 +906,7 @@ static void atomic (klisp_State *K) {
     udsize += propagateall(g);  /* remark, to propagate `preserveness' */
 #endif
     cleartable(g->weak);  /* remove collected objects from weak tables */
+    clearheapsamples(g);
 
     /* flip current white */
     g->currentwhite = cast(uint16_t, otherwhite(g));
@@ -745,6 +914,8 @@ static void atomic (klisp_State *K) {
     g->sweepgc = &g->rootgc;
     g->gcstate = GCSsweepstring;
     g->estimate = g->totalbytes - udsize;  /* first estimate */
+    /* the sweep counts the objects that survive */
+    memset(g->gc_live, 0, sizeof(g->gc_live));
 }
 
 
@@ -764,23 +935,38 @@ static int32_t singlestep (klisp_State *K) {
         }
     }
     case GCSsweepstring: {
-        uint32_t old = g->totalbytes;
-        sweepwholelist(K, &g->strt.hash[g->sweepstrgc++]);
-        if (g->sweepstrgc >= g->strt.size)  /* nothing more to sweep? */
+        kmem_t old = g->totalbytes;
+        stringtable *tb = &g->strt;
+        /* if the table is being resized, after the new array, sweep
+           the elements that haven't been moved yet */
+        if (g->sweepstrgc < tb->size)
+            sweepwholelist(K, &tb->hash[g->sweepstrgc]);
+        else
+            sweepwholelist(K, &tb->oldhash[g->sweepstrgc - tb->size]);
+        ++g->sweepstrgc;
+        /* nothing more to sweep? */
+        if (g->sweepstrgc >= tb->size + tb->oldsize)
             g->gcstate = GCSsweep;  /* end sweep-string phase */
         klisp_assert(old >= g->totalbytes);
         g->estimate -= old - g->totalbytes;
+        g->gc_freed_strings += old - g->totalbytes;
         return GCSWEEPCOST;
     }
     case GCSsweep: {
-        uint32_t old = g->totalbytes;
+        kmem_t old = g->totalbytes;
         g->sweepgc = sweeplist(K, g->sweepgc, GCSWEEPMAX);
+        klisp_assert(old >= g->totalbytes);
+        g->estimate -= old - g->totalbytes;
+        g->gc_freed_objects += old - g->totalbytes;
         if (*g->sweepgc == NULL) {  /* nothing more to sweep? */
+            /* this is after the accounting, because shrinking the
+               string table allocates the new array and only frees
+               the old one when the rehash is done */
+            old = g->totalbytes;
             checkSizes(K);
+            g->estimate += g->totalbytes - old;
             g->gcstate = GCSfinalize;  /* end sweep phase */
         }
-        klisp_assert(old >= g->totalbytes);
-        g->estimate -= old - g->totalbytes;
         return GCSWEEPMAX*GCSWEEPCOST;
     }
     case GCSfinalize: {
@@ -795,6 +981,7 @@ static int32_t singlestep (klisp_State *K) {
 #endif
             g->gcstate = GCSpause;  /* end collection */
             g->gcdept = 0;
+            g->gc_count++;
             return 0;
 #if 0
         }
@@ -805,9 +992,19 @@ static int32_t singlestep (klisp_State *K) {
 }
 
 
+/* accumulate the time spent in a step or full collection */
+static void count_pause(global_State *g, uint64_t nsecs)
+{
+    g->gc_nsecs += nsecs;
+    if (nsecs > g->gc_max_nsecs)
+        g->gc_max_nsecs = nsecs;
+}
+
 void klispC_step (klisp_State *K) {
     global_State *g = G(K);
-    int32_t lim = (GCSTEPSIZE/100) * g->gcstepmul;
+    /* klisp: stepmul can be set by the user, avoid overflows */
+    int64_t lim = (int64_t) (GCSTEPSIZE/100) * g->gcstepmul;
+    uint64_t start = ksystem_prof_clock(K);
 
     if (lim == 0)
         lim = (UINT32_MAX-1)/2;  /* no limit */
@@ -832,11 +1029,13 @@ void klispC_step (klisp_State *K) {
         klisp_assert(g->totalbytes >= g->estimate);
         setthreshold(g);
     }
+    count_pause(g, ksystem_prof_clock(K) - start);
 }
 
-void klispC_fullgc (klisp_State *K) {
+/* finish the current cycle (if any), returns with gcstate == GCSpause */
+static void finishcycle (klisp_State *K) {
     global_State *g = G(K);
-    if (g->gcstate <= GCSpropagate) {
+    if (g->gcstate == GCSpropagate) {
         /* reset sweep marks to sweep all elements (returning them to white) */
         g->sweepstrgc = 0;
         g->sweepgc = &g->rootgc;
@@ -846,17 +1045,83 @@ void klispC_fullgc (klisp_State *K) {
         g->weak = NULL;
         g->gcstate = GCSsweepstring;
     }
-    klisp_assert(g->gcstate != GCSpause && g->gcstate != GCSpropagate);
     /* finish any pending sweep phase */
-    while (g->gcstate != GCSfinalize) {
-        klisp_assert(g->gcstate == GCSsweepstring || g->gcstate == GCSsweep);
+    while (g->gcstate != GCSpause) {
+        klisp_assert(g->gcstate != GCSpropagate);
         singlestep(K);
     }
+}
+
+/* mark everything & sweep the string table, returns with 
+   gcstate == GCSsweep */
+static void markall (klisp_State *K) {
+    global_State *g = G(K);
+    klisp_assert(g->gcstate == GCSpause);
     markroot(K);
-    while (g->gcstate != GCSpause) {
+    while (g->gcstate != GCSsweep)
         singlestep(K);
-    }
+}
+
+static void endcycle (global_State *g) {
+    klisp_assert(g->gcstate == GCSpause);
     setthreshold(g);
+    /* the memory limit error was handled (see kmem.c) */
+    if (g->totalbytes <= g->gclimit)
+        g->gclimit_hit = false;
+}
+
+void klispC_fullgc (klisp_State *K) {
+    global_State *g = G(K);
+    uint64_t start = ksystem_prof_clock(K);
+    bool running = g->gcrunning;
+    g->gcrunning = true;
+    finishcycle(K);
+    markall(K);
+    finishcycle(K);
+    endcycle(g);
+    g->gcrunning = running;
+    count_pause(g, ksystem_prof_clock(K) - start);
+}
+
+/*
+** Lazy sweep: mark everything (and sweep the string table, see
+** klispS_chains) at once, but leave the sweep of the object list to
+** be done a little at a time on each allocation (see klispC_sweepstep
+** & kmem.c), so that the pause is proportional to the live objects
+** and not to the whole heap.
+*/
+void klispC_lazygc (klisp_State *K) {
+    global_State *g = G(K);
+    uint64_t start = ksystem_prof_clock(K);
+    bool running = g->gcrunning;
+    g->gcrunning = true;
+    finishcycle(K);
+    markall(K);
+    /* don't start another cycle until this one is swept */
+    g->GCthreshold = MAX_KMEM;
+    g->gcrunning = running;
+    count_pause(g, ksystem_prof_clock(K) - start);
+}
+
+void klispC_sweepstep (klisp_State *K) {
+    global_State *g = G(K);
+    uint64_t start = ksystem_prof_clock(K);
+    /* the step multiplier scales the work done on each allocation, the
+       default is GCSWEEPMAX objects */
+    int64_t lim = (int64_t) (GCSWEEPMAX*GCSWEEPCOST) * g->gcstepmul /
+        KLISPI_GCMUL;
+    bool running = g->gcrunning;
+    klisp_assert(klispC_sweeping(g));
+    if (lim == 0)
+        lim = INT64_MAX;  /* no limit, sweep everything now */
+    g->gcrunning = true;
+    /* don't stop in the finalize state, it is quick anyways */
+    while (g->gcstate != GCSpause && (lim > 0 || g->gcstate == GCSfinalize))
+        lim -= singlestep(K);
+    if (g->gcstate == GCSpause)
+        endcycle(g);
+    g->gcrunning = running;
+    count_pause(g, ksystem_prof_clock(K) - start);
 }
 
 /* TODO: make all code using mutation to call these,
@@ -899,5 +1164,7 @@ void klispC_link (klisp_State *K, GCObject *o, uint8_t tt, uint8_t kflags) {
     o->gch.kflags = kflags;
     o->gch.si = NULL;
     /* NOTE that o->gch.gclist doesn't need to be setted */
+    if (g->hprof_weight != 0) /* heap profiler sample due */
+        klispP_heap_sample(K, o, tt);
 }
 
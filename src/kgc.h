@@ -55,6 +55,7 @@
 ** bit 4 - for tables: has weak values
 ** bit 5 - object is fixed (should not be collected)
 ** bit 6 - object is "super" fixed (only the main thread)
+** bit 7 - object is registered in a guardian (see make-guardian)
 */
 
 
@@ -66,6 +67,7 @@
 #define VALUEWEAKBIT	4
 #define FIXEDBIT	5
 #define SFIXEDBIT	6
+#define GUARDEDBIT	7
 #define WHITEBITS	bit2mask(WHITE0BIT, WHITE1BIT)
 
 
@@ -83,6 +85,10 @@
 
 #define klispC_white(g)	cast(uint16_t, (g)->currentwhite & WHITEBITS)
 
+/* a lazy sweep is pending (see klispC_lazygc) */
+#define klispC_sweeping(g)	((g)->gcstate >= GCSsweepstring &&	\
+                                 (g)->gcstate <= GCSfinalize)
+
 
 #define klispC_checkGC(K) {                     \
         if (G(K)->totalbytes >= G(K)->GCthreshold)  \
@@ -104,9 +110,14 @@
 
 /* size_t klispC_separateudata (klisp_State *K, int all); */
 /* void klispC_callGCTM (klisp_State *K); */
+/* names of the types of collectable objects, by type tag (or NULL) */
+extern const char *const klispC_type_names[KGC_NTYPES];
+
 void klispC_freeall (klisp_State *K);
 void klispC_step (klisp_State *K);
 void klispC_fullgc (klisp_State *K);
+void klispC_lazygc (klisp_State *K);
+void klispC_sweepstep (klisp_State *K);
 void klispC_link (klisp_State *K, GCObject *o, uint8_t tt, uint8_t flags);
 void klispC_barrierf (klisp_State *K, GCObject *o, GCObject *v);
 void klispC_barrierback (klisp_State *K, Table *t);
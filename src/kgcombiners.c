@@ -293,11 +293,13 @@ void do_map(klisp_State *K)
     klisp_assert(ttisnil(K->next_env));
     /*
     ** xparams[0]: app
-    ** xparams[1]: rem-ls
+    ** xparams[1]: rem-lss (the remaining part of each list)
     ** xparams[2]: last-pair
     ** xparams[3]: n
     ** xparams[4]: denv
     ** xparams[5]: dummyp
+    ** xparams[6]: app_apairs
+    ** xparams[7]: app_cpairs
     */
     TValue app = xparams[0];
     TValue ls = xparams[1];
@@ -305,6 +307,8 @@ void do_map(klisp_State *K)
     int32_t n = ivalue(xparams[3]);
     TValue denv = xparams[4];
     bool dummyp = bvalue(xparams[5]);
+    int32_t app_apairs = ivalue(xparams[6]);
+    int32_t app_cpairs = ivalue(xparams[7]);
 
     /* this case is used to kick start the mapping of both
        the acyclic and cyclic part, avoiding code duplication */
@@ -315,24 +319,26 @@ void do_map(klisp_State *K)
     }
 
     if (n == 0) {
-        /* pass the rest of the list and last pair for cycle handling */
+        /* pass the rest of the lists and last pair for cycle handling */
         kapply_cc(K, kcons(K, ls, last_pair));
     } else {
-        /* copy the ptree to avoid problems with mutation */
-        /* XXX: no check necessary, could just use copy_list if there
-           was such a procedure */
-        TValue first_ptree = check_copy_list(K, kcar(ls), false, NULL, NULL);
-        ls = kcdr(ls);
-        n = n-1;
+        /* build the ptree for this call, and advance the lists. 
+           Both are new lists, so there are no problems with mutation */
+        krooted_vars_push(K, &ls);
+        TValue first_ptree = 
+            map_for_each_get_cars_cdrs(K, &ls, app_apairs, app_cpairs);
         krooted_tvs_push(K, first_ptree);
+        n = n-1;
         /* have to unwrap the applicative to avoid extra evaluation of first */
         TValue new_expr = kcons(K, kunwrap(app), first_ptree);
         krooted_tvs_push(K, new_expr);
         TValue new_cont = 
-            kmake_continuation(K, kget_cc(K), do_map, 6, app, 
-                               ls, last_pair, i2tv(n), denv, KFALSE);
+            kmake_continuation(K, kget_cc(K), do_map, 8, app, 
+                               ls, last_pair, i2tv(n), denv, KFALSE,
+                               i2tv(app_apairs), i2tv(app_cpairs));
         krooted_tvs_pop(K); 
         krooted_tvs_pop(K); 
+        krooted_vars_pop(K);
         kset_cc(K, new_cont);
         ktail_eval(K, new_expr, denv);
     }
@@ -348,6 +354,8 @@ void do_map_cycle(klisp_State *K)
     ** xparams[1]: (dummy . res-list)
     ** xparams[2]: cpairs
     ** xparams[3]: denv
+    ** xparams[4]: app_apairs
+    ** xparams[5]: app_cpairs
     */ 
 
     TValue app = xparams[0];
@@ -369,8 +377,9 @@ void do_map_cycle(klisp_State *K)
        signal dummyp = true to avoid creating a pair for
        the inert value passed to the first continuation */
     TValue new_cont = 
-        kmake_continuation(K, encycle_cont, do_map, 6, app, ls, 
-                           last_apair, i2tv(cpairs), denv, KTRUE);
+        kmake_continuation(K, encycle_cont, do_map, 8, app, ls, 
+                           last_apair, i2tv(cpairs), denv, KTRUE,
+                           xparams[4], xparams[5]);
     klisp_assert(ttisenvironment(denv));
 
     krooted_tvs_pop(K); 
@@ -407,9 +416,8 @@ void map(klisp_State *K)
     UNUSED(app_pairs);
     UNUSED(res_pairs);
 
-    /* create the list of parameters to app */
-    lss = map_for_each_transpose(K, lss, app_apairs, app_cpairs, 
-                                 res_apairs, res_cpairs);
+    /* The lists are traversed in parallel, the list of parameters to 
+       app for each call is only created when it's needed (see do_map) */
 
     /* ASK John: the semantics when this is mixed with continuations,
        isn't all that great..., but what are the expectations considering
@@ -424,8 +432,9 @@ void map(klisp_State *K)
 
     TValue ret_cont = (res_cpairs == 0)?
         kmake_continuation(K, kget_cc(K), do_map_ret, 1, dummy)
-        : kmake_continuation(K, kget_cc(K), do_map_cycle, 4, 
-                             app, dummy, i2tv(res_cpairs), denv);
+        : kmake_continuation(K, kget_cc(K), do_map_cycle, 6, 
+                             app, dummy, i2tv(res_cpairs), denv,
+                             i2tv(app_apairs), i2tv(app_cpairs));
 
     krooted_tvs_push(K, ret_cont);
 
@@ -433,8 +442,9 @@ void map(klisp_State *K)
        signal dummyp = true to avoid creating a pair for
        the inert value passed to the first continuation */
     TValue new_cont = 
-        kmake_continuation(K, ret_cont, do_map, 6, app, lss, dummy,
-                           i2tv(res_apairs), denv, KTRUE);
+        kmake_continuation(K, ret_cont, do_map, 8, app, lss, dummy,
+                           i2tv(res_apairs), denv, KTRUE,
+                           i2tv(app_apairs), i2tv(app_cpairs));
 
     krooted_tvs_pop(K); 
     krooted_tvs_pop(K); 
@@ -540,16 +550,13 @@ void array_map(klisp_State *K)
         tail = kcdr(tail);
     }
     
-    /* create the list of parameters to app */
-    lss = map_for_each_transpose(K, lss, app_apairs, app_cpairs, 
-                                 res_pairs, 0); /* cycle pairs is always 0 */
+    /* The lists are traversed in parallel, the list of parameters to 
+       app for each call is only created when it's needed (see do_map) */
 
     /* ASK John: the semantics when this is mixed with continuations,
        isn't all that great..., but what are the expectations considering
        there is no prescribed order? */
 
-    krooted_tvs_pop(K);
-    krooted_tvs_push(K, lss);
     /* This will be the list to be returned, but it will be transformed
        to an array before returning (making it also play a little nicer 
        with continuations) */
@@ -566,8 +573,9 @@ void array_map(klisp_State *K)
        signal dummyp = true to avoid creating a pair for
        the inert value passed to the first continuation */
     TValue new_cont = 
-        kmake_continuation(K, ret_cont, do_map, 6, app, lss, dummy,
-                           i2tv(res_pairs), denv, KTRUE);
+        kmake_continuation(K, ret_cont, do_map, 8, app, lss, dummy,
+                           i2tv(res_pairs), denv, KTRUE,
+                           i2tv(app_apairs), i2tv(app_cpairs));
 
     krooted_tvs_pop(K); 
     krooted_tvs_pop(K); 
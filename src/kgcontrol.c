@@ -297,14 +297,18 @@ void do_for_each(klisp_State *K)
     klisp_assert(ttisnil(K->next_env));
     /*
     ** xparams[0]: app
-    ** xparams[1]: rem-ls
+    ** xparams[1]: rem-lss (the remaining part of each list)
     ** xparams[2]: n
     ** xparams[3]: denv
+    ** xparams[4]: app_apairs
+    ** xparams[5]: app_cpairs
     */
     TValue app = xparams[0];
     TValue ls = xparams[1];
     int32_t n = ivalue(xparams[2]);
     TValue denv = xparams[3];
+    int32_t app_apairs = ivalue(xparams[4]);
+    int32_t app_cpairs = ivalue(xparams[5]);
 
     /* the resulting value is just ignored */
     UNUSED(obj);
@@ -313,20 +317,24 @@ void do_for_each(klisp_State *K)
         /* return inert as the final result to for-each */
         kapply_cc(K, KINERT);
     } else {
-        /* copy the ptree to avoid problems with mutation */
-        /* XXX: no check necessary, could just use copy_list if there
-           was such a procedure */
-        TValue first_ptree = check_copy_list(K, kcar(ls), false, NULL, NULL);
+        /* build the ptree for this call, and advance the lists. 
+           Both are new lists, so there are no problems with mutation */
+        krooted_vars_push(K, &ls);
+        TValue first_ptree = 
+            map_for_each_get_cars_cdrs(K, &ls, app_apairs, app_cpairs);
         krooted_tvs_push(K, first_ptree);
-        ls = kcdr(ls);
         n = n-1;
 
         /* have to unwrap the applicative to avoid extra evaluation of first */
         TValue new_expr = kcons(K, kunwrap(app), first_ptree);
+        krooted_tvs_push(K, new_expr);
         TValue new_cont = 
-            kmake_continuation(K, kget_cc(K), do_for_each, 4, 
-                               app, ls, i2tv(n), denv);
+            kmake_continuation(K, kget_cc(K), do_for_each, 6, 
+                               app, ls, i2tv(n), denv, i2tv(app_apairs),
+                               i2tv(app_cpairs));
         krooted_tvs_pop(K);
+        krooted_tvs_pop(K);
+        krooted_vars_pop(K);
         kset_cc(K, new_cont);
         ktail_eval(K, new_expr, denv);
     }
@@ -359,17 +367,17 @@ void for_each(klisp_State *K)
     UNUSED(app_pairs);
     res_pairs = res_apairs + res_cpairs;
 
-    /* create the list of parameters to app */
-    lss = map_for_each_transpose(K, lss, app_apairs, app_cpairs, 
-                                 res_apairs, res_cpairs);
-
+    /* The lists are traversed in parallel, the list of parameters to 
+       app for each call is only created when it's needed (see 
+       do_for_each) */
     krooted_tvs_push(K, lss);
 
     /* schedule all elements at once, the cycle is just ignored, this
        will also return #inert once done. */
     TValue new_cont = 
-        kmake_continuation(K, kget_cc(K), do_for_each, 4, app, lss,
-                           i2tv(res_pairs), denv);
+        kmake_continuation(K, kget_cc(K), do_for_each, 6, app, lss,
+                           i2tv(res_pairs), denv, i2tv(app_apairs),
+                           i2tv(app_cpairs));
     kset_cc(K, new_cont);
     krooted_tvs_pop(K);
     /* this will be a nop */
@@ -427,22 +435,20 @@ void array_for_each(klisp_State *K)
         tail = kcdr(tail);
     }
     
-    /* create the list of parameters to app */
-    lss = map_for_each_transpose(K, lss, app_apairs, app_cpairs, 
-                                 res_pairs, 0); /* cycle pairs is always 0 */
+    /* The lists are traversed in parallel, the list of parameters to 
+       app for each call is only created when it's needed (see 
+       do_for_each) */
 
     /* ASK John: the semantics when this is mixed with continuations,
        isn't all that great..., but what are the expectations considering
        there is no prescribed order? */
 
-    krooted_tvs_pop(K);
-    krooted_tvs_push(K, lss);
-
     /* schedule all elements at once, this will also return #inert once 
        done. */
     TValue new_cont = 
-        kmake_continuation(K, kget_cc(K), do_for_each, 4, app, lss,
-                           i2tv(res_pairs), denv);
+        kmake_continuation(K, kget_cc(K), do_for_each, 6, app, lss,
+                           i2tv(res_pairs), denv, i2tv(app_apairs),
+                           i2tv(app_cpairs));
     kset_cc(K, new_cont);
     krooted_tvs_pop(K);
     /* this will be a nop */
@@ -12,4 +12,7 @@
 /* init ground */
 void kinit_equalp_ground_env(klisp_State *K);
 
+/* for kget_ground_bpred */
+void equalp(klisp_State *K);
+
 #endif
@@ -0,0 +1,253 @@
+/*
+** kggc.c
+** Garbage collector features for the ground environment
+** See Copyright Notice in klisp.h
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "kstate.h"
+#include "kobject.h"
+#include "kpair.h"
+#include "ktable.h"
+#include "kapplicative.h"
+#include "ksymbol.h"
+#include "kinteger.h"
+#include "kerror.h"
+#include "kgc.h"
+
+#include "kghelpers.h"
+#include "kggc.h"
+
+/* conses (name . val) to *res, GC: assumes *res & val are rooted */
+static void push_stat(klisp_State *K, TValue *res, const char *name, 
+                      TValue val)
+{
+    TValue sym = ksymbol_new_b(K, name, KNIL);
+    krooted_tvs_push(K, sym);
+    TValue entry = kcons(K, sym, val);
+    krooted_tvs_push(K, entry);
+    *res = kcons(K, entry, *res);
+    krooted_tvs_pop(K);
+    krooted_tvs_pop(K);
+}
+
+/* GC: assumes *res is rooted */
+static void push_int_stat(klisp_State *K, TValue *res, const char *name, 
+                          uint64_t n)
+{
+    TValue val = kinteger_new_uint64(K, n);
+    krooted_tvs_push(K, val);
+    push_stat(K, res, name, val);
+    krooted_tvs_pop(K);
+}
+
+/* GC: assumes *res is rooted */
+static void push_type_stat(klisp_State *K, TValue *res, const char *name, 
+                           bool livep)
+{
+    global_State *g = G(K);
+    TValue types = KNIL;
+    krooted_vars_push(K, &types);
+    for (int32_t i = KGC_NTYPES - 1; i >= 0; --i) {
+        uint64_t n = livep? g->gc_live[i] : g->gc_freed[i];
+        if (klispC_type_names[i] != NULL && n > 0)
+            push_int_stat(K, &types, klispC_type_names[i], n);
+    }
+    push_stat(K, res, name, types);
+    krooted_vars_pop(K);
+}
+
+/* gc-stats */
+static void gc_stats(klisp_State *K)
+{
+    TValue ptree = K->next_value;
+    check_0p(K, ptree);
+
+    global_State *g = G(K);
+    TValue res = KNIL;
+    krooted_vars_push(K, &res);
+    /* built in reverse */
+    push_type_stat(K, &res, "freed-objects", false);
+    push_type_stat(K, &res, "live-objects", true);
+    push_int_stat(K, &res, "freed-bytes-objects", g->gc_freed_objects);
+    push_int_stat(K, &res, "freed-bytes-strings", g->gc_freed_strings);
+    push_int_stat(K, &res, "max-pause-time", g->gc_max_nsecs);
+    push_int_stat(K, &res, "pause-time", g->gc_nsecs);
+    push_int_stat(K, &res, "collections", g->gc_count);
+    push_int_stat(K, &res, "allocated-bytes", g->gc_allocated);
+    push_int_stat(K, &res, "limit", g->gclimit);
+    push_int_stat(K, &res, "stepmul", g->gcstepmul);
+    push_int_stat(K, &res, "pause", g->gcpause);
+    push_int_stat(K, &res, "debt", g->gcdept);
+    push_int_stat(K, &res, "threshold", g->GCthreshold);
+    push_int_stat(K, &res, "estimate", g->estimate);
+    push_int_stat(K, &res, "total-bytes", g->totalbytes);
+    krooted_vars_pop(K);
+    kapply_cc(K, res);
+}
+
+/* gc-collect! */
+static void gc_collectB(klisp_State *K)
+{
+    TValue ptree = K->next_value;
+    check_0p(K, ptree);
+
+    klispC_fullgc(K);
+    kapply_cc(K, KINERT);
+}
+
+/* make-guardian */
+/* A guardian is an applicative, (guardian obj) registers obj & 
+   (guardian) returns one of the registered objects that were found
+   unreachable by the collector (which keeps them alive after that),
+   or #f if there are none (see separateguarded in kgc.c) */
+static void guardian(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    /*
+    ** xparams[0]: state, a pair whose car is the list of unreachable
+    **             objects ready to be returned
+    */
+    TValue state = xparams[0];
+    if (ttisnil(ptree)) {
+        TValue ready = kcar(state);
+        if (ttisnil(ready)) {
+            kapply_cc(K, KFALSE);
+        } else {
+            kset_car(state, kcdr(ready));
+            kapply_cc(K, kcar(ready));
+        }
+        return;
+    }
+
+    bind_1p(K, ptree, obj);
+    if (iscollectable(obj)) { /* the others are never collected */
+        Table *t = tv2table(G(K)->guarded);
+        TValue node = kcons(K, state, KNIL);
+        krooted_tvs_push(K, node);
+        const TValue *ls = klispH_get(K, t, obj);
+        node = kcons(K, node, ls == &kfree? KNIL : *ls);
+        krooted_tvs_pop(K);
+        krooted_tvs_push(K, node);
+        /* obj is rooted in the ptree */
+        *klispH_set(K, t, obj) = node;
+        krooted_tvs_pop(K);
+        /* see isinterned in kgc.c */
+        k_setbit(gcvalue(obj)->gch.gct, GUARDEDBIT);
+    }
+    kapply_cc(K, KINERT);
+}
+
+static void make_guardian(klisp_State *K)
+{
+    TValue ptree = K->next_value;
+    check_0p(K, ptree);
+
+    TValue state = kcons(K, KNIL, KNIL);
+    krooted_tvs_push(K, state);
+    TValue app = kmake_applicative(K, guardian, 1, state);
+    krooted_tvs_pop(K);
+    kapply_cc(K, app);
+}
+
+/* Helper for gc-step! and gc-set-xxx! */
+static int32_t get_gc_param(klisp_State *K, TValue obj)
+{
+    if (knegativep(obj)) {
+        klispE_throw_simple_with_irritants(K, "negative argument", 1, obj);
+        return 0;
+    } else if (!ttisfixint(obj)) {
+        klispE_throw_simple_with_irritants(K, "argument is too big", 1, obj);
+        return 0;
+    }
+    return ivalue(obj);
+}
+
+/* gc-step! */
+/* NOTE: as in lua, the argument is in kilobytes. The collector is 
+   stop-the-world (the incremental write barriers aren't in place yet),
+   so instead of doing an incremental step, the allocation debt is 
+   increased by that amount and a full collection is done if the 
+   threshold is reached, in which case the result is true */
+static void gc_stepB(klisp_State *K)
+{
+    TValue ptree = K->next_value;
+    bind_1tp(K, ptree, "exact integer", keintegerp, tv_n);
+    kmem_t n = (kmem_t) get_gc_param(K, tv_n);
+    n = (n > MAX_KMEM / 1024)? MAX_KMEM : n * 1024;
+
+    global_State *g = G(K);
+    if (n >= g->GCthreshold || g->totalbytes >= g->GCthreshold - n) {
+        klispC_fullgc(K);
+        kapply_cc(K, KTRUE);
+    } else {
+        g->GCthreshold -= n;
+        kapply_cc(K, KFALSE);
+    }
+}
+
+/* gc-set-pause!, gc-set-stepmul! */
+/* the new threshold takes effect after the next collection,
+   these return the previous value */
+static void gc_set_paramB(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    /*
+    ** xparams[0]: true for pause, false for stepmul
+    */
+    bool pausep = bvalue(xparams[0]);
+    bind_1tp(K, ptree, "exact integer", keintegerp, tv_p);
+    int32_t p = get_gc_param(K, tv_p);
+
+    global_State *g = G(K);
+    int32_t *param = pausep? &g->gcpause : &g->gcstepmul;
+    int32_t old = *param;
+    *param = p;
+    kapply_cc(K, i2tv(old));
+}
+
+/* gc-set-limit! */
+/* 0 means no limit, returns the previous limit */
+static void gc_set_limitB(klisp_State *K)
+{
+    TValue ptree = K->next_value;
+    bind_1tp(K, ptree, "exact integer", keintegerp, tv_limit);
+
+    uint64_t limit;
+    if (knegativep(tv_limit)) {
+        klispE_throw_simple_with_irritants(K, "negative argument", 1, 
+                                           tv_limit);
+        return;
+    } else if (!kinteger_to_uint64(tv_limit, &limit) || limit > MAX_KMEM) {
+        klispE_throw_simple_with_irritants(K, "argument is too big", 1, 
+                                           tv_limit);
+        return;
+    }
+
+    global_State *g = G(K);
+    kmem_t old = g->gclimit;
+    g->gclimit = (kmem_t) limit;
+    g->gclimit_hit = false;
+    kapply_cc(K, kinteger_new_uint64(K, old));
+}
+
+/* init ground */
+void kinit_gc_ground_env(klisp_State *K)
+{
+    TValue ground_env = G(K)->ground_env;
+    TValue symbol, value;
+
+    add_applicative(K, ground_env, "gc-stats", gc_stats, 0);
+    add_applicative(K, ground_env, "gc-collect!", gc_collectB, 0);
+    add_applicative(K, ground_env, "gc-step!", gc_stepB, 0);
+    add_applicative(K, ground_env, "gc-set-pause!", gc_set_paramB, 1, 
+                    b2tv(true));
+    add_applicative(K, ground_env, "gc-set-stepmul!", gc_set_paramB, 1, 
+                    b2tv(false));
+    add_applicative(K, ground_env, "gc-set-limit!", gc_set_limitB, 0);
+    add_applicative(K, ground_env, "make-guardian", make_guardian, 0);
+}
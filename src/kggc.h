@@ -0,0 +1,15 @@
+/*
+** kggc.h
+** Garbage collector features for the ground environment
+** See Copyright Notice in klisp.h
+*/
+
+#ifndef kggc_h
+#define kggc_h
+
+#include "kstate.h"
+
+/* init ground */
+void kinit_gc_ground_env(klisp_State *K);
+
+#endif
@@ -6,6 +6,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -26,6 +27,9 @@
 #include "kcontinuation.h"
 #include "kencapsulation.h"
 #include "kpromise.h"
+#include "kgeqp.h"
+#include "kgequalp.h"
+#include "kgnumbers.h"
 
 /* XXX lock? */
 /* Initialization of continuation names */
@@ -39,6 +43,8 @@ void kinit_kghelpers_cont_names(klisp_State *K)
     add_cont_name(K, t, do_bind, "dynamic-access");
     add_cont_name(K, t, do_bind, "dynamic-unbind");
     add_cont_name(K, t, do_bind, "dynamic-set!-pass");
+    add_cont_name(K, t, do_sort, "sort");
+    add_cont_name(K, t, do_fold, "fold");
 }
 
 /* Type predicates */
@@ -870,6 +876,86 @@ int32_t ksmallest_index(klisp_State *K, TValue obj, TValue tk)
     return ivalue(idx) + apairs; 
 }
 
+void get_opt_range(klisp_State *K, TValue rest, int32_t size, 
+                   int32_t *start, int32_t *end)
+{
+    TValue tv_start = KNIL, tv_end = KNIL;
+    if (ttispair(rest)) {
+        tv_start = kcar(rest);
+        rest = kcdr(rest);
+        if (ttispair(rest)) {
+            tv_end = kcar(rest);
+            rest = kcdr(rest);
+        }
+    }
+    if (!ttisnil(rest)) {
+        klispE_throw_simple(K, "Bad ptree structure "
+                            "(in optional argument)");
+        return;
+    } else if ((!ttisnil(tv_start) && !keintegerp(tv_start)) ||
+               (!ttisnil(tv_end) && !keintegerp(tv_end))) {
+        klispE_throw_simple(K, "Bad type on optional argument "
+                            "(expected exact integer)");
+        return;
+    }
+
+    *start = 0;
+    *end = size;
+    if (!ttisnil(tv_start)) {
+        if (!ttisfixint(tv_start) || ivalue(tv_start) < 0 ||
+            ivalue(tv_start) > size) {
+            /* TODO show index */
+            klispE_throw_simple(K, "start index out of bounds");
+            return;
+        }
+        *start = ivalue(tv_start);
+    }
+    if (!ttisnil(tv_end)) {
+        if (!ttisfixint(tv_end) || ivalue(tv_end) < 0 ||
+            ivalue(tv_end) > size) {
+            klispE_throw_simple(K, "end index out of bounds");
+            return;
+        }
+        *end = ivalue(tv_end);
+    }
+    if (*start > *end) {
+        /* TODO show indexes */
+        klispE_throw_simple(K, "end index is smaller than start index");
+        return;
+    }
+}
+
+/* Helper for sort, assoc & member? */
+bool kget_ground_bpred(TValue app, kbpred *bpred)
+{
+    if (!ttisapplicative(app))
+        return false;
+    /* only one level of wrapping, otherwise the arguments would be
+       evaluated */
+    TValue op = kunwrap(app);
+    if (!ttisoperative(op))
+        return false;
+
+    Operative *o = tv2op(op);
+    bpred->typep = NULL;
+    bpred->predp = NULL;
+    bpred->kpredp = NULL;
+    if (o->fn == ftyped_bpredp) {
+        bpred->typep = pvalue(o->extra[1]);
+        bpred->predp = pvalue(o->extra[2]);
+    } else if (o->fn == ftyped_kbpredp) {
+        bpred->typep = pvalue(o->extra[1]);
+        bpred->kpredp = pvalue(o->extra[2]);
+    } else if (o->fn == eqp) {
+        bpred->kpredp = eq2p;
+    } else if (o->fn == equalp) {
+        bpred->kpredp = equal2p;
+    } else {
+        return false;
+    }
+    return true;
+}
+
 /* Helper for eq? and equal? */
 bool eq2p(klisp_State *K, TValue obj1, TValue obj2)
 {
@@ -995,6 +1081,69 @@ static inline bool equal_find2_mergep(klisp_State *K, TValue obj1, TValue obj2)
     }
 }
 
+/*
+** Before using the algorithm below, which marks every pair & vector
+** compared and has to unmark them afterwards, a simple recursive 
+** comparison is tried. This doesn't detect cycles, so it gives up after
+** comparing EQUAL_FAST_BUDGET objects (or reaching a depth of 
+** EQUAL_FAST_DEPTH), in that case the full algorithm is used.
+** A difference found by the simple comparison is final, even in cyclic 
+** structures.
+*/
+#define EQUAL_FAST_BUDGET 4096
+#define EQUAL_FAST_DEPTH 128
+
+/* returns 1 if equal, 0 if not, and -1 if it gave up */
+static int equal_fastp(klisp_State *K, TValue obj1, TValue obj2, 
+                       int32_t depth, int32_t *budget)
+{
+    while(true) {
+        if (eq2p(K, obj1, obj2))
+            return 1;
+        else if (ttype(obj1) != ttype(obj2))
+            return 0;
+        else if (--(*budget) < 0)
+            return -1;
+
+        switch(ttype(obj1)) {
+        case K_TPAIR: {
+            if (depth <= 0)
+                return -1;
+            int res = equal_fastp(K, kcar(obj1), kcar(obj2), depth - 1, 
+                                  budget);
+            if (res != 1)
+                return res;
+            /* loop instead of recursing on the cdrs, for long lists */
+            obj1 = kcdr(obj1);
+            obj2 = kcdr(obj2);
+            break;
+        }
+        case K_TVECTOR: {
+            uint32_t size = kvector_size(obj1);
+            if (size != kvector_size(obj2))
+                return 0;
+            else if (depth <= 0)
+                return -1;
+            TValue *array1 = kvector_buf(obj1);
+            TValue *array2 = kvector_buf(obj2);
+            for (uint32_t i = 0; i < size; ++i) {
+                int res = equal_fastp(K, array1[i], array2[i], depth - 1, 
+                                      budget);
+                if (res != 1)
+                    return res;
+            }
+            return 1;
+        }
+        case K_TSTRING:
+            return kstring_equalp(obj1, obj2);
+        case K_TBYTEVECTOR:
+            return kbytevector_equalp(K, obj1, obj2);
+        default:
+            return 0;
+        }
+    }
+}
+
 /*
 ** See [1] for details, in this case the pairs form a possibly infinite "tree" 
 ** structure, and that can be seen as a finite automata, where each node is a 
@@ -1011,6 +1160,12 @@ bool equal2p(klisp_State *K, TValue obj1, TValue obj2)
 {
     assert(ks_sisempty(K));
 
+    /* first try without marking, this is enough for most objects */
+    int32_t budget = EQUAL_FAST_BUDGET;
+    int res = equal_fastp(K, obj1, obj2, EQUAL_FAST_DEPTH, &budget);
+    if (res >= 0)
+        return res == 1;
+
     /* the stack has the elements to be compaired, always in pairs.
        So the top should be compared with the one below, the third with
        the fourth and so on */
@@ -1488,6 +1643,12 @@ TValue map_for_each_get_cars_cdrs(klisp_State *K, TValue *lss,
         while(pairs--) {
             TValue first = kcar(tail);
             tail = kcdr(tail);
+
+            if (!ttispair(first)) {
+                /* the list was mutated since it was checked */
+                klispE_throw_simple(K, "list changed during map/for-each");
+                return KNIL;
+            }
 	 
             /* accumulate both cars and cdrs */
             TValue np;
@@ -1522,67 +1683,6 @@ TValue map_for_each_get_cars_cdrs(klisp_State *K, TValue *lss,
     return kcdr(cars);
 }
 
-/* Transpose lss so that the result is a list of lists, each one having
-   metrics (app_apairs, app_cpairs). The metrics of the returned list
-   should be (res_apairs, res_cpairs) */
-
-/* GC: assumes lss is rooted */
-TValue map_for_each_transpose(klisp_State *K, TValue lss, 
-                              int32_t app_apairs, int32_t app_cpairs, 
-                              int32_t res_apairs, int32_t res_cpairs)
-{
-    TValue tlist = kcons(K, KNIL, KNIL);
-    krooted_vars_push(K, &tlist);    
-    TValue lp = tlist;
-    TValue lap = lp;
-
-    TValue cars = KNIL; /* put something for GC */
-    TValue tail = lss;
-
-    /* GC: both cars & tail vary in each loop, to protect them we need
-       the vars stack */
-    krooted_vars_push(K, &cars);
-    krooted_vars_push(K, &tail);
-    
-    /* Loop over list of lists, creating a list of cars and 
-       a list of cdrs, accumulate the list of cars and loop
-       with the list of cdrs as the new list of lists (lss) */
-    while(res_apairs != 0 || res_cpairs != 0) {
-        int32_t pairs;
-	
-        if (res_apairs != 0) {
-            pairs = res_apairs;
-        } else {
-            pairs = res_cpairs;
-            /* remember last acyclic pair to encycle! later */
-            lap = lp;
-        }
-
-        while(pairs--) {
-            /* accumulate cars and replace tail with cdrs */
-            cars = map_for_each_get_cars_cdrs(K, &tail, app_apairs, app_cpairs);
-            TValue np = kcons(K, cars, KNIL);
-            kset_cdr(lp, np);
-            lp = np;
-        }
-
-        if (res_apairs != 0) {
-            res_apairs = 0;
-        } else {
-            res_cpairs = 0;
-            /* encycle! the list of list of cars */
-            TValue fcp = kcdr(lap);
-            TValue lcp = lp;
-            kset_cdr(lcp, fcp);
-        }
-    }
-
-    krooted_vars_pop(K);
-    krooted_vars_pop(K);
-    krooted_vars_pop(K);
-    return kcdr(tlist);
-}
-
 /* Continuations that are used in more than one file */
 
 /* Helper for $sequence, $vau, $lambda, ... */
@@ -1964,3 +2064,402 @@ void do_int_mark_root(klisp_State *K)
     /* pass #INERT to the root continuation */
     kapply_cc(K, KINERT);
 }
+
+/*
+** Sorting (sort, sort!, list-sort, vector-sort!)
+** The elements are copied to a vector and sorted there with a stable,
+** bottom up merge sort. Then the result is written back to the sequence
+** or returned as a new list/vector.
+** If less? is a ground typed comparison (like <?, string<? or char<?)
+** the comparisons are done directly in C. Otherwise each comparison
+** is evaluated, and its result passed to a continuation (do_sort). 
+** The whole state of the sort is kept in the xparams of that 
+** continuation, and each pass of the merge sort writes to a new vector,
+** so capturing and reentering it with call/cc is safe.
+*/
+
+/* the sorted elements are in arr, copyp is true if arr may still be
+   modified by reentering a sort continuation. Returns the value to pass
+   to the continuation */
+/* GC: Assumes arr & seq are rooted */
+static TValue sort_result(klisp_State *K, TValue arr, TValue seq, 
+                          bool destructive, bool copyp)
+{
+    uint32_t n = kvector_size(arr);
+    TValue *buf = kvector_buf(arr);
+
+    if (destructive) {
+        if (ttisvector(seq)) {
+            /* less? may have changed the size of the vector, writing
+               to the current buffer is fine if the size is the same */
+            if (kvector_size(seq) != n) {
+                klispE_throw_simple(K, "vector changed while sorting");
+                return KINERT;
+            }
+            memcpy(kvector_buf(seq), buf, n * sizeof(TValue));
+        } else {
+            /* less? may have changed the list */
+            TValue tail = seq;
+            for (uint32_t i = 0; i < n; ++i, tail = kcdr(tail)) {
+                if (!kmutable_pairp(tail)) {
+                    klispE_throw_simple(K, "list changed while sorting");
+                    return KINERT;
+                }
+                kset_car(tail, buf[i]);
+            }
+        }
+        return KINERT;
+    } else if (ttisvector(seq)) {
+        return copyp? kvector_new_bs_g(K, true, buf, n) : arr;
+    } else {
+        TValue res = KNIL;
+        krooted_vars_push(K, &res);
+        while(n-- > 0)
+            res = kcons(K, buf[n], res);
+        krooted_vars_pop(K);
+        return res;
+    }
+}
+
+/* runs shorter than this are sorted with insertion sort */
+#define SORT_RUN 8
+
+/* merge src[lo, mid) & src[mid, hi) into dst[lo, hi) */
+static void sort_merge(klisp_State *K, kbpred *cmp, TValue *src, 
+                       TValue *dst, uint32_t lo, uint32_t mid, uint32_t hi)
+{
+    uint32_t i = lo, j = mid, k = lo;
+    while(i < mid && j < hi) {
+        /* only take from the right run if it's strictly less, to keep
+           the sort stable */
+        dst[k++] = kbpred_call(K, cmp, src[j], src[i])? src[j++] : src[i++];
+    }
+    while(i < mid)
+        dst[k++] = src[i++];
+    while(j < hi)
+        dst[k++] = src[j++];
+}
+
+/* sorts the elements of src, returns the vector with the result 
+   (either src or tmp) */
+/* GC: Assumes src & tmp are rooted */
+static TValue sort_fast(klisp_State *K, kbpred *cmp, TValue src, 
+                        TValue tmp)
+{
+    uint32_t n = kvector_size(src);
+    TValue *buf = kvector_buf(src);
+
+    /* the comparisons can't fail if the types are right */
+    for (uint32_t i = 0; i < n; ++i) {
+        if (!kbpred_typep(cmp, buf[i])) {
+            klispE_throw_simple(K, "bad argument type");
+            return KINERT;
+        }
+    }
+
+    /* insertion sort for small runs */
+    for (uint32_t lo = 0; lo < n; lo += SORT_RUN) {
+        uint32_t hi = lo + SORT_RUN < n? lo + SORT_RUN : n;
+        for (uint32_t i = lo + 1; i < hi; ++i) {
+            TValue obj = buf[i];
+            uint32_t j = i;
+            while(j > lo && kbpred_call(K, cmp, obj, buf[j-1])) {
+                buf[j] = buf[j-1];
+                --j;
+            }
+            buf[j] = obj;
+        }
+    }
+
+    /* merge the runs, alternating between src & tmp */
+    for (uint32_t width = SORT_RUN; width < n; width *= 2) {
+        TValue *dst = kvector_buf(tmp);
+        for (uint32_t lo = 0; lo < n; lo += 2 * width) {
+            uint32_t mid = lo + width < n? lo + width : n;
+            uint32_t hi = mid + width < n? mid + width : n;
+            sort_merge(K, cmp, buf, dst, lo, mid, hi);
+        }
+        TValue t = src; src = tmp; tmp = t;
+        buf = kvector_buf(src);
+    }
+    return src;
+}
+
+/* Continue merging until a comparison is needed or the sort is done */
+/* GC: Assumes less, denv & seq are rooted, src & dst are rooted here 
+   (they change between passes) and kept in the xparams of the new 
+   continuation */
+static void sort_step(klisp_State *K, TValue less, TValue denv, TValue seq,
+                      TValue destructivep, TValue src, TValue dst, 
+                      uint32_t width, uint32_t lo, uint32_t i, uint32_t j)
+{
+    uint32_t n = kvector_size(src);
+    krooted_vars_push(K, &src);
+    krooted_vars_push(K, &dst);
+
+    while(true) {
+        uint32_t mid = lo + width < n? lo + width : n;
+        uint32_t hi = mid + width < n? mid + width : n;
+        TValue *sbuf = kvector_buf(src);
+        TValue *dbuf = kvector_buf(dst);
+
+        if (i < mid && j < hi) {
+            /* have to unwrap the applicative to avoid extra evaluation of
+               the elements */
+            TValue expr = klist(K, 3, kunwrap(less), sbuf[j], sbuf[i]);
+            krooted_tvs_push(K, expr);
+            TValue new_cont = 
+                kmake_continuation(K, kget_cc(K), do_sort, 10, less, denv, 
+                                   seq, destructivep, src, dst, 
+                                   i2tv(width), i2tv(lo), i2tv(i), i2tv(j));
+            krooted_tvs_pop(K);
+            krooted_vars_pop(K);
+            krooted_vars_pop(K);
+            kset_cc(K, new_cont);
+            ktail_eval(K, expr, denv);
+        }
+
+        /* one of the runs is done, copy the rest of the other one */
+        uint32_t k = i + (j - mid);
+        while(i < mid)
+            dbuf[k++] = sbuf[i++];
+        while(j < hi)
+            dbuf[k++] = sbuf[j++];
+
+        lo = hi;
+        if (lo >= n) {
+            /* end of a pass */
+            if (width >= n - width) {
+                TValue res = sort_result(K, dst, seq, bvalue(destructivep),
+                                         true);
+                krooted_vars_pop(K);
+                krooted_vars_pop(K);
+                kapply_cc(K, res);
+            }
+            /* use a new vector for the next pass, the old one may still 
+               be used by a continuation */
+            src = dst;
+            dst = kvector_new_sf(K, n, KINERT);
+            width *= 2;
+            lo = 0;
+        }
+        i = lo;
+        j = lo + width < n? lo + width : n;
+    }
+}
+
+void do_sort(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue obj = K->next_value;
+    klisp_assert(ttisnil(K->next_env));
+    /*
+    ** xparams[0]: less? applicative
+    ** xparams[1]: dynamic environment
+    ** xparams[2]: sequence being sorted
+    ** xparams[3]: destructive?
+    ** xparams[4]: source vector of this pass
+    ** xparams[5]: destination vector of this pass
+    ** xparams[6]: length of the runs being merged
+    ** xparams[7]: start of the left run
+    ** xparams[8]: next element of the left run
+    ** xparams[9]: next element of the right run
+    */
+    if (!ttisboolean(obj)) {
+        klispE_throw_simple_with_irritants(K, "less? should return a "
+                                           "boolean", 1, obj);
+        return;
+    }
+
+    TValue src = xparams[4];
+    TValue dst = xparams[5];
+    uint32_t n = kvector_size(src);
+    uint32_t width = ivalue(xparams[6]);
+    uint32_t lo = ivalue(xparams[7]);
+    uint32_t i = ivalue(xparams[8]);
+    uint32_t j = ivalue(xparams[9]);
+    uint32_t mid = lo + width < n? lo + width : n;
+    TValue *sbuf = kvector_buf(src);
+
+    /* obj is (less? right left) */
+    uint32_t k = i + (j - mid);
+    kvector_buf(dst)[k] = bvalue(obj)? sbuf[j++] : sbuf[i++];
+    sort_step(K, xparams[0], xparams[1], xparams[2], xparams[3], src, dst,
+              width, lo, i, j);
+}
+
+void sort_seq(klisp_State *K, TValue seq, TValue less, bool destructive)
+{
+    TValue src;
+    uint32_t n;
+
+    if (ttisvector(seq)) {
+        if (destructive && !kvector_mutablep(seq)) {
+            klispE_throw_simple(K, "immutable vector");
+            return;
+        }
+        n = kvector_size(seq);
+    } else {
+        int32_t pairs;
+        check_list(K, false, seq, &pairs, NULL);
+        n = pairs;
+    }
+
+    if (n == 0) {
+        /* nothing to sort, and there are no empty mutable vectors to
+           use as buffers */
+        kapply_cc(K, destructive? KINERT : 
+                  ttisvector(seq)? G(K)->empty_vector : KNIL);
+    }
+
+    if (ttisvector(seq)) {
+        src = kvector_new_bs_g(K, true, kvector_buf(seq), n);
+    } else {
+        src = kvector_new_sf(K, n, KINERT);
+        TValue *buf = kvector_buf(src);
+        TValue tail = seq;
+        for (uint32_t i = 0; i < n; ++i, tail = kcdr(tail)) {
+            if (destructive && !kmutable_pairp(tail)) {
+                klispE_throw_simple(K, "immutable pair");
+                return;
+            }
+            buf[i] = kcar(tail);
+        }
+    }
+    krooted_tvs_push(K, src);
+    TValue tmp = kvector_new_sf(K, n, KINERT);
+    krooted_tvs_push(K, tmp);
+
+    TValue res;
+    kbpred cmp;
+    if (n == 1) {
+        res = sort_result(K, src, seq, destructive, false);
+    } else if (kget_ground_bpred(less, &cmp)) {
+        res = sort_fast(K, &cmp, src, tmp);
+        res = sort_result(K, res, seq, destructive, false);
+    } else {
+        krooted_tvs_pop(K);
+        krooted_tvs_pop(K);
+        sort_step(K, less, K->next_env, seq, b2tv(destructive), src, tmp, 
+                  1, 0, 0, 1);
+        return;
+    }
+    krooted_tvs_pop(K);
+    krooted_tvs_pop(K);
+    kapply_cc(K, res);
+}
+
+/*
+** Folds
+** The elements are first put in a vector (unless seq is already a vector),
+** for ground numeric combiners (+, *, min & max) the whole fold is done
+** here, otherwise each combination is evaluated and its result passed 
+** to a continuation (do_fold). In that case a copy of the vector is used,
+** so that the applicative can't change the elements by mutating seq.
+*/
+
+/* returns true if the fold could be done without calling app, putting
+   the result in res */
+/* GC: Assumes vec & init are rooted */
+static bool fold_fast(klisp_State *K, TValue vec, TValue app, TValue init, 
+                      bool rightp, TValue *res)
+{
+    knum_binop binop = kget_ground_num_binop(app);
+    if (binop == NULL || !knumberp(init))
+        return false;
+
+    uint32_t n = kvector_size(vec);
+    TValue *buf = kvector_buf(vec);
+    /* if there is something else the error should be signaled by 
+       the applicative in the right place, don't do anything here */
+    for (uint32_t i = 0; i < n; ++i) {
+        if (!knumberp(buf[i]))
+            return false;
+    }
+
+    TValue acc = init;
+    krooted_vars_push(K, &acc);
+    if (rightp) {
+        for (uint32_t i = n; i > 0; --i)
+            acc = (*binop)(K, buf[i-1], acc);
+    } else {
+        for (uint32_t i = 0; i < n; ++i)
+            acc = (*binop)(K, acc, buf[i]);
+    }
+    krooted_vars_pop(K);
+    *res = acc;
+    return true;
+}
+
+void do_fold(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue obj = K->next_value;
+    klisp_assert(ttisnil(K->next_env));
+    /*
+    ** xparams[0]: vector with the elements
+    ** xparams[1]: number of elements already combined
+    ** xparams[2]: applicative
+    ** xparams[3]: dynamic environment
+    ** xparams[4]: rightp
+    */
+    TValue vec = xparams[0];
+    int32_t i = ivalue(xparams[1]);
+    TValue app = xparams[2];
+    TValue denv = xparams[3];
+    bool rightp = bvalue(xparams[4]);
+    int32_t n = kvector_size(vec);
+
+    if (i == n) {
+        kapply_cc(K, obj);
+    } else {
+        TValue next = kvector_buf(vec)[rightp? n - 1 - i : i];
+        TValue expr = rightp? klist(K, 3, kunwrap(app), next, obj) :
+            klist(K, 3, kunwrap(app), obj, next);
+        krooted_tvs_push(K, expr);
+        TValue new_cont = 
+            kmake_continuation(K, kget_cc(K), do_fold, 5, vec, i2tv(i+1), 
+                               app, denv, b2tv(rightp));
+        kset_cc(K, new_cont);
+        krooted_tvs_pop(K);
+        ktail_eval(K, expr, denv);
+    }
+}
+
+void fold_seq(klisp_State *K, TValue seq, TValue app, TValue init, 
+              bool rightp, TValue denv)
+{
+    TValue vec;
+    if (ttisvector(seq)) {
+        vec = seq;
+    } else {
+        int32_t pairs;
+        check_list(K, false, seq, &pairs, NULL);
+        krooted_tvs_push(K, seq);
+        vec = list_to_vector_h(K, seq, pairs);
+        krooted_tvs_pop(K);
+    }
+    krooted_tvs_push(K, vec);
+
+    TValue res;
+    if (fold_fast(K, vec, app, init, rightp, &res)) {
+        krooted_tvs_pop(K);
+        kapply_cc(K, res);
+    } else if (kvector_size(vec) == 0) {
+        krooted_tvs_pop(K);
+        kapply_cc(K, init);
+    } else {
+        if (tv_equal(vec, seq)) {
+            vec = kvector_new_bs_g(K, true, kvector_buf(seq), 
+                                   kvector_size(seq));
+            krooted_tvs_pop(K);
+            krooted_tvs_push(K, vec);
+        }
+        TValue new_cont = 
+            kmake_continuation(K, kget_cc(K), do_fold, 5, vec, i2tv(0), 
+                               app, denv, b2tv(rightp));
+        kset_cc(K, new_cont);
+        krooted_tvs_pop(K);
+        kapply_cc(K, init);
+    }
+}
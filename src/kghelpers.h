@@ -469,6 +469,12 @@ void list(klisp_State *K);
 /* Helper for list-tail, list-ref and list-set! */
 int32_t ksmallest_index(klisp_State *K, TValue obj, TValue tk);
 
+/* Helper for the optional start & end arguments of copy & fill! on
+   vectors, strings and bytevectors. rest is the list of remaining 
+   arguments, start defaults to 0 & end to size */
+void get_opt_range(klisp_State *K, TValue rest, int32_t size, 
+                   int32_t *start, int32_t *end);
+
 /* Helper for get-list-metrics, and list-tail, list-ref and list-set! 
    when receiving bigint indexes */
 void get_list_metrics_aux(klisp_State *K, TValue obj, int32_t *p, int32_t *n, 
@@ -481,6 +487,35 @@ bool eq2p(klisp_State *K, TValue obj1, TValue obj2);
 /* compare two objects and check to see if they are "equal?". */
 bool equal2p(klisp_State *K, TValue obj1, TValue obj2);
 
+/*
+** Ground binary predicates that can be called directly from C, 
+** instead of through a continuation (used by sort, assoc & member?).
+** These are eq?, equal? & the typed comparisons (see ftyped_bpredp & 
+** ftyped_kbpredp).
+*/
+typedef struct {
+    bool (*typep)(TValue obj); /* NULL if there's no type restriction */
+    bool (*predp)(TValue obj1, TValue obj2);
+    bool (*kpredp)(klisp_State *K, TValue obj1, TValue obj2);
+} kbpred;
+
+/* returns true if app is one of those, filling bpred */
+bool kget_ground_bpred(TValue app, kbpred *bpred);
+
+/* returns true if obj has the right type for bpred */
+static inline bool kbpred_typep(kbpred *bpred, TValue obj)
+{
+    return bpred->typep == NULL || (*bpred->typep)(obj);
+}
+
+/* both objects should have the right type */
+static inline bool kbpred_call(klisp_State *K, kbpred *bpred, TValue obj1, 
+                               TValue obj2)
+{
+    return bpred->predp? (*bpred->predp)(obj1, obj2) : 
+        (*bpred->kpredp)(K, obj1, obj2);
+}
+
 /* Helper (also used by $vau, $lambda, etc) */
 TValue copy_es_immutable_h(klisp_State *K, TValue ptree, bool mut_flag);
 
@@ -498,20 +533,37 @@ void map_for_each_get_metrics(
     int32_t *app_cpairs_out, int32_t *res_apairs_out, int32_t *res_cpairs_out);
 
 /* Return two lists, isomorphic to lss: one list of cars and one list
-   of cdrs (replacing the value of lss) */
+   of cdrs (replacing the value of lss). 
+   map & for-each call this once per element, with lss being the list of 
+   the remaining parts of each list, so that the list of arguments for 
+   each call is only created when needed. Both lists are new, so lss 
+   can be shared by different continuations. Throws an error if some
+   list is shorter than expected (e.g. if it was mutated) */
 /* GC: Assumes lss is rooted */
 TValue map_for_each_get_cars_cdrs(klisp_State *K, TValue *lss, 
                                   int32_t apairs, int32_t cpairs);
 
-/* Transpose lss so that the result is a list of lists, each one having
-   metrics (app_apairs, app_cpairs). The metrics of the returned list
-   should be (res_apairs, res_cpairs) */
-
-/* GC: Assumes lss is rooted */
-TValue map_for_each_transpose(klisp_State *K, TValue lss, 
-                              int32_t app_apairs, int32_t app_cpairs, 
-                              int32_t res_apairs, int32_t res_cpairs);
 
+/* sort */
+/* Sorts seq (a list or a vector) with the applicative less, if
+   destructive the result is stored in seq and #inert is returned,
+   otherwise a new list/vector is returned. Always ends with kapply_cc
+   or a tail call. */
+/* GC: Assumes seq & less are rooted */
+void sort_seq(klisp_State *K, TValue seq, TValue less, bool destructive);
+void do_sort(klisp_State *K);
+
+/* fold */
+/* Combines init with the elements of seq (an acyclic list or a vector)
+   using the applicative app, from left to right: 
+   (app (app init e1) e2)..., or if rightp from right to left: 
+   (app e1 (app e2 init)).... The applicative is called in denv. 
+   Always ends with kapply_cc or a tail call. */
+/* GC: Assumes app & init are rooted, seq is rooted here (so a new list 
+   or vector can be passed) */
+void fold_seq(klisp_State *K, TValue seq, TValue app, TValue init, 
+              bool rightp, TValue denv);
+void do_fold(klisp_State *K);
 
 /* for thread continuation guarding */
 void do_int_mark_root(klisp_State *K);
@@ -1439,6 +1439,49 @@ void kmin_max(klisp_State *K)
     kapply_cc(K, res);
 }
 
+/* these do the same as min & max with two arguments */
+static TValue knum_min2(klisp_State *K, TValue n1, TValue n2)
+{
+    TValue res = KEPINF;
+    if (knum_ltp(K, n1, res))
+        res = n1;
+    if (knum_ltp(K, n2, res))
+        res = n2;
+    return res;
+}
+
+static TValue knum_max2(klisp_State *K, TValue n1, TValue n2)
+{
+    TValue res = KEMINF;
+    if (knum_gtp(K, n1, res))
+        res = n1;
+    if (knum_gtp(K, n2, res))
+        res = n2;
+    return res;
+}
+
+/* Helper for folds */
+knum_binop kget_ground_num_binop(TValue app)
+{
+    if (!ttisapplicative(app))
+        return NULL;
+    /* only one level of wrapping, otherwise the arguments would be
+       evaluated */
+    TValue op = kunwrap(app);
+    if (!ttisoperative(op))
+        return NULL;
+
+    Operative *o = tv2op(op);
+    if (o->fn == kplus)
+        return knum_plus;
+    else if (o->fn == ktimes)
+        return knum_times;
+    else if (o->fn == kmin_max)
+        return bvalue(o->extra[1]) == FMIN? knum_min2 : knum_max2;
+    else
+        return NULL;
+}
+
 /* 12.5.14 gcm, lcm */
 void kgcd(klisp_State *K)
 {
@@ -2470,6 +2513,15 @@ void string_to_number(klisp_State *K)
         }
 
         if (radix == 10) {
+            /* try the fast path for decimals first, these are inexact
+               unless there is an explicit #e */
+            double d;
+            char *end;
+            if ((!has_exactp || !exactp) &&
+                kdouble_read_decimal(buf, &end, &d) && 
+                end == kstring_buf(str) + len) {
+                kapply_cc(K, ktag_double(d));
+            }
             /* only allow decimals with radix 10 */
             bool decimalp = false;
             if (!krational_read_decimal(K, buf, radix, &res, NULL, &decimalp)) {
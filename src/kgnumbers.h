@@ -12,4 +12,11 @@
 /* init ground */
 void kinit_numbers_ground_env(klisp_State *K);
 
+/* Helper for folds (see fold_seq in kghelpers.c) */
+/* If app is the ground +, *, min or max applicative, returns a function 
+   that does the same as calling it with two numbers, otherwise returns 
+   NULL */
+typedef TValue (*knum_binop)(klisp_State *K, TValue n1, TValue n2);
+knum_binop kget_ground_num_binop(TValue app);
+
 #endif
@@ -699,6 +699,22 @@ void filter(klisp_State *K)
     kapply_cc(K, KFALSE);
 }
 
+/* Helper for assoc & member?, returns true if obj and all the elements
+   of ls (or their cars if assocp is true) have the right type for bpred */
+static bool search_typep(kbpred *bpred, TValue obj, TValue ls, int32_t pairs,
+                         bool assocp)
+{
+    if (!kbpred_typep(bpred, obj))
+        return false;
+    while(pairs--) {
+        TValue first = assocp? kcar(kcar(ls)) : kcar(ls);
+        if (!kbpred_typep(bpred, first))
+            return false;
+        ls = kcdr(ls);
+    }
+    return true;
+}
+
 /* 6.3.6 assoc */
 /* helper if third optional argument is used */
 void do_assoc(klisp_State *K)
@@ -711,12 +727,14 @@ void do_assoc(klisp_State *K)
     ** xparams[1]: obj to be compared
     ** xparams[2]: last-pair + rem ls
     ** xparams[3]: rem pairs
+    ** xparams[4]: dynamic environment for pred
     */ 
 
     TValue pred = xparams[0];
     TValue cmp_obj = xparams[1];
     TValue ls = xparams[2];
     int32_t pairs = ivalue(xparams[3]);
+    TValue env = xparams[4];
 
     if (!ttisboolean(obj)) {
         klispE_throw_simple_with_irritants(K, "expected boolean", 1, obj);
@@ -726,17 +744,17 @@ void do_assoc(klisp_State *K)
         kapply_cc(K, res);
     } else {
         /* object not YET found */
-        TValue cont = kmake_continuation(K, kget_cc(K), do_assoc, 4, pred, 
-                                         cmp_obj, kcdr(ls), i2tv(pairs-1));
+        TValue cont = kmake_continuation(K, kget_cc(K), do_assoc, 5, pred, 
+                                         cmp_obj, kcdr(ls), i2tv(pairs-1),
+                                         env);
         /* not necessary but may save a continuation in some cases */
         kset_bool_check_cont(cont);
         kset_cc(K, cont);
+        /* the arguments are already evaluated, like in apply */
         TValue exp = kcons(K, kcar(kcar(kcdr(ls))), KNIL);
         krooted_vars_push(K, &exp);
         exp = kcons(K, cmp_obj, exp);
-        exp = kcons(K, pred, exp);
-        /* TEMP for now use an empty environment for dynamic env */
-        TValue env = kmake_empty_environment(K);
+        exp = kcons(K, kunwrap(pred), exp);
         krooted_vars_pop(K);
         ktail_eval(K, exp, env);
     }
@@ -756,33 +774,43 @@ void assoc(klisp_State *K)
     /* first pass, check structure */
     int32_t pairs;
     check_typed_list(K, kpairp, true, ls, &pairs, NULL);
+
+    /* equal?, eq? and the ground typed comparisons can be called from
+       here, no continuation needed */
+    kbpred bpred = { NULL, NULL, equal2p };
+    bool fastp = !predp || (kget_ground_bpred(maybe_pred, &bpred) &&
+                            search_typep(&bpred, obj, ls, pairs, true));
 	
     TValue res;
-    if (predp) {
+    if (fastp) {
+        TValue tail = ls;
+        res = KNIL;
+        while(pairs--) {
+            TValue first = kcar(tail);
+            if (kbpred_call(K, &bpred, obj, kcar(first))) {
+                res = first;
+                break;
+            }
+            tail = kcdr(tail);
+        }
+    } else {   
         /* we'll need use continuations, copy list first to
            avoid troubles with mutation */
         ls = check_copy_list(K, ls, false, NULL, NULL);
         krooted_vars_push(K, &ls);
         ls = kcons(K, KINERT, ls); /* add dummy obj to stand as last 
                                       compared obj */
-        TValue cont = kmake_continuation(K, kget_cc(K), do_assoc, 4,
-                                         maybe_pred, obj, ls, i2tv(pairs));
+        /* TEMP for now use an empty environment for dynamic env */
+        TValue env = kmake_empty_environment(K);
+        krooted_tvs_push(K, env);
+        TValue cont = kmake_continuation(K, kget_cc(K), do_assoc, 5,
+                                         maybe_pred, obj, ls, i2tv(pairs),
+                                         env);
+        krooted_tvs_pop(K);
         krooted_vars_pop(K);
         kset_cc(K, cont);
         /* pass false to have it keep looking (in the whole list) */
         res = KFALSE;
-    } else {   
-        /* use equal?, no continuation needed */
-        TValue tail = ls;
-        res = KNIL;
-        while(pairs--) {
-            TValue first = kcar(tail);
-            if (equal2p(K, kcar(first), obj)) {
-                res = first;
-                break;
-            }
-            tail = kcdr(tail);
-        }
     }
     kapply_cc(K, res);
 }
@@ -799,12 +827,14 @@ void do_memberp(klisp_State *K)
     ** xparams[1]: obj to be compared
     ** xparams[2]: rem ls
     ** xparams[3]: rem pairs
+    ** xparams[4]: dynamic environment for pred
     */ 
 
     TValue pred = xparams[0];
     TValue cmp_obj = xparams[1];
     TValue ls = xparams[2];
     int32_t pairs = ivalue(xparams[3]);
+    TValue env = xparams[4];
 
     if (!ttisboolean(obj)) {
         klispE_throw_simple_with_irritants(K, "expected boolean", 1, obj);
@@ -814,17 +844,17 @@ void do_memberp(klisp_State *K)
         kapply_cc(K, obj);
     } else {
         /* object not YET found */
-        TValue cont = kmake_continuation(K, kget_cc(K), do_memberp, 4, pred, 
-                                         cmp_obj, kcdr(ls), i2tv(pairs-1));
+        TValue cont = kmake_continuation(K, kget_cc(K), do_memberp, 5, pred, 
+                                         cmp_obj, kcdr(ls), i2tv(pairs-1),
+                                         env);
         /* not necessary but may save a continuation in some cases */
         kset_bool_check_cont(cont);
         kset_cc(K, cont);
+        /* the arguments are already evaluated, like in apply */
         TValue exp = kcons(K, kcar(ls), KNIL);
         krooted_vars_push(K, &exp);
         exp = kcons(K, cmp_obj, exp);
-        exp = kcons(K, pred, exp);
-        /* TEMP for now use an empty environment for dynamic env */
-        TValue env = kmake_empty_environment(K);
+        exp = kcons(K, kunwrap(pred), exp);
         krooted_vars_pop(K);
         ktail_eval(K, exp, env);
     }
@@ -844,35 +874,42 @@ void memberp(klisp_State *K)
     
     /* first pass, check structure */
     int32_t pairs;
-    if (predp) { /* copy if a custom predicate is used */
-        ls = check_copy_list(K, ls, false, &pairs, NULL);
-    } else { 
-        check_list(K, true, ls, &pairs, NULL);
-    }
+    check_list(K, true, ls, &pairs, NULL);
+
+    /* equal?, eq? and the ground typed comparisons can be called from
+       here, no continuation needed */
+    kbpred bpred = { NULL, NULL, equal2p };
+    bool fastp = !predp || (kget_ground_bpred(maybe_pred, &bpred) &&
+                            search_typep(&bpred, obj, ls, pairs, false));
 
     TValue res;
-    if (predp) {
-        /* we'll need use continuations */
-        krooted_tvs_push(K, ls);
-        TValue cont = kmake_continuation(K, kget_cc(K), do_memberp, 4,
-                                         maybe_pred, obj, ls, i2tv(pairs));
-        krooted_tvs_pop(K);
-        kset_cc(K, cont);
-        /* pass false to have it keep looking (in the whole list) */
-        res = KFALSE;
-    } else {
-        /* if using equal? we need no continuation, we can 
-           do it all here */
+    if (fastp) {
         TValue tail = ls;
         res = KFALSE;
         while(pairs--) {
             TValue first = kcar(tail);
-            if (equal2p(K, first, obj)) {
+            if (kbpred_call(K, &bpred, obj, first)) {
                 res = KTRUE;
                 break;
             }
             tail = kcdr(tail);
         }
+    } else {
+        /* we'll need use continuations, copy list first to
+           avoid troubles with mutation */
+        ls = check_copy_list(K, ls, false, NULL, NULL);
+        krooted_tvs_push(K, ls);
+        /* TEMP for now use an empty environment for dynamic env */
+        TValue env = kmake_empty_environment(K);
+        krooted_tvs_push(K, env);
+        TValue cont = kmake_continuation(K, kget_cc(K), do_memberp, 5,
+                                         maybe_pred, obj, ls, i2tv(pairs),
+                                         env);
+        krooted_tvs_pop(K);
+        krooted_tvs_pop(K);
+        kset_cc(K, cont);
+        /* pass false to have it keep looking (in the whole list) */
+        res = KFALSE;
     }
     kapply_cc(K, res);
 }
@@ -1181,28 +1218,28 @@ void reduce(klisp_State *K)
 
     TValue res;
 
-    if (cpairs != 0) {
-        if (!extended_form) {
-            klispE_throw_simple(K, "no cyclic handling applicatives");
-            return;
-        }
-        /* make cycle reducing cont */
-        TValue cyc_cont = 
-            kmake_continuation(K, kget_cc(K), do_reduce_cycle, 8, 
-                               first_cycle_pair, i2tv(cpairs), bin, prec, 
-                               inc, postc, denv, b2tv(apairs != 0));
-        kset_cc(K, cyc_cont);
+    if (cpairs == 0) {
+        /* a left fold does the same, and it can avoid the
+           continuations for +, *, min & max */
+        fold_seq(K, kcdr(ls), bin, kcar(ls), false, denv);
+        return;
+    } else if (!extended_form) {
+        klispE_throw_simple(K, "no cyclic handling applicatives");
+        return;
     }
 
+    /* make cycle reducing cont */
+    TValue cyc_cont = 
+        kmake_continuation(K, kget_cc(K), do_reduce_cycle, 8, 
+                           first_cycle_pair, i2tv(cpairs), bin, prec, 
+                           inc, postc, denv, b2tv(apairs != 0));
+    kset_cc(K, cyc_cont);
+
     if (apairs == 0) {
         /* this will be ignore by cyc_cont */
         res = KINERT;
     } else {
-        /* this will pass the parent continuation either
-           a list of (rem-ls result) if there is a cycle or
-           result if there is no cycle, this should be a list
-           and not a regular pair to allow the above case of 
-           a one element list to signal no acyclic part */
+        /* this will pass the result of the acyclic part to cyc_cont */
         TValue acyc_cont = 
             kmake_continuation(K, kget_cc(K), do_reduce, 4, 
                                kcdr(ls), i2tv(apairs-1), bin, denv);
@@ -1212,6 +1249,68 @@ void reduce(klisp_State *K)
     kapply_cc(K, res);
 }
 
+/* ?.? sort, sort! */
+/* see sort_seq in kghelpers.c */
+void sort(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(denv);
+    /*
+    ** xparams[0]: destructive?
+    */
+    bool destructive = bvalue(xparams[0]);
+
+    bind_2tp(K, ptree, "list or vector", anytype, seq,
+             "applicative", ttisapplicative, less);
+    sort_seq(K, seq, less, destructive);
+}
+
+/* ?.? list-sort */
+void list_sort(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    UNUSED(denv);
+
+    bind_2tp(K, ptree, "applicative", ttisapplicative, less,
+             "any", anytype, ls);
+    if (ttisvector(ls)) {
+        klispE_throw_simple(K, "Bad type on second argument (expected "
+                            "list)");
+        return;
+    }
+    sort_seq(K, ls, less, false);
+}
+
+/* ?.? fold-left, fold-right */
+/* see fold_seq in kghelpers.c */
+void fold(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    /*
+    ** xparams[0]: rightp
+    */
+    bool rightp = bvalue(xparams[0]);
+
+    bind_3tp(K, ptree, "applicative", ttisapplicative, app,
+             "any", anytype, init, "any", anytype, ls);
+    if (ttisvector(ls)) {
+        klispE_throw_simple(K, "Bad type on third argument (expected "
+                            "list)");
+        return;
+    }
+    fold_seq(K, ls, app, init, rightp, denv);
+}
+
 /* init ground */
 void kinit_pairs_lists_ground_env(klisp_State *K)
 {
@@ -1322,6 +1421,14 @@ void kinit_pairs_lists_ground_env(klisp_State *K)
     add_applicative(K, ground_env, "countable-list?", countable_listp, 0);
     /* 6.3.10 reduce */
     add_applicative(K, ground_env, "reduce", reduce, 0);
+    /* ?.? sort, sort! */
+    add_applicative(K, ground_env, "sort", sort, 1, KFALSE);
+    add_applicative(K, ground_env, "sort!", sort, 1, KTRUE);
+    /* ?.? list-sort */
+    add_applicative(K, ground_env, "list-sort", list_sort, 0);
+    /* ?.? fold-left, fold-right */
+    add_applicative(K, ground_env, "fold-left", fold, 1, KFALSE);
+    add_applicative(K, ground_env, "fold-right", fold, 1, KTRUE);
 }
 
 /* XXX lock? */
@@ -0,0 +1,121 @@
+/*
+** kgprofile.c
+** Profiling features for the ground environment
+** See Copyright Notice in klisp.h
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "kstate.h"
+#include "kobject.h"
+#include "kpair.h"
+#include "kenvironment.h"
+#include "kcontinuation.h"
+#include "kerror.h"
+#include "kinteger.h"
+#include "kprofile.h"
+
+#include "kghelpers.h"
+#include "kgprofile.h"
+
+/* Helper for profile */
+static void do_profile(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue obj = K->next_value;
+    klisp_assert(ttisnil(K->next_env));
+    UNUSED(xparams);
+    UNUSED(obj);
+
+    TValue samples = klispP_stop(K);
+    kapply_cc(K, klispP_samples_list(K, samples));
+}
+
+/* profile */
+/* NOTE: the combiner is called with no arguments in an empty environment,
+   like in call-with-input-file. If control leaves the call abnormally,
+   the profiler keeps running until the next call to profile */
+static void profile(klisp_State *K)
+{
+    TValue ptree = K->next_value;
+    bind_1tp(K, ptree, "combiner", ttiscombiner, comb);
+
+    if (!klispP_start(K, KPROFILE_INTERVAL)) {
+        klispE_throw_simple(K, "profiling is not supported in this "
+                            "platform");
+        return;
+    }
+    /* make the continuation to stop the profiler & return the samples */
+    TValue new_cont = kmake_continuation(K, kget_cc(K), do_profile, 0);
+    kset_cc(K, new_cont); /* implicit rooting */
+    TValue empty_env = kmake_empty_environment(K);
+    krooted_tvs_push(K, empty_env);
+    TValue expr = klist(K, 1, comb);
+
+    krooted_tvs_pop(K);
+    ktail_eval(K, expr, empty_env);
+}
+
+/* get-profile-stats */
+static void get_profile_stats(klisp_State *K)
+{
+    TValue ptree = K->next_value;
+    check_0p(K, ptree);
+#ifdef KPROFILE
+    kapply_cc(K, klispP_get_stats(K));
+#else
+    klispE_throw_simple(K, "klisp wasn't built with KPROFILE");
+    return;
+#endif
+}
+
+/* heap-profile-set-rate! */
+/* 0 stops the heap profiler, returns the previous rate */
+static void heap_profile_set_rateB(klisp_State *K)
+{
+    TValue ptree = K->next_value;
+    bind_1tp(K, ptree, "exact integer", keintegerp, tv_rate);
+
+    uint64_t rate;
+    if (knegativep(tv_rate)) {
+        klispE_throw_simple_with_irritants(K, "negative argument", 1, 
+                                           tv_rate);
+        return;
+    } else if (!kinteger_to_uint64(tv_rate, &rate) || rate > MAX_KMEM / 2) {
+        klispE_throw_simple_with_irritants(K, "argument is too big", 1, 
+                                           tv_rate);
+        return;
+    }
+    kmem_t old = klispP_heap_set_rate(K, (kmem_t) rate);
+    kapply_cc(K, kinteger_new_uint64(K, old));
+}
+
+/* heap-profile */
+static void heap_profile(klisp_State *K)
+{
+    TValue ptree = K->next_value;
+    check_0p(K, ptree);
+    kapply_cc(K, klispP_heap_profile(K));
+}
+
+/* init ground */
+void kinit_profile_ground_env(klisp_State *K)
+{
+    TValue ground_env = G(K)->ground_env;
+    TValue symbol, value;
+
+    add_applicative(K, ground_env, "profile", profile, 0);
+    add_applicative(K, ground_env, "get-profile-stats", get_profile_stats, 0);
+    add_applicative(K, ground_env, "heap-profile-set-rate!", 
+                    heap_profile_set_rateB, 0);
+    add_applicative(K, ground_env, "heap-profile", heap_profile, 0);
+}
+
+/* init continuation names */
+void kinit_profile_cont_names(klisp_State *K)
+{
+    Table *t = tv2table(G(K)->cont_name_table);
+
+    add_cont_name(K, t, do_profile, "profile");
+}
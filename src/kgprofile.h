@@ -0,0 +1,17 @@
+/*
+** kgprofile.h
+** Profiling features for the ground environment
+** See Copyright Notice in klisp.h
+*/
+
+#ifndef kgprofile_h
+#define kgprofile_h
+
+#include "kstate.h"
+
+/* init ground */
+void kinit_profile_ground_env(klisp_State *K);
+/* init continuation names */
+void kinit_profile_cont_names(klisp_State *K);
+
+#endif
@@ -43,6 +43,8 @@
 #include "kgkeywords.h"
 #include "kglibraries.h"
 #include "kgthreads.h"
+#include "kgprofile.h"
+#include "kggc.h"
 
 #if KUSE_LIBFFI
 #  include "kgffi.h"
@@ -83,6 +85,7 @@ void kinit_cont_names(klisp_State *K)
 #endif
     kinit_error_cont_names(K);
     kinit_libraries_cont_names(K);
+    kinit_profile_cont_names(K);
 }
 
 /*
@@ -120,6 +123,8 @@ void kinit_ground_env(klisp_State *K)
     kinit_keywords_ground_env(K);
     kinit_libraries_ground_env(K);
     kinit_threads_ground_env(K);
+    kinit_profile_ground_env(K);
+    kinit_gc_ground_env(K);
 #if KUSE_LIBFFI
     kinit_ffi_ground_env(K);
 #endif
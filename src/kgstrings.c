@@ -220,7 +220,8 @@ void kstring_title_case(klisp_State *K)
 /* XXX: this should probably be in file kstring.h */
 
 bool kstring_eqp(TValue str1, TValue str2) { 
-    return tv_equal(str1, str2) || kstring_equalp(str1, str2);
+    /* kstring_equalp checks for eq? (and interned strings) first */
+    return kstring_equalp(str1, str2);
 }
 
 bool kstring_ci_eqp(TValue str1, TValue str2)
@@ -567,19 +568,25 @@ void string_copy(klisp_State *K)
     klisp_assert(ttisenvironment(K->next_env));
     UNUSED(xparams);
     UNUSED(denv);
-    bind_1tp(K, ptree, "string", ttisstring, str);
+    bind_al1tp(K, ptree, "string", ttisstring, str, rest);
+
+    int32_t start, end;
+    get_opt_range(K, rest, kstring_size(str), &start, &end);
 
     TValue new_str;
     /* the if isn't strictly necessary but it's clearer this way */
-    if (tv_equal(str, G(K)->empty_string)) {
-        new_str = str; 
+    if (start == end) {
+        new_str = G(K)->empty_string; 
     } else {
-        new_str = kstring_new_bs(K, kstring_buf(str), kstring_size(str));
+        new_str = kstring_new_bs(K, kstring_buf(str) + start, end - start);
     }
     kapply_cc(K, new_str);
 }
 
-/* 13.2.9? string->immutable-string */
+/* 13.2.9? string->immutable-string, string-intern */
+/* all immutable strings are interned, so string-intern is just another
+   name for string->immutable-string, and strings returned by it are
+   eq? iff they are string=? */
 void string_to_immutable_string(klisp_State *K)
 {
     TValue *xparams = K->next_xparams;
@@ -608,18 +615,288 @@ void string_fillB(klisp_State *K)
     klisp_assert(ttisenvironment(K->next_env));
     UNUSED(xparams);
     UNUSED(denv);
-    bind_2tp(K, ptree, "string", ttisstring, str,
-             "char", ttischar, tv_ch);
+    bind_al2tp(K, ptree, "string", ttisstring, str,
+               "char", ttischar, tv_ch, rest);
 
     if (kstring_immutablep(str)) {
         klispE_throw_simple(K, "immutable string");
         return;
     } 
 
-    memset(kstring_buf(str), chvalue(tv_ch), kstring_size(str));
+    int32_t start, end;
+    get_opt_range(K, rest, kstring_size(str), &start, &end);
+
+    memset(kstring_buf(str) + start, chvalue(tv_ch), end - start);
     kapply_cc(K, KINERT);
 }
 
+/* Helpers for string search & split */
+
+/* 
+** Returns the index of the first occurrence of pat in buf starting 
+** at start, or -1 if there is none.
+** Single chars use memchr, short texts use memchr on the first char 
+** of the pattern and memcmp, and everything else uses the 
+** Boyer-Moore-Horspool algorithm.
+*/
+#define SEARCH_MIN_HORSPOOL 256
+
+static int32_t string_search_h(const char *buf, int32_t size, 
+                               const char *pat, int32_t psize, 
+                               int32_t start)
+{
+    if (psize == 0)
+        return start;
+    else if (psize > size - start)
+        return -1;
+
+    int32_t limit = size - psize; /* last possible match */
+
+    if (psize == 1 || size - start < SEARCH_MIN_HORSPOOL) {
+        int32_t i = start;
+        while(i <= limit) {
+            const char *p = memchr(buf + i, pat[0], limit - i + 1);
+            if (p == NULL)
+                return -1;
+            i = (int32_t) (p - buf);
+            if (memcmp(p + 1, pat + 1, psize - 1) == 0)
+                return i;
+            ++i;
+        }
+        return -1;
+    }
+
+    int32_t skip[256];
+    for (int32_t i = 0; i < 256; ++i)
+        skip[i] = psize;
+    for (int32_t i = 0; i < psize - 1; ++i)
+        skip[(unsigned char) pat[i]] = psize - 1 - i;
+
+    char last = pat[psize - 1];
+    int32_t i = start;
+    while(i <= limit) {
+        char c = buf[i + psize - 1];
+        if (c == last && memcmp(buf + i, pat, psize - 1) == 0)
+            return i;
+        i += skip[(unsigned char) c];
+    }
+    return -1;
+}
+
+/* the start index is optional, it defaults to 0 */
+static inline bool get_start_index(klisp_State *K, TValue str, TValue tv_start, 
+                                   int32_t *start)
+{
+    if (ttisnil(tv_start)) {
+        *start = 0;
+        return true;
+    } else if (!ttispair(tv_start) || !ttisnil(kcdr(tv_start))) {
+        klispE_throw_simple(K, "Bad ptree structure (in optional argument)");
+        return false;
+    }
+    tv_start = kcar(tv_start);
+    if (!keintegerp(tv_start)) {
+        klispE_throw_simple(K, "Bad type on optional argument (expected "
+                            "exact integer)");
+        return false;
+    } else if (!ttisfixint(tv_start) || ivalue(tv_start) < 0 ||
+        ivalue(tv_start) > kstring_size(str)) {
+        klispE_throw_simple(K, "start index out of bounds");
+        return false;
+    }
+    *start = ivalue(tv_start);
+    return true;
+}
+
+/* 13.? string-index */
+void string_index(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    UNUSED(denv);
+    bind_al2tp(K, ptree, "string", ttisstring, str, 
+               "char", ttischar, tv_ch, tv_start);
+
+    int32_t start;
+    if (!get_start_index(K, str, tv_start, &start))
+        return;
+
+    char ch = chvalue(tv_ch);
+    int32_t res = string_search_h(kstring_buf(str), kstring_size(str), 
+                                  &ch, 1, start);
+    kapply_cc(K, res < 0? KFALSE : i2tv(res));
+}
+
+/* 13.? string-search */
+void string_search(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    UNUSED(denv);
+    bind_al2tp(K, ptree, "string", ttisstring, str, 
+               "string", ttisstring, pat, tv_start);
+
+    int32_t start;
+    if (!get_start_index(K, str, tv_start, &start))
+        return;
+
+    int32_t res = string_search_h(kstring_buf(str), kstring_size(str), 
+                                  kstring_buf(pat), kstring_size(pat), start);
+    kapply_cc(K, res < 0? KFALSE : i2tv(res));
+}
+
+/* 13.? string-contains? */
+void string_containsp(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    UNUSED(denv);
+    bind_2tp(K, ptree, "string", ttisstring, str, 
+             "string", ttisstring, pat);
+
+    int32_t res = string_search_h(kstring_buf(str), kstring_size(str), 
+                                  kstring_buf(pat), kstring_size(pat), 0);
+    kapply_cc(K, b2tv(res >= 0));
+}
+
+/* 13.? string-split */
+/* the separator can be a char or a non empty string, all the fields
+   are returned, even empty ones */
+/* TEMP: at least for now this always returns mutable strings */
+void string_split(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    UNUSED(denv);
+    bind_2tp(K, ptree, "string", ttisstring, str, 
+             "char or string", anytype, sep);
+
+    char ch;
+    const char *sbuf;
+    int32_t ssize;
+    if (ttischar(sep)) {
+        ch = chvalue(sep);
+        sbuf = &ch;
+        ssize = 1;
+    } else if (ttisstring(sep)) {
+        sbuf = kstring_buf(sep);
+        ssize = kstring_size(sep);
+        if (ssize == 0) {
+            klispE_throw_simple(K, "empty separator");
+            return;
+        }
+    } else {
+        klispE_throw_simple(K, "Bad type on second argument (expected "
+                            "char or string)");
+        return;
+    }
+
+    krooted_tvs_push(K, str);
+    krooted_tvs_push(K, sep);
+    TValue dummy = kcons(K, KINERT, KNIL);
+    krooted_tvs_push(K, dummy);
+    TValue tail = dummy;
+
+    int32_t size = kstring_size(str);
+    int32_t start = 0;
+    while(true) {
+        int32_t end = string_search_h(kstring_buf(str), size, sbuf, 
+                                      ssize, start);
+        int32_t fsize = (end < 0? size : end) - start;
+        TValue field = fsize == 0? G(K)->empty_string :
+            kstring_new_bs(K, kstring_buf(str) + start, fsize);
+        krooted_tvs_push(K, field);
+        TValue new_pair = kcons(K, field, KNIL);
+        krooted_tvs_pop(K);
+        kset_cdr_unsafe(K, tail, new_pair);
+        tail = new_pair;
+
+        if (end < 0)
+            break;
+        start = end + ssize;
+    }
+
+    krooted_tvs_pop(K);
+    krooted_tvs_pop(K);
+    krooted_tvs_pop(K);
+    kapply_cc(K, kcdr(dummy));
+}
+
+/* 13.? string-join */
+/* the separator is optional, it defaults to a single space */
+/* TEMP: at least for now this always returns mutable strings */
+void string_join(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    UNUSED(denv);
+    bind_al1p(K, ptree, ls, sep);
+
+    const char *sbuf = " ";
+    int32_t ssize = 1;
+    if (get_opt_tpar(K, sep, "string", ttisstring)) {
+        sbuf = kstring_buf(sep);
+        ssize = kstring_size(sep);
+    }
+
+    /* don't allow cycles */
+    int32_t pairs;
+    check_typed_list(K, kstringp, false, ls, &pairs, NULL);
+
+    /* first compute the size, to allocate only once */
+    int64_t total_size = 0; /* use int64 to check for overflow */
+    TValue tail = ls;
+    for (int32_t i = 0; i < pairs; ++i) {
+        if (i > 0)
+            total_size += ssize;
+        total_size += kstring_size(kcar(tail));
+        if (total_size > INT32_MAX) {
+            klispE_throw_simple(K, "resulting string is too big");
+            return;
+        }
+        tail = kcdr(tail);
+    }
+    /* this is safe */
+    int32_t size = (int32_t) total_size;
+
+    if (size == 0) {
+        kapply_cc(K, G(K)->empty_string);
+        return;
+    } 
+
+    TValue new_str = kstring_new_s(K, size);
+    /* the buffer of sep is still valid (GC doesn't move objects) */
+    char *buf = kstring_buf(new_str);
+    tail = ls;
+    for (int32_t i = 0; i < pairs; ++i) {
+        if (i > 0) {
+            memcpy(buf, sbuf, ssize);
+            buf += ssize;
+        }
+        TValue first = kcar(tail);
+        int32_t first_size = kstring_size(first);
+        memcpy(buf, kstring_buf(first), first_size);
+        buf += first_size;
+        tail = kcdr(tail);
+    }
+    kapply_cc(K, new_str);
+}
+
 /* init ground */
 void kinit_strings_ground_env(klisp_State *K)
 {
@@ -703,7 +980,17 @@ void kinit_strings_ground_env(klisp_State *K)
     /* 13.2.9? string->immutable-string */
     add_applicative(K, ground_env, "string->immutable-string", 
                     string_to_immutable_string, 0);
+    add_applicative(K, ground_env, "string-intern", 
+                    string_to_immutable_string, 0);
 
     /* 13.2.10? string-fill! */
     add_applicative(K, ground_env, "string-fill!", string_fillB, 0);
+
+    /* 13.? string-index, string-search, string-contains? */
+    add_applicative(K, ground_env, "string-index", string_index, 0);
+    add_applicative(K, ground_env, "string-search", string_search, 0);
+    add_applicative(K, ground_env, "string-contains?", string_containsp, 0);
+    /* 13.? string-split, string-join */
+    add_applicative(K, ground_env, "string-split", string_split, 0);
+    add_applicative(K, ground_env, "string-join", string_join, 0);
 }
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #include "kstate.h"
 #include "kobject.h"
@@ -18,6 +19,10 @@
 #include "kcontinuation.h"
 #include "kerror.h"
 #include "kpair.h"
+#include "kenvironment.h"
+#include "ksymbol.h"
+#include "kstring.h"
+#include "ktable.h"
 
 #include "kghelpers.h"
 #include "kgtables.h"
@@ -26,22 +31,16 @@
  * is modeled after SRFI-69.
  *
  * MISSING FUNCTIONALITY
- *   - no user definable equivalence predicates
  *   - no user definable hash functions
- *   - hash function itself is not available
- *   - hash-table-ref/default not implemented
- *   - hash-table-update! not implemented
- *   - hash-table-for-each (hash-table-walk in SRFI-69) not implemented
+ *   - the only equivalence predicates allowed are eq?, equal?
+ *     and string=?
+ *   - hash-table-update!/default, hash-table-fold not implemented
  *
  * DEVIATIONS FROM SRFI-69
  *   - hash-table-size renamed to hash-table-length to match klisp's vector-length
  *   - hash-table-exists? and hash-table-delete! accept more than one key
  *   - hash-table-merge! accepts more than two arguments
- *
- * KNOWN BUGS
- *   - removing elements do not cause hash tables shrink
- *   - hash_table_merge() may compute too low initial table size
- *   - "array" optimization never used
+ *   - the keys of string=? tables must be strings
  *
  * Hash tables are equal? if and only if they are eq?. Hash
  * tables do not have external representation.
@@ -52,9 +51,21 @@
  *   Type predicate. Evaluates to #t iff all arguments are hash
  *   tables, and #f otherwise.
  *
- * (make-hash-table)
- *   Create new, empty hash table. Currently accepts no optional
- *   parameters (SRFI-69 allows user-defined hash function, etc.)
+ * (make-hash-table [EQUIV])
+ *   Create new, empty hash table. EQUIV is the equivalence predicate
+ *   used to compare keys, it should be one of eq? (the default),
+ *   equal? or string=?. SRFI-69 also allows a user-defined hash
+ *   function, this is not supported.
+ *
+ * (make-weak-hash-table WEAKNESS [EQUIV])
+ *   Create new, empty weak hash table. WEAKNESS is one of the symbols
+ *   keys, values, keys-and-values or ephemeron. The bindings whose
+ *   keys (or values, or either) are only reachable through weak
+ *   tables are removed by the garbage collector. In ephemeron tables
+ *   the keys are weak and each value is kept only while its key is
+ *   reachable from outside the table, even if the value refers to the
+ *   key. Symbols, keywords and immutable strings and bytevectors are
+ *   never removed. EQUIV is like in make-hash-table.
  *
  * (hash-table-set! TABLE KEY VALUE)
  *   Set KEY => VALUE in TABLE, silently replacing
@@ -66,6 +77,15 @@
  *   evaluation of (THUNK) in the dynamic environment. Otherwise,
  *   an error is signalled.
  *
+ * (hash-table-ref/default TABLE KEY DEFAULT)
+ *   Returns value corresponding to KEY in TABLE, if present, or
+ *   DEFAULT otherwise.
+ *
+ * (hash-table-update! TABLE KEY PROC [THUNK])
+ *   Sets KEY => (PROC (hash-table-ref TABLE KEY THUNK)) in TABLE.
+ *   Unless TABLE was modified by PROC (or THUNK), the binding is
+ *   looked up only once. The result is #inert.
+ *
  * (hash-table-exists? TABLE KEY1 KEY2 ...)
  *   Returns #t if all keys KEY1, KEY2, ... are bound in TABLE.
  *   Returns #f otherwise.
@@ -78,7 +98,7 @@
  *   Returns number of KEY => VALUE bindings in TABLE.
  *
  * (hash-table-copy TABLE)
- *   Returns a copy of TABLE.
+ *   Returns a copy of TABLE (with the same weakness).
  *
  * (hash-table-merge T1 T2 ... Tn)
  *   Creates new hash table with all bindings from T1, T2, ... Tn.
@@ -98,8 +118,9 @@
  *   Creates new hash table, binding Kn => Vn. If Ki = Kj for i < j,
  *   then Vj overrides Vi.
  *
- * (alist->hash-table ALIST)
- *   Creates new hash table from association list.
+ * (alist->hash-table ALIST [EQUIV])
+ *   Creates new hash table from association list. EQUIV is like
+ *   in make-hash-table.
  *
  * WHOLE CONTENTS MANIPULATION
  *
@@ -112,15 +133,88 @@
  * (hash-table-values TABLE)
  *   Returns list of all values from TABLE.
  *
+ * (hash-table-walk TABLE PROC)
+ *   Calls (PROC KEY VALUE) for each binding in TABLE, in unspecified
+ *   order. Only the bindings present when hash-table-walk is called 
+ *   are visited. The result is #inert.
+ *
+ * HASHING
+ *
+ * (hash OBJ [BOUND])
+ *   Returns a non negative fixint, the same for any two objects that
+ *   are equal?. If BOUND is present the result is less than BOUND.
+ *
+ * (string-hash STRING [BOUND])
+ *   Like hash, but only for strings.
+ *
  */
 
+/* returns the kind of table for the equivalence predicate pred, 
+   the accepted predicates should be in xparams */
+static int32_t get_table_kind(klisp_State *K, TValue pred)
+{
+    TValue *xparams = K->next_xparams;
+    if (eq2p(K, pred, xparams[0]))
+        return K_TABLE_EQ;
+    else if (eq2p(K, pred, xparams[1]))
+        return K_TABLE_EQUAL;
+    else if (eq2p(K, pred, xparams[2]))
+        return K_TABLE_STRING;
+
+    klispE_throw_simple_with_irritants(K, "unsupported equivalence "
+                                       "predicate", 1, pred);
+    return K_TABLE_EQ;
+}
+
+/* string=? tables only accept strings as keys */
+static inline void check_key(klisp_State *K, TValue tab, TValue key)
+{
+    if (tv2table(tab)->kind == K_TABLE_STRING && !ttisstring(key)) {
+        klispE_throw_simple_with_irritants(K, "Bad type on key (expected "
+                                           "string)", 1, key);
+    }
+}
+
 static void make_hash_table(klisp_State *K)
 {
-    check_0p(K, K->next_value);
-    TValue tab = klispH_new(K,
-                            0,  /* narray - not used in klisp */
-                            32, /* nhash - size of the hash table */
-                            0   /* wflags - no weak pointers */ );
+    TValue pred = K->next_value;
+    int32_t kind = K_TABLE_EQ;
+    if (get_opt_tpar(K, pred, "applicative", ttisapplicative))
+        kind = get_table_kind(K, pred);
+
+    TValue tab = klispH_newkind(K,
+                                0,  /* narray - not used in klisp */
+                                32, /* nhash - size of the hash table */
+                                0,  /* wflags - no weak pointers */ 
+                                kind);
+    kapply_cc(K, tab);
+}
+
+/* returns the weak flags for the weakness symbol sym */
+static int32_t get_table_weakness(klisp_State *K, TValue sym)
+{
+    if (ksymbol_cstr_cmp(sym, "keys") == 0)
+        return K_FLAG_WEAK_KEYS;
+    else if (ksymbol_cstr_cmp(sym, "values") == 0)
+        return K_FLAG_WEAK_VALUES;
+    else if (ksymbol_cstr_cmp(sym, "keys-and-values") == 0)
+        return K_FLAG_WEAK_KEYS | K_FLAG_WEAK_VALUES;
+    else if (ksymbol_cstr_cmp(sym, "ephemeron") == 0)
+        return K_FLAG_WEAK_KEYS | K_FLAG_EPHEMERON;
+
+    klispE_throw_simple_with_irritants(K, "unsupported weakness", 1, sym);
+    return K_FLAG_WEAK_NOTHING;
+}
+
+static void make_weak_hash_table(klisp_State *K)
+{
+    bind_al1tp(K, K->next_value, "symbol", ttissymbol, weakness, pred);
+    int32_t wflags = get_table_weakness(K, weakness);
+    int32_t kind = K_TABLE_EQ;
+    if (get_opt_tpar(K, pred, "applicative", ttisapplicative))
+        kind = get_table_kind(K, pred);
+
+    TValue tab = klispH_newkind(K, 0, 32, wflags, kind);
     kapply_cc(K, tab);
 }
 
@@ -130,6 +224,7 @@ static void hash_table_setB(klisp_State *K)
              "hash table", ttistable, tab,
              "any", anytype, key,
              "any", anytype, val);
+    check_key(K, tab, key);
     *klispH_set(K, tv2table(tab), key) = val;
     kapply_cc(K, KINERT);
 }
@@ -141,8 +236,9 @@ static void hash_table_ref(klisp_State *K)
                "any", anytype, key,
                dfl);
     (void) get_opt_tpar(K, dfl, "combiner", ttiscombiner);
+    check_key(K, tab, key);
 
-    const TValue *node = klispH_get(tv2table(tab), key);
+    const TValue *node = klispH_get(K, tv2table(tab), key);
     if (!ttisfree(*node)) {
         kapply_cc(K, *node);
     } else if (ttiscombiner(dfl)) {
@@ -155,6 +251,117 @@ static void hash_table_ref(klisp_State *K)
     }
 }
 
+static void hash_table_ref_default(klisp_State *K)
+{
+    bind_3tp(K, K->next_value,
+             "hash table", ttistable, tab,
+             "any", anytype, key,
+             "any", anytype, dfl);
+    check_key(K, tab, key);
+
+    const TValue *node = klispH_get(K, tv2table(tab), key);
+    kapply_cc(K, ttisfree(*node)? dfl : *node);
+}
+
+/* 
+** The slot of the binding is remembered between the lookup and the call 
+** to the updating procedure. It can be reused as long as the table 
+** wasn't resized and the key is still there (it may have been moved 
+** by an insertion).
+*/
+static TValue *update_slot(klisp_State *K, Table *t, TValue key, 
+                           TValue *xparams)
+{
+    TValue *slot = (TValue *) pvalue(xparams[0]);
+    if (slot != NULL && t->node == (Node *) pvalue(xparams[1]) &&
+        t->array == (TValue *) pvalue(xparams[2]) && 
+        t->sizearray == ivalue(xparams[3])) {
+        if (slot >= t->array && slot < t->array + t->sizearray)
+            return slot; /* array part */
+        Node *n = (Node *) (((char *) slot) - offsetof(Node, i_val));
+        if (tv_equal(key2tval(n), key))
+            return slot; /* hash part */
+    }
+    /* the table changed, look it up again */
+    return klispH_set(K, t, key);
+}
+
+/* Helper for hash-table-update! */
+static void do_update(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue obj = K->next_value;
+    klisp_assert(ttisnil(K->next_env));
+    /*
+    ** xparams[0]: table
+    ** xparams[1]: key
+    ** xparams[2]: slot (or NULL if the key wasn't present)
+    ** xparams[3]: node array of the table when the slot was taken
+    ** xparams[4]: array part of the table when the slot was taken
+    ** xparams[5]: size of the array part of the table
+    */
+    TValue tab = xparams[0];
+    TValue key = xparams[1];
+
+    *update_slot(K, tv2table(tab), key, xparams+2) = obj;
+    kapply_cc(K, KINERT);
+}
+
+/* Helper for hash-table-update!, calls the updating procedure */
+static void do_update_call(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue obj = K->next_value;
+    klisp_assert(ttisnil(K->next_env));
+    /*
+    ** xparams[0]: applicative
+    ** xparams[1]: dynamic environment
+    */
+    TValue app = xparams[0];
+    TValue denv = xparams[1];
+    
+    /* have to unwrap the applicative to avoid extra evaluation of obj */
+    TValue expr = klist(K, 2, kunwrap(app), obj);
+    ktail_eval(K, expr, denv);
+}
+
+static void hash_table_updateB(klisp_State *K)
+{
+    bind_al3tp(K, K->next_value,
+               "hash table", ttistable, tab,
+               "any", anytype, key,
+               "applicative", ttisapplicative, app,
+               dfl);
+    bool has_dfl = get_opt_tpar(K, dfl, "combiner", ttiscombiner);
+    check_key(K, tab, key);
+
+    Table *t = tv2table(tab);
+    const TValue *node = klispH_get(K, t, key);
+    bool found = !ttisfree(*node);
+
+    if (!found && !has_dfl) {
+        klispE_throw_simple_with_irritants(K, "key not found", 1, key);
+        return;
+    }
+
+    TValue new_cont = 
+        kmake_continuation(K, kget_cc(K), do_update, 6, tab, key, 
+                           p2tv(found? (void *) node : NULL), p2tv(t->node), 
+                           p2tv(t->array), i2tv(t->sizearray));
+    kset_cc(K, new_cont);
+    new_cont = kmake_continuation(K, kget_cc(K), do_update_call, 2, app, 
+                                  K->next_env);
+    kset_cc(K, new_cont);
+
+    if (found) {
+        kapply_cc(K, *node);
+    } else {
+        while(ttisapplicative(dfl))
+            dfl = tv2app(dfl)->underlying;
+        ktail_call(K, dfl, KNIL, K->next_env);
+    }
+}
+
 static void hash_table_existsP(klisp_State *K)
 {
     int32_t i, pairs;
@@ -165,7 +372,8 @@ static void hash_table_existsP(klisp_State *K)
     check_list(K, 1, keys, &pairs, NULL);
 
     for (i = 0; i < pairs; i++, keys = kcdr(keys)) {
-        const TValue *node = klispH_get(tv2table(tab), kcar(keys));
+        check_key(K, tab, kcar(keys));
+        const TValue *node = klispH_get(K, tv2table(tab), kcar(keys));
         if (ttisfree(*node)) {
             res = KFALSE;
             break;
@@ -183,10 +391,8 @@ static void hash_table_deleteB(klisp_State *K)
     check_list(K, 1, keys, &pairs, NULL);
 
     for (i = 0; i < pairs; i++, keys = kcdr(keys)) {
-        TValue *node = klispH_set(K, tv2table(tab), kcar(keys));
-        if (!ttisfree(*node)) {
-            *node = KFREE; /* TODO: shrink ? */
-        }
+        check_key(K, tab, kcar(keys));
+        (void) klispH_remove(K, tv2table(tab), kcar(keys));
     }
     kapply_cc(K, KINERT);
 }
@@ -216,13 +422,18 @@ static void hash_table_constructor(klisp_State *K)
 static void alist_to_hash_table(klisp_State *K)
 {
     int32_t pairs, i;
-    bind_1p(K, K->next_value, rest);
+    int32_t kind = K_TABLE_EQ;
+    bind_al1p(K, K->next_value, rest, pred);
+    if (get_opt_tpar(K, pred, "applicative", ttisapplicative))
+        kind = get_table_kind(K, pred);
     check_typed_list(K, kpairp, true, rest, &pairs, NULL);
 
-    TValue tab = klispH_new(K, 0, 32 + 2 * pairs, 0);
+    TValue tab = klispH_newkind(K, 0, 32 + 2 * pairs, 0, kind);
     krooted_tvs_push(K, tab);
-    for (i = 0; i < pairs; i++, rest = kcdr(rest))
+    for (i = 0; i < pairs; i++, rest = kcdr(rest)) {
+        check_key(K, tab, kcaar(rest));
         *klispH_set(K, tv2table(tab), kcaar(rest)) = kcdar(rest);
+    }
     krooted_tvs_pop(K);
     kapply_cc(K, tab);
 }
@@ -245,15 +456,30 @@ static void hash_table_merge(klisp_State *K)
         rest = kcdr(rest);
         pairs--;
     } else {
-        dest = klispH_new(K, 0, 32 + 2 * pairs, 0);
+        /* the new table compares keys like the first one, has the same
+           weakness, and has room for all the bindings (the common ones
+           may be counted more than once) */
+        int32_t kind = pairs > 0? tv2table(kcar(rest))->kind : K_TABLE_EQ;
+        int32_t wflags = pairs > 0? 
+            (tv_get_kflags(kcar(rest)) & (K_FLAG_WEAK_KEYS | 
+                                          K_FLAG_WEAK_VALUES |
+                                          K_FLAG_EPHEMERON)) :
+            K_FLAG_WEAK_NOTHING;
+        int32_t total = 0;
+        TValue ls = rest;
+        for (int32_t i = 0; i < pairs; i++, ls = kcdr(ls))
+            total += klispH_numuse(tv2table(kcar(ls)));
+        dest = klispH_newkind(K, 0, total, wflags, kind);
     }
 
     krooted_tvs_push(K, dest);
     while (pairs--) {
         TValue key = KFREE, data;
         Table *t = tv2table(kcar(rest));
-        while (klispH_next(K, t, &key, &data))
+        while (klispH_next(K, t, &key, &data)) {
+            check_key(K, dest, key);
             *klispH_set(K, tv2table(dest), key) = data;
+        }
         rest = kcdr(rest);
     }
     krooted_tvs_pop(K);
@@ -308,6 +534,80 @@ static void hash_table_to_list(klisp_State *K)
     kapply_cc(K, res);
 }
 
+/* Helper for hash-table-walk */
+static void do_walk(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue obj = K->next_value;
+    klisp_assert(ttisnil(K->next_env));
+    /*
+    ** xparams[0]: applicative
+    ** xparams[1]: remaining (key . value) pairs
+    ** xparams[2]: dynamic environment
+    */
+    TValue app = xparams[0];
+    TValue ls = xparams[1];
+    TValue denv = xparams[2];
+
+    /* the resulting value is just ignored */
+    UNUSED(obj);
+
+    if (ttisnil(ls)) {
+        kapply_cc(K, KINERT);
+    } else {
+        /* have to unwrap the applicative to avoid extra evaluation of 
+           the key & value */
+        TValue expr = klist(K, 3, kunwrap(app), kcaar(ls), kcdar(ls));
+        krooted_tvs_push(K, expr);
+        TValue new_cont = 
+            kmake_continuation(K, kget_cc(K), do_walk, 3, app, kcdr(ls), 
+                               denv);
+        krooted_tvs_pop(K);
+        kset_cc(K, new_cont);
+        ktail_eval(K, expr, denv);
+    }
+}
+
+static void hash_table_walk(klisp_State *K)
+{
+    bind_2tp(K, K->next_value,
+             "hash table", ttistable, tab,
+             "applicative", ttisapplicative, app);
+
+    /* take the bindings first, in case app modifies the table */
+    TValue ls = table_elements(K, tv2table(tab), mkelt_cons);
+    krooted_tvs_push(K, ls);
+    TValue new_cont = 
+        kmake_continuation(K, kget_cc(K), do_walk, 3, app, ls, K->next_env);
+    krooted_tvs_pop(K);
+    kset_cc(K, new_cont);
+    /* this will be a nop */
+    kapply_cc(K, KINERT);
+}
+
+static void hash(klisp_State *K)
+{
+    bool stringp = bvalue(K->next_xparams[0]);
+    bind_al1p(K, K->next_value, obj, bound);
+    bool has_bound = get_opt_tpar(K, bound, "fixint", ttisfixint);
+
+    if (stringp && !ttisstring(obj)) {
+        klispE_throw_simple(K, "Bad type on first argument (expected "
+                            "string)");
+        return;
+    } else if (has_bound && ivalue(bound) <= 0) {
+        klispE_throw_simple(K, "bound should be positive");
+        return;
+    }
+
+    uint32_t h = klispH_equalhash(K, obj);
+    if (has_bound)
+        h %= (uint32_t) ivalue(bound);
+    else
+        h &= INT32_MAX;
+    kapply_cc(K, i2tv((int32_t) h));
+}
+
 /* init ground */
 void kinit_tables_ground_env(klisp_State *K)
 {
@@ -316,16 +616,37 @@ void kinit_tables_ground_env(klisp_State *K)
 
     add_applicative(K, ground_env, "hash-table?", typep, 2, symbol,
                     i2tv(K_TTABLE));
-    add_applicative(K, ground_env, "make-hash-table", make_hash_table, 0);
+    /* the equivalence predicates for make-hash-table & alist->hash-table */
+    TValue eqp = kget_binding(K, ground_env, ksymbol_new_b(K, "eq?", KNIL));
+    krooted_tvs_push(K, eqp);
+    TValue equalp = kget_binding(K, ground_env, 
+                                 ksymbol_new_b(K, "equal?", KNIL));
+    krooted_tvs_push(K, equalp);
+    TValue stringp = kget_binding(K, ground_env, 
+                                  ksymbol_new_b(K, "string=?", KNIL));
+    krooted_tvs_push(K, stringp);
+
+    add_applicative(K, ground_env, "make-hash-table", make_hash_table, 3,
+                    eqp, equalp, stringp);
+    add_applicative(K, ground_env, "make-weak-hash-table", 
+                    make_weak_hash_table, 3, eqp, equalp, stringp);
 
     add_applicative(K, ground_env, "hash-table-set!", hash_table_setB, 0);
     add_applicative(K, ground_env, "hash-table-ref", hash_table_ref, 0);
+    add_applicative(K, ground_env, "hash-table-ref/default", 
+                    hash_table_ref_default, 0);
+    add_applicative(K, ground_env, "hash-table-update!", hash_table_updateB, 
+                    0);
     add_applicative(K, ground_env, "hash-table-exists?", hash_table_existsP, 0);
     add_applicative(K, ground_env, "hash-table-delete!", hash_table_deleteB, 0);
     add_applicative(K, ground_env, "hash-table-length", hash_table_length, 0);
 
     add_applicative(K, ground_env, "hash-table", hash_table_constructor, 0);
-    add_applicative(K, ground_env, "alist->hash-table", alist_to_hash_table, 0);
+    add_applicative(K, ground_env, "alist->hash-table", alist_to_hash_table, 
+                    3, eqp, equalp, stringp);
+    krooted_tvs_pop(K);
+    krooted_tvs_pop(K);
+    krooted_tvs_pop(K);
 
     add_applicative(K, ground_env, "hash-table-merge", hash_table_merge, 2, KFALSE, KFALSE);
     add_applicative(K, ground_env, "hash-table-copy", hash_table_merge, 2, KFALSE, KTRUE);
@@ -334,4 +655,8 @@ void kinit_tables_ground_env(klisp_State *K)
     add_applicative(K, ground_env, "hash-table-keys", hash_table_to_list, 1, p2tv(mkelt_proj1));
     add_applicative(K, ground_env, "hash-table-values", hash_table_to_list, 1, p2tv(mkelt_proj2));
     add_applicative(K, ground_env, "hash-table->alist", hash_table_to_list, 1, p2tv(mkelt_cons));
+    add_applicative(K, ground_env, "hash-table-walk", hash_table_walk, 0);
+
+    add_applicative(K, ground_env, "hash", hash, 1, KFALSE);
+    add_applicative(K, ground_env, "string-hash", hash, 1, KTRUE);
 }
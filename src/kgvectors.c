@@ -124,11 +124,14 @@ void vector_copy(klisp_State *K)
     klisp_assert(ttisenvironment(K->next_env));
     TValue ptree = K->next_value;
 
-    bind_1tp(K, ptree, "vector", ttisvector, v);
+    bind_al1tp(K, ptree, "vector", ttisvector, v, rest);
 
-    TValue new_vector = kvector_emptyp(v)? 
-        v
-        : kvector_new_bs_g(K, true, kvector_buf(v), kvector_size(v));
+    int32_t start, end;
+    get_opt_range(K, rest, kvector_size(v), &start, &end);
+
+    /* this returns the empty vector if start == end */
+    TValue new_vector = kvector_new_bs_g(K, true, kvector_buf(v) + start, 
+                                         end - start);
     kapply_cc(K, new_vector);
 }
 
@@ -258,9 +261,9 @@ void vector_copyB(klisp_State *K)
 
     if (!tv_equal(vector1, vector2) && 
         !tv_equal(vector1, G(K)->empty_vector)) {
-        memcpy(kvector_buf(vector2),
-               kvector_buf(vector1),
-               kvector_size(vector1) * sizeof(TValue));
+        memmove(kvector_buf(vector2),
+                kvector_buf(vector1),
+                kvector_size(vector1) * sizeof(TValue));
     }
     kapply_cc(K, KINERT);
 }
@@ -378,10 +381,11 @@ void vector_copy_partialB(klisp_State *K)
         return;
     }
 
+    /* the ranges may overlap if both vectors are the same */
     if (size > 0) {
-        memcpy(kvector_buf(vector2) + start2,
-               kvector_buf(vector1) + start,
-               size * sizeof(TValue));
+        memmove(kvector_buf(vector2) + start2,
+                kvector_buf(vector1) + start,
+                size * sizeof(TValue));
     }
     kapply_cc(K, KINERT);
 }
@@ -395,19 +399,180 @@ void vector_fillB(klisp_State *K)
     klisp_assert(ttisenvironment(K->next_env));
     UNUSED(xparams);
     UNUSED(denv);
-    bind_2tp(K, ptree, "vector", ttisvector, vector,
-             "any", anytype, fill);
+    bind_al2tp(K, ptree, "vector", ttisvector, vector,
+               "any", anytype, fill, rest);
 
     if (kvector_immutablep(vector)) {
         klispE_throw_simple(K, "immutable vector");
         return;
     } 
 
+    int32_t start, end;
+    get_opt_range(K, rest, kvector_size(vector), &start, &end);
+
+    /* TValues can't be memset, instead fill a few elements and then 
+       keep doubling the filled prefix with memcpy */
+    TValue *buf = kvector_buf(vector) + start;
+    int32_t size = end - start;
+    int32_t filled = kmin32(size, 8);
+    for (int32_t i = 0; i < filled; ++i)
+        buf[i] = fill;
+    while(filled < size) {
+        int32_t n = kmin32(filled, size - filled);
+        memcpy(buf + filled, buf, n * sizeof(TValue));
+        filled += n;
+    }
+    kapply_cc(K, KINERT);
+}
+
+/* ?.? vector-sort! */
+/* see sort_seq in kghelpers.c */
+void vector_sortB(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    UNUSED(denv);
+    bind_2tp(K, ptree, "vector", ttisvector, vector,
+             "applicative", ttisapplicative, less);
+
+    sort_seq(K, vector, less, true);
+}
+
+/* ?.? vector-fold */
+/* see fold_seq in kghelpers.c */
+void vector_fold(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    bind_3tp(K, ptree, "applicative", ttisapplicative, app,
+             "any", anytype, init, "vector", ttisvector, vector);
+
+    fold_seq(K, vector, app, init, false, denv);
+}
+
+/* ?.? vector-reduce */
+/* like reduce, but only for vectors (and without the cyclic handling 
+   applicatives) */
+void vector_reduce(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    bind_3tp(K, ptree, "vector", ttisvector, vector, 
+             "applicative", ttisapplicative, bin, "any", anytype, id);
+
     uint32_t size = kvector_size(vector);
-    TValue *buf = kvector_buf(vector);
-    while(size-- > 0) {
-        *buf++ = fill;
+    if (size == 0) {
+        kapply_cc(K, id);
+    } 
+    
+    /* the first element is the initial value */
+    TValue rest = kvector_new_bs_g(K, true, kvector_buf(vector) + 1, 
+                                   size - 1);
+    fold_seq(K, rest, bin, kvector_buf(vector)[0], false, denv);
+}
+
+/* ?.? make-growable-vector */
+/* Any mutable vector can grow, but empty vectors are always immutable,
+   this returns an empty mutable vector with room for capacity elements */
+void make_growable_vector(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    UNUSED(denv);
+
+    TValue tv_c = ptree;
+    int32_t capacity = KVECTOR_MINGROWTH;
+    if (get_opt_tpar(K, tv_c, "exact integer", keintegerp)) {
+        if (knegativep(tv_c)) {
+            klispE_throw_simple(K, "negative vector capacity");
+            return;
+        } else if (!ttisfixint(tv_c)) {
+            klispE_throw_simple(K, "vector capacity is too big");
+            return;
+        } else if (ivalue(tv_c) > 0) {
+            capacity = ivalue(tv_c);
+        }
     }
+    kapply_cc(K, kvector_new_c(K, capacity));
+}
+
+/* ?.? vector-push!, vector-pop! */
+void vector_pushB(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    UNUSED(denv);
+    bind_2tp(K, ptree, "vector", ttisvector, vector, "any", anytype, obj);
+
+    if (kvector_immutablep(vector)) {
+        klispE_throw_simple(K, "immutable vector");
+        return;
+    } else if (kvector_size(vector) == INT32_MAX) {
+        klispE_throw_simple(K, "vector is too big");
+        return;
+    }
+    kvector_push(K, vector, obj);
+    kapply_cc(K, KINERT);
+}
+
+void vector_popB(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    UNUSED(denv);
+    bind_1tp(K, ptree, "vector", ttisvector, vector);
+
+    if (kvector_immutablep(vector)) {
+        klispE_throw_simple(K, "immutable vector");
+        return;
+    } else if (kvector_emptyp(vector)) {
+        klispE_throw_simple(K, "empty vector");
+        return;
+    }
+    kapply_cc(K, kvector_pop(K, vector));
+}
+
+/* ?.? vector-reserve! */
+void vector_reserveB(klisp_State *K)
+{
+    TValue *xparams = K->next_xparams;
+    TValue ptree = K->next_value;
+    TValue denv = K->next_env;
+    klisp_assert(ttisenvironment(K->next_env));
+    UNUSED(xparams);
+    UNUSED(denv);
+    bind_2tp(K, ptree, "vector", ttisvector, vector, 
+             "exact integer", keintegerp, tv_c);
+
+    if (kvector_immutablep(vector)) {
+        klispE_throw_simple(K, "immutable vector");
+        return;
+    } else if (knegativep(tv_c)) {
+        klispE_throw_simple(K, "negative vector capacity");
+        return;
+    } else if (!ttisfixint(tv_c)) {
+        klispE_throw_simple(K, "vector capacity is too big");
+        return;
+    }
+    kvector_reserve(K, vector, ivalue(tv_c));
     kapply_cc(K, KINERT);
 }
 
@@ -484,6 +649,21 @@ void kinit_vectors_ground_env(klisp_State *K)
     /* ?.? vector-fill! */
     add_applicative(K, ground_env, "vector-fill!", vector_fillB, 0);
 
+    /* ?.? vector-sort! */
+    add_applicative(K, ground_env, "vector-sort!", vector_sortB, 0);
+
+    /* ?.? make-growable-vector, vector-push!, vector-pop!, 
+       vector-reserve! */
+    add_applicative(K, ground_env, "make-growable-vector", 
+                    make_growable_vector, 0);
+    add_applicative(K, ground_env, "vector-push!", vector_pushB, 0);
+    add_applicative(K, ground_env, "vector-pop!", vector_popB, 0);
+    add_applicative(K, ground_env, "vector-reserve!", vector_reserveB, 0);
+
+    /* ?.? vector-fold, vector-reduce */
+    add_applicative(K, ground_env, "vector-fold", vector_fold, 0);
+    add_applicative(K, ground_env, "vector-reduce", vector_reduce, 0);
+
     /* ?.? vector->immutable-vector */
     add_applicative(K, ground_env, "vector->immutable-vector",
                     vector_to_immutable_vector, 0);
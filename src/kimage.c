@@ -0,0 +1,881 @@
+/*
+** kimage.c
+** Heap images
+** See Copyright Notice in klisp.h
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "kimage.h"
+#include "kobject.h"
+#include "kstate.h"
+#include "kmem.h"
+#include "kgc.h"
+#include "kstring.h"
+#include "ksymbol.h"
+#include "kkeyword.h"
+#include "ktable.h"
+#include "kpair.h"
+#include "koperative.h"
+#include "kcontinuation.h"
+#include "ksystem.h"
+#include "kprofile.h"
+#include "kground.h"
+#include "kgbooleans.h"
+#include "kggc.h"
+
+/*
+** Image file layout (all in native byte order):
+** - the header (ImageHeader),
+** - the heap: the roots (see kimage_roots) followed by the objects, each
+**   one followed by its separately allocated arrays (if any), all the
+**   blocks are 8 byte aligned,
+** - the relocations (Reloc), the slots of the heap they fix are zeroed,
+** - the offsets in the heap of all the objects (uint32_t), to link them
+**   when loading.
+*/
+#define KIMAGE_MAGIC "\x7fklimg01"
+
+typedef struct {
+    char magic[8];
+    uint32_t fingerprint; /* of the code layout (see fingerprint) */
+    uint32_t nobjs; /* number of objects */
+    uint32_t nrelocs; /* number of relocations */
+    uint32_t heapsize; /* size of the heap in bytes */
+    uint64_t heapbytes; /* memory accounted for the objects (see freeobj) */
+} ImageHeader;
+
+typedef struct {
+    uint32_t where; /* offset of the slot in the heap << 3 | kind */
+    int32_t what; /* depends on the kind, see below */
+} Reloc;
+
+/* pointer to the object at heap offset what */
+#define KR_OBJ 0
+/* tagged value with the object at heap offset what */
+#define KR_OBJTV 1
+/* pointer to klisp code or static data at what bytes from the anchor */
+#define KR_PROG 2
+/* user value (see p2tv) with the pointer at what bytes from the anchor */
+#define KR_PROGTV 3
+/* user value with the function kimage_funcs[what] */
+#define KR_FUNCTV 4
+/* FILE pointer: stdin (0), stdout (1) or stderr (2) */
+#define KR_FILE 5
+/* tagged value with the main thread */
+#define KR_THREADTV 6
+
+#define reloc_where(r_) ((r_)->where >> 3)
+#define reloc_kind(r_) ((r_)->where & 7)
+
+/* code & static data are addressed relative to a function in this file */
+#define KIMAGE_ANCHOR ((char *) (uintptr_t) &klispI_load)
+#define progoffset(p_) ((intptr_t) ((char *) (p_) - KIMAGE_ANCHOR))
+
+/* all blocks are 8 byte aligned */
+#define align8(n_) (((n_) + 7) & ~((size_t) 7))
+#define HEAP_START align8(sizeof(ImageHeader))
+/* the offsets are shifted in the relocations */
+#define MAX_HEAPSIZE ((size_t) 1 << 29)
+
+/* C library functions stored in xparams, these aren't in the klisp
+   executable so they can't be addressed relative to the anchor */
+static void *const kimage_funcs[] = {
+    (void *) tolower, (void *) toupper,
+    (void *) sin, (void *) cos, (void *) tan, (void *) asin, (void *) acos,
+};
+#define NFUNCS ((int32_t) (sizeof(kimage_funcs) / sizeof(kimage_funcs[0])))
+
+/* the roots of the global state saved in the image, they are the first
+   values of the heap, followed by K->next_env.
+   require_path depends on the environment, so it isn't saved, and the
+   profiler tables are created anew (see klisp_newstate_image) */
+static const size_t kimage_roots[] = {
+    offsetof(global_State, name_table),
+    offsetof(global_State, cont_name_table),
+    offsetof(global_State, thread_table),
+    offsetof(global_State, guarded),
+    offsetof(global_State, root_cont),
+    offsetof(global_State, error_cont),
+    offsetof(global_State, system_error_cont),
+    offsetof(global_State, empty_string),
+    offsetof(global_State, empty_bytevector),
+    offsetof(global_State, empty_vector),
+    offsetof(global_State, si_files),
+    offsetof(global_State, ktok_lparen),
+    offsetof(global_State, ktok_rparen),
+    offsetof(global_State, ktok_dot),
+    offsetof(global_State, ktok_sexp_comment),
+    offsetof(global_State, require_table),
+    offsetof(global_State, libraries_registry),
+    offsetof(global_State, kd_in_port_key),
+    offsetof(global_State, kd_out_port_key),
+    offsetof(global_State, kd_error_port_key),
+    offsetof(global_State, kd_strict_arith_key),
+    offsetof(global_State, eval_op),
+    offsetof(global_State, list_app),
+    offsetof(global_State, memoize_app),
+    offsetof(global_State, ground_env),
+    offsetof(global_State, module_params_sym),
+};
+#define NROOTS (sizeof(kimage_roots) / sizeof(kimage_roots[0]))
+#define groot(g_, i_) (*(TValue *) ((char *) (g_) + kimage_roots[i_]))
+#define ROOTS_SIZE align8((NROOTS + 1) * sizeof(TValue))
+
+/*
+** The relocated code & static data pointers are only valid in the same
+** executable. Use the distance to the anchor of functions spread over
+** the whole program (any change in the code before them moves them)
+** and the sizes of the main structures.
+*/
+#define fnoffset(f_) ((uint64_t) progoffset((void *) (uintptr_t) (f_)))
+
+static uint32_t fingerprint(void)
+{
+    uint64_t buf[] = {
+        fnoffset(klisp_newstate), fnoffset(klispM_realloc_),
+        fnoffset(klispC_fullgc), fnoffset(klispH_new),
+        fnoffset(klispS_hash), fnoffset(ksymbol_hash),
+        fnoffset(kmake_operative), fnoffset(kmake_continuation),
+        fnoffset(kcons_g), fnoffset(klispT_run), fnoffset(kinit_ground_env),
+        fnoffset(kinit_booleans_ground_env), fnoffset(kinit_gc_ground_env),
+        fnoffset(klispP_start), fnoffset(ksystem_map_file),
+        sizeof(void *), sizeof(TValue), sizeof(global_State),
+        sizeof(klisp_State),
+#ifdef KPROFILE
+        1,
+#else
+        0,
+#endif
+    };
+    return klispS_hash(buf, sizeof(buf), 0);
+}
+
+/*
+** Dump
+*/
+
+typedef struct {
+    klisp_State *K;
+    /* the buffers are allocated outside of the klisp heap, so that no
+       collection can start while the objects are marked */
+    GCObject **objs; /* the objects in the image, in order */
+    uint32_t nobjs;
+    uint32_t sizeobjs;
+    Reloc *relocs;
+    uint32_t nrelocs;
+    uint32_t sizerelocs;
+    char *heap; /* NULL while collecting the objects */
+    size_t heapsize;
+    uint64_t heapbytes;
+    const char *msg; /* error message or NULL */
+} DumpState;
+
+/* the marked objects have the offset in the heap in gclist */
+#define objoffset(o_) ((size_t) (uintptr_t) (o_)->gch.gclist)
+
+static bool grow(DumpState *D, void **buf, uint32_t *size, size_t elsize)
+{
+    global_State *g = G(D->K);
+    uint32_t nsize = (*size == 0)? 256 : *size * 2;
+    void *nbuf = (*g->frealloc)(g->ud, *buf, *size * elsize, nsize * elsize);
+    if (nbuf == NULL) {
+        D->msg = "not enough memory";
+        return false;
+    }
+    *buf = nbuf;
+    *size = nsize;
+    return true;
+}
+
+static void setslot(DumpState *D, size_t where, const void *p, size_t size)
+{
+    memcpy(D->heap + where, p, size);
+}
+
+static void addreloc(DumpState *D, size_t where, uint32_t kind, int64_t what)
+{
+    if (D->nrelocs == D->sizerelocs &&
+        !grow(D, (void **) &D->relocs, &D->sizerelocs, sizeof(Reloc)))
+        return;
+    Reloc *r = &D->relocs[D->nrelocs++];
+    r->where = (uint32_t) (where << 3) | kind;
+    r->what = (int32_t) what;
+}
+
+/* pointer to the heap in a raw pointer slot */
+static void dumpheapptr(DumpState *D, size_t where, size_t off)
+{
+    void *null = NULL;
+    setslot(D, where, &null, sizeof(null));
+    addreloc(D, where, KR_OBJ, off);
+}
+
+/* pointer to klisp code or static data */
+static void dumpprog(DumpState *D, size_t where, const void *p,
+                     uint32_t kind)
+{
+    intptr_t off = progoffset(p);
+    if (off < INT32_MIN || off > INT32_MAX) {
+        /* it is most likely a pointer to C data from the ffi */
+        D->msg = "a pointer to C data can't be in an image";
+        return;
+    }
+    addreloc(D, where, kind, off);
+}
+
+static size_t objsize(DumpState *D, GCObject *o, size_t *bytes);
+
+/* mark an object to be dumped */
+static void dumpref(DumpState *D, GCObject *o)
+{
+    if (o == obj2gco(G(D->K)->mainthread) || isblack(o) || D->msg != NULL)
+        return;
+
+    size_t bytes;
+    size_t size = objsize(D, o, &bytes);
+    if (size == 0)
+        return; /* error */
+    if (D->heapsize + size > MAX_HEAPSIZE) {
+        D->msg = "the heap is too big for an image";
+        return;
+    }
+    if (D->nobjs == D->sizeobjs &&
+        !grow(D, (void **) &D->objs, &D->sizeobjs, sizeof(GCObject *)))
+        return;
+
+    gray2black(o);
+    o->gch.gclist = (GCObject *) (uintptr_t) D->heapsize;
+    D->objs[D->nobjs++] = o;
+    D->heapsize += size;
+    D->heapbytes += bytes;
+}
+
+/* v is the value in the heap at offset where, in the first pass this
+   marks the object in v, in the second one it relocates the slot */
+static void dumpvalue(DumpState *D, TValue v, size_t where)
+{
+    if (D->heap == NULL) {
+        if (iscollectable(v) && ttype(v) != K_TDEADKEY)
+            dumpref(D, gcvalue(v));
+        return;
+    }
+
+    if (ttisuser(v)) {
+        void *p = pvalue(v);
+        if (p == NULL)
+            return;
+        TValue null = p2tv(NULL);
+        setslot(D, where, &null, sizeof(TValue));
+        for (int32_t i = 0; i < NFUNCS; i++) {
+            if (kimage_funcs[i] == p) {
+                addreloc(D, where, KR_FUNCTV, i);
+                return;
+            }
+        }
+        dumpprog(D, where, p, KR_PROGTV);
+    } else if (iscollectable(v)) {
+        GCObject *o = gcvalue(v);
+        TValue null = gc2tv(ttag(v), NULL);
+        setslot(D, where, &null, sizeof(TValue));
+        if (o == obj2gco(G(D->K)->mainthread)) {
+            addreloc(D, where, KR_THREADTV, 0);
+        } else {
+            klisp_assert(isblack(o));
+            addreloc(D, where, KR_OBJTV, objoffset(o));
+        }
+    }
+}
+
+static void dumpvaluearray(DumpState *D, TValue *array, int32_t size,
+                           size_t where)
+{
+    for (int32_t i = 0; i < size; i++)
+        dumpvalue(D, array[i], where + i * sizeof(TValue));
+}
+
+/* the digits of a bigint (or one of the parts of a bigrat) at offset off,
+   if they are separately allocated they go to *next */
+static void dumpdigits(DumpState *D, Bigint *b, size_t off, size_t *next)
+{
+    char *single = (char *) b + offsetof(Bigint, single);
+    size_t where = off + offsetof(Bigint, digits);
+
+    if (b->digits == NULL) {
+        return;
+    } else if ((char *) b->digits == single) {
+        if (D->heap != NULL)
+            dumpheapptr(D, where, off + offsetof(Bigint, single));
+    } else {
+        size_t size = b->alloc * sizeof(uint32_t);
+        if (D->heap != NULL) {
+            setslot(D, *next, b->digits, size);
+            dumpheapptr(D, where, *next);
+        }
+        *next += align8(size);
+    }
+}
+
+/* the size of the object itself, it should match the one in freeobj
+   (see kgc.c), 0 if the object can't be dumped */
+static size_t mainsize(DumpState *D, GCObject *o)
+{
+    switch (o->gch.tt) {
+    case K_TBIGINT: return sizeof(Bigint);
+    case K_TBIGRAT: return sizeof(Bigrat);
+    case K_TPAIR: return sizeof(Pair);
+    case K_TSYMBOL: return sizeof(Symbol);
+    case K_TKEYWORD: return sizeof(Keyword);
+    case K_TSTRING: return sizeof(String) + o->str.size + 1;
+    case K_TENVIRONMENT: return sizeof(Environment);
+    case K_TCONTINUATION:
+        return sizeof(Continuation) + o->cont.extra_size * sizeof(TValue);
+    case K_TOPERATIVE:
+        return sizeof(Operative) + o->op.extra_size * sizeof(TValue);
+    case K_TAPPLICATIVE: return sizeof(Applicative);
+    case K_TENCAPSULATION: return sizeof(Encapsulation);
+    case K_TPROMISE: return sizeof(Promise);
+    case K_TTABLE: return sizeof(Table);
+    case K_TERROR: return sizeof(Error);
+    case K_TBYTEVECTOR: return sizeof(Bytevector) + o->bytevector.size;
+    case K_TFPORT: {
+        FILE *file = o->fport.file;
+        if ((o->gch.kflags & K_FLAG_CLOSED_PORT) == 0 && file != stdin &&
+            file != stdout && file != stderr) {
+            D->msg = "open file ports can't be in an image";
+            return 0;
+        }
+        return sizeof(FPort);
+    }
+    case K_TMPORT: return sizeof(MPort);
+    case K_TVECTOR:
+        return sizeof(Vector) + o->vector.sizeinline * sizeof(TValue);
+    case K_TLIBRARY: return sizeof(Library);
+    case K_TTHREAD:
+        D->msg = "threads other than the main one can't be in an image";
+        return 0;
+    default: /* mutexes & condition variables */
+        D->msg = "mutexes & condition variables can't be in an image";
+        return 0;
+    }
+}
+
+/* the size of the object & its arrays in the heap, bytes is the
+   memory accounted for them */
+static size_t objsize(DumpState *D, GCObject *o, size_t *bytes)
+{
+    size_t size = mainsize(D, o);
+    if (size == 0)
+        return 0;
+    *bytes = size;
+    size = align8(size);
+
+    size_t arrays[2];
+    int32_t narrays = 0;
+    switch (o->gch.tt) {
+    case K_TBIGINT: {
+        Bigint *b = (Bigint *) o;
+        size_t next = 0;
+        dumpdigits(D, b, 0, &next);
+        arrays[narrays++] = next;
+        break;
+    }
+    case K_TBIGRAT: {
+        Bigrat *r = (Bigrat *) o;
+        size_t next = 0;
+        dumpdigits(D, &r->num, 0, &next);
+        dumpdigits(D, &r->den, 0, &next);
+        arrays[narrays++] = next;
+        break;
+    }
+    case K_TTABLE: {
+        Table *t = (Table *) o;
+        if (t->sizearray > 0)
+            arrays[narrays++] = t->sizearray * sizeof(TValue);
+        if (t->node != klispH_dummynode)
+            arrays[narrays++] = sizenode(t) * sizeof(Node);
+        break;
+    }
+    case K_TVECTOR: {
+        Vector *v = (Vector *) o;
+        if (v->array != v->inlinearray)
+            arrays[narrays++] = v->capacity * sizeof(TValue);
+        break;
+    }
+    }
+    for (int32_t i = 0; i < narrays; i++) {
+        /* the digits are already aligned */
+        *bytes += arrays[i];
+        size += align8(arrays[i]);
+    }
+    return size;
+}
+
+/* in the first pass this marks the objects referenced by o, in the second
+   one it copies o (and its arrays) to the heap */
+static void dumpobject(DumpState *D, GCObject *o)
+{
+    size_t off = objoffset(o);
+    size_t size = mainsize(D, o);
+    size_t next = off + align8(size);
+    GCObject *si = o->gch.si;
+
+    if (D->heap != NULL) {
+        setslot(D, off, o, size);
+        GCheader *h = (GCheader *) (D->heap + off);
+        h->next = NULL;
+        h->gclist = NULL;
+        if (si != NULL && !ksi_packedp(si)) {
+            klisp_assert(isblack(si));
+            dumpheapptr(D, off + offsetof(GCheader, si), objoffset(si));
+        }
+    } else if (si != NULL && !ksi_packedp(si)) {
+        dumpref(D, si);
+    }
+
+#define dumpfield(T_, f_) \
+    dumpvalue(D, ((T_ *) o)->f_, off + offsetof(T_, f_))
+
+    switch (o->gch.tt) {
+    case K_TBIGINT:
+        dumpdigits(D, (Bigint *) o, off, &next);
+        break;
+    case K_TBIGRAT:
+        dumpdigits(D, &((Bigrat *) o)->num, off + offsetof(Bigrat, num),
+                   &next);
+        dumpdigits(D, &((Bigrat *) o)->den, off + offsetof(Bigrat, den),
+                   &next);
+        break;
+    case K_TPAIR:
+        dumpfield(Pair, mark);
+        dumpfield(Pair, car);
+        dumpfield(Pair, cdr);
+        break;
+    case K_TSYMBOL:
+        dumpfield(Symbol, str);
+        break;
+    case K_TKEYWORD:
+        dumpfield(Keyword, mark);
+        dumpfield(Keyword, str);
+        break;
+    case K_TSTRING:
+        dumpfield(String, mark);
+        break;
+    case K_TENVIRONMENT:
+        dumpfield(Environment, mark);
+        dumpfield(Environment, parents);
+        dumpfield(Environment, bindings);
+        dumpfield(Environment, keyed_node);
+        dumpfield(Environment, keyed_parents);
+        break;
+    case K_TCONTINUATION: {
+        Continuation *c = (Continuation *) o;
+        dumpfield(Continuation, mark);
+        dumpfield(Continuation, parent);
+        dumpfield(Continuation, comb);
+        if (D->heap != NULL)
+            dumpprog(D, off + offsetof(Continuation, fn),
+                     (void *) (uintptr_t) c->fn, KR_PROG);
+        dumpvaluearray(D, c->extra, c->extra_size,
+                       off + offsetof(Continuation, extra));
+        break;
+    }
+    case K_TOPERATIVE: {
+        Operative *op = (Operative *) o;
+        if (D->heap != NULL)
+            dumpprog(D, off + offsetof(Operative, fn),
+                     (void *) (uintptr_t) op->fn, KR_PROG);
+        dumpvaluearray(D, op->extra, op->extra_size,
+                       off + offsetof(Operative, extra));
+        break;
+    }
+    case K_TAPPLICATIVE:
+        dumpfield(Applicative, underlying);
+        break;
+    case K_TENCAPSULATION:
+        dumpfield(Encapsulation, key);
+        dumpfield(Encapsulation, value);
+        break;
+    case K_TPROMISE:
+        dumpfield(Promise, node);
+        break;
+    case K_TTABLE: {
+        Table *t = (Table *) o;
+        if (t->sizearray > 0) {
+            if (D->heap != NULL) {
+                setslot(D, next, t->array, t->sizearray * sizeof(TValue));
+                dumpheapptr(D, off + offsetof(Table, array), next);
+            }
+            dumpvaluearray(D, t->array, t->sizearray, next);
+            next += align8(t->sizearray * sizeof(TValue));
+        }
+        if (D->heap != NULL) {
+            void *null = NULL;
+            if (t->sizearray == 0)
+                setslot(D, off + offsetof(Table, array), &null, sizeof(null));
+            setslot(D, off + offsetof(Table, lastfree), &null, sizeof(null));
+        }
+        if (t->node == klispH_dummynode) {
+            if (D->heap != NULL)
+                dumpprog(D, off + offsetof(Table, node), klispH_dummynode,
+                         KR_PROG);
+            break;
+        }
+        if (D->heap != NULL)
+            dumpheapptr(D, off + offsetof(Table, node), next);
+        /* the chains are rebuilt when loading (see klispI_load),
+           free nodes & dead keys aren't kept */
+        for (int32_t i = 0; i < sizenode(t); i++) {
+            Node *n = gnode(t, i);
+            size_t where = next + i * sizeof(Node);
+            if (D->heap != NULL) {
+                Node nn;
+                nn.i_val = KFREE;
+                nn.i_key.nk.this = KFREE;
+                nn.i_key.nk.next = NULL;
+                if (!ttisfree(gval(n))) {
+                    nn.i_val = gval(n);
+                    nn.i_key.nk.this = gkey(n)->this;
+                }
+                setslot(D, where, &nn, sizeof(Node));
+            }
+            if (!ttisfree(gval(n))) {
+                dumpvalue(D, gval(n), where + offsetof(Node, i_val));
+                dumpvalue(D, gkey(n)->this, where + offsetof(Node, i_key));
+            }
+        }
+        break;
+    }
+    case K_TERROR:
+        dumpfield(Error, who);
+        dumpfield(Error, cont);
+        dumpfield(Error, msg);
+        dumpfield(Error, irritants);
+        break;
+    case K_TBYTEVECTOR:
+        dumpfield(Bytevector, mark);
+        break;
+    case K_TFPORT: {
+        FPort *p = (FPort *) o;
+        dumpfield(FPort, filename);
+        if (D->heap != NULL) {
+            size_t where = off + offsetof(FPort, file);
+            FILE *null = NULL;
+            setslot(D, where, &null, sizeof(null));
+            if ((p->kflags & K_FLAG_CLOSED_PORT) == 0) {
+                addreloc(D, where, KR_FILE, p->file == stdin? 0 :
+                         p->file == stdout? 1 : 2);
+            }
+        }
+        break;
+    }
+    case K_TMPORT:
+        dumpfield(MPort, filename);
+        dumpfield(MPort, buf);
+        break;
+    case K_TVECTOR: {
+        Vector *v = (Vector *) o;
+        dumpfield(Vector, mark);
+        size_t inl = off + offsetof(Vector, inlinearray);
+        size_t where = inl;
+        if (v->array != v->inlinearray) {
+            where = next;
+            if (D->heap != NULL) {
+                setslot(D, where, v->array, v->capacity * sizeof(TValue));
+                for (uint32_t i = 0; i < v->sizeinline; i++)
+                    setslot(D, inl + i * sizeof(TValue), &kinert,
+                            sizeof(TValue));
+            }
+        }
+        if (D->heap != NULL) {
+            dumpheapptr(D, off + offsetof(Vector, array), where);
+            /* the unused slots may have stale values */
+            uint32_t size = (v->array != v->inlinearray)? v->capacity :
+                v->sizeinline;
+            for (uint32_t i = v->sizearray; i < size; i++)
+                setslot(D, where + i * sizeof(TValue), &kinert,
+                        sizeof(TValue));
+        }
+        dumpvaluearray(D, v->array, v->sizearray, where);
+        break;
+    }
+    case K_TLIBRARY:
+        dumpfield(Library, env);
+        dumpfield(Library, exp_list);
+        break;
+    }
+#undef dumpfield
+}
+
+static void dumproots(DumpState *D)
+{
+    klisp_State *K = D->K;
+    global_State *g = G(K);
+    for (uint32_t i = 0; i <= NROOTS; i++) {
+        TValue v = (i < NROOTS)? groot(g, i) : K->next_env;
+        if (D->heap != NULL)
+            setslot(D, i * sizeof(TValue), &v, sizeof(TValue));
+        dumpvalue(D, v, i * sizeof(TValue));
+    }
+}
+
+static bool writeimage(DumpState *D, FILE *file)
+{
+    ImageHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, KIMAGE_MAGIC, sizeof(h.magic));
+    h.fingerprint = fingerprint();
+    h.nobjs = D->nobjs;
+    h.nrelocs = D->nrelocs;
+    h.heapsize = (uint32_t) D->heapsize;
+    h.heapbytes = D->heapbytes;
+
+    char pad[HEAP_START - sizeof(ImageHeader) + 1];
+    memset(pad, 0, sizeof(pad));
+    if (fwrite(&h, sizeof(h), 1, file) != 1 ||
+        fwrite(pad, 1, sizeof(pad) - 1, file) != sizeof(pad) - 1 ||
+        fwrite(D->heap, 1, D->heapsize, file) != D->heapsize ||
+        fwrite(D->relocs, sizeof(Reloc), D->nrelocs, file) != D->nrelocs)
+        return false;
+    for (uint32_t i = 0; i < D->nobjs; i++) {
+        uint32_t off = (uint32_t) objoffset(D->objs[i]);
+        if (fwrite(&off, sizeof(off), 1, file) != 1)
+            return false;
+    }
+    return true;
+}
+
+/* LOCK: the GIL should be acquired */
+const char *klispI_dump(klisp_State *K, FILE *file)
+{
+    global_State *g = G(K);
+    DumpState D;
+    D.K = K;
+    D.objs = NULL;
+    D.nobjs = D.sizeobjs = 0;
+    D.relocs = NULL;
+    D.nrelocs = D.sizerelocs = 0;
+    D.heap = NULL;
+    D.heapsize = ROOTS_SIZE;
+    D.heapbytes = 0;
+    D.msg = NULL;
+
+    /* after a full collection all live objects are white, so the black
+       bit can be used to mark the objects in the image, nothing from
+       here on can start a collection */
+    klispC_fullgc(K);
+    klisp_assert(g->gcstate == GCSpause);
+
+    /* first pass: mark the objects & assign them a place in the heap */
+    dumproots(&D);
+    for (uint32_t i = 0; i < D.nobjs && D.msg == NULL; i++)
+        dumpobject(&D, D.objs[i]);
+
+    /* second pass: copy the objects */
+    if (D.msg == NULL) {
+        D.heap = (*g->frealloc)(g->ud, NULL, 0, D.heapsize);
+        if (D.heap == NULL) {
+            D.msg = "not enough memory";
+        } else {
+            memset(D.heap, 0, D.heapsize);
+            dumproots(&D);
+            for (uint32_t i = 0; i < D.nobjs && D.msg == NULL; i++)
+                dumpobject(&D, D.objs[i]);
+        }
+    }
+
+    if (D.msg == NULL && !writeimage(&D, file))
+        D.msg = "error writing the image file";
+
+    /* restore the objects */
+    for (uint32_t i = 0; i < D.nobjs; i++) {
+        GCObject *o = D.objs[i];
+        resetbit(o->gch.gct, BLACKBIT);
+        o->gch.gclist = NULL;
+    }
+    if (D.heap != NULL)
+        (*g->frealloc)(g->ud, D.heap, D.heapsize, 0);
+    (*g->frealloc)(g->ud, D.objs, D.sizeobjs * sizeof(GCObject *), 0);
+    (*g->frealloc)(g->ud, D.relocs, D.sizerelocs * sizeof(Reloc), 0);
+    return D.msg;
+}
+
+/*
+** Load
+*/
+
+static bool relocate(klisp_State *K, char *heap, size_t heapsize,
+                     const Reloc *r)
+{
+    size_t where = reloc_where(r);
+    uint32_t kind = reloc_kind(r);
+    bool tv = (kind == KR_OBJTV || kind == KR_PROGTV || kind == KR_FUNCTV ||
+               kind == KR_THREADTV);
+    char *slot = heap + where;
+    void *p;
+
+    if (where + (tv? sizeof(TValue) : sizeof(void *)) > heapsize)
+        return false;
+
+    switch (kind) {
+    case KR_OBJ:
+    case KR_OBJTV:
+        if (r->what < 0 || (size_t) r->what > heapsize)
+            return false;
+        p = heap + r->what;
+        break;
+    case KR_PROG:
+    case KR_PROGTV:
+        p = KIMAGE_ANCHOR + r->what;
+        break;
+    case KR_FUNCTV:
+        if (r->what < 0 || r->what >= NFUNCS)
+            return false;
+        p = kimage_funcs[r->what];
+        break;
+    case KR_FILE:
+        if (r->what < 0 || r->what > 2)
+            return false;
+        p = (r->what == 0)? stdin : (r->what == 1)? stdout : stderr;
+        break;
+    case KR_THREADTV:
+        p = K;
+        break;
+    default:
+        return false;
+    }
+
+    if (!tv) {
+        memcpy(slot, &p, sizeof(p));
+    } else {
+        TValue v;
+        memcpy(&v, slot, sizeof(TValue));
+        v = (kind == KR_OBJTV || kind == KR_THREADTV)?
+            gc2tv(ttag(v), p) : p2tv(p);
+        memcpy(slot, &v, sizeof(TValue));
+    }
+    return true;
+}
+
+/* the object is interned in the string table */
+static bool internedp(GCObject *o)
+{
+    switch (o->gch.tt) {
+    case K_TSTRING:
+    case K_TBYTEVECTOR:
+        return (o->gch.kflags & K_FLAG_IMMUTABLE) != 0;
+    case K_TSYMBOL: /* symbols with source info aren't interned */
+        return (o->gch.kflags & K_FLAG_HAS_SI) == 0;
+    case K_TKEYWORD:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* the hashes depend on the seed of the state */
+static uint32_t objhash(klisp_State *K, GCObject *o)
+{
+    switch (o->gch.tt) {
+    case K_TSTRING:
+        return o->str.hash = klispS_hash(o->str.b, o->str.size, G(K)->seed);
+    case K_TBYTEVECTOR:
+        return o->bytevector.hash = klispS_hash(o->bytevector.b,
+                                                o->bytevector.size,
+                                                G(K)->seed);
+    case K_TSYMBOL: {
+        String *s = (String *) gcvalue(o->sym.str);
+        return o->sym.hash = ksymbol_hash(K, s->b, s->size);
+    }
+    case K_TKEYWORD: {
+        String *s = (String *) gcvalue(o->keyw.str);
+        return o->keyw.hash = kkeyword_hash(K, s->b, s->size);
+    }
+    default:
+        return 0;
+    }
+}
+
+static const char *checkheader(const char *image, size_t size,
+                               ImageHeader *h)
+{
+    memset(h, 0, sizeof(ImageHeader));
+    if (size < sizeof(ImageHeader))
+        return "not a klisp image";
+    memcpy(h, image, sizeof(ImageHeader));
+    if (memcmp(h->magic, KIMAGE_MAGIC, sizeof(h->magic)) != 0)
+        return "not a klisp image";
+    if (h->fingerprint != fingerprint())
+        return "the image was written by a different klisp executable";
+    if (size != HEAP_START + (size_t) h->heapsize +
+        (size_t) h->nrelocs * sizeof(Reloc) +
+        (size_t) h->nobjs * sizeof(uint32_t) || h->heapsize < ROOTS_SIZE)
+        return "the image is truncated";
+    return NULL;
+}
+
+/* LOCK: called while creating the state, no collection can run */
+const char *klispI_load(klisp_State *K, const char *name)
+{
+    global_State *g = G(K);
+    size_t size;
+    char *image = ksystem_map_file(K, name, &size);
+    if (image == NULL)
+        return "cannot read the image file";
+
+    ImageHeader h;
+    const char *msg = checkheader(image, size, &h);
+    char *heap = image + HEAP_START;
+    Reloc *relocs = (Reloc *) (heap + h.heapsize);
+    uint32_t *objs = (uint32_t *) (relocs + h.nrelocs);
+    for (uint32_t i = 0; msg == NULL && i < h.nrelocs; i++) {
+        if (!relocate(K, heap, h.heapsize, &relocs[i]))
+            msg = "the image is corrupted";
+    }
+    for (uint32_t i = 0; msg == NULL && i < h.nobjs; i++) {
+        if (objs[i] < ROOTS_SIZE || objs[i] + sizeof(GCheader) > h.heapsize)
+            msg = "the image is corrupted";
+    }
+    if (msg != NULL) {
+        ksystem_unmap_file(K, image, size);
+        return msg;
+    }
+
+    /* from here on, the objects are in use, nothing can fail */
+    g->image = image;
+    g->image_size = size;
+    /* freeing the objects subtracts their size (see kmem.c) */
+    g->totalbytes += h.heapbytes;
+
+    for (uint32_t i = 0; i < h.nobjs; i++) {
+        GCObject *o = (GCObject *) (heap + objs[i]);
+        o->gch.gct = (o->gch.gct & ~(WHITEBITS | bitmask(BLACKBIT))) |
+            klispC_white(g);
+        uint32_t hash = objhash(K, o);
+        if (internedp(o)) {
+            klispS_add(K, o, hash);
+        } else {
+            o->gch.next = g->rootgc;
+            g->rootgc = o;
+        }
+    }
+
+    TValue *roots = (TValue *) heap;
+    for (uint32_t i = 0; i < NROOTS; i++)
+        groot(g, i) = roots[i];
+    K->next_env = roots[NROOTS];
+
+    /* the tables hash by address & with the seed, rebuild them now that
+       all the hashes are right */
+    for (uint32_t i = 0; i < h.nobjs; i++) {
+        GCObject *o = (GCObject *) (heap + objs[i]);
+        if (o->gch.tt == K_TTABLE)
+            klispH_resizearray(K, (Table *) o, o->table.sizearray);
+    }
+    return NULL;
+}
@@ -0,0 +1,59 @@
+/*
+** kimage.h
+** Heap images
+** See Copyright Notice in klisp.h
+*/
+
+#ifndef kimage_h
+#define kimage_h
+
+#include <stdio.h>
+
+#include "kobject.h"
+#include "kstate.h"
+
+/*
+** A heap image is a copy of all the objects reachable from the roots
+** of the global state (ground environment, libraries registry, require
+** table, etc) and the standard environment in K->next_env, as they
+** were after running the -e, -l & -r options of the interpreter (see
+** klisp.c). Loading the image replaces building the ground environment
+** in klisp_newstate.
+**
+** The file is mapped in memory (see ksystem_map_file) and the objects
+** are used in place, pointers in the image are fixed with a list of
+** relocations:
+** - pointers to other objects in the image are offsets from the start
+**   of the heap,
+** - pointers to klisp functions and static data (operative and
+**   continuation fns, function pointers in xparams, the empty node of
+**   tables) are offsets from a function in this file, so that they can
+**   be loaded in a program mapped at a different address,
+** - pointers to C library functions stored in xparams (like tolower or
+**   sin) are indexes in a registration table (see kimage.c),
+** - the main thread and the standard file ports are replaced by the
+**   ones of the new state.
+** An image can only be loaded by the same klisp executable that wrote
+** it, this is checked with a fingerprint of the code layout. The hashes
+** of strings and symbols depend on the per state seed, so they are
+** recomputed on load, and all tables are rehashed.
+**
+** Objects in the image aren't allocated with frealloc, klispM_realloc_
+** never frees them and copies them to a new block when they are
+** resized. The image is unmapped when the state is closed.
+*/
+
+/* LOCK: the GIL should be acquired */
+/* writes the image to file, returns NULL or an error message (there are
+   objects that can't be in an image, like threads other than the main
+   one, mutexes or open file ports other than the standard ones) */
+const char *klispI_dump(klisp_State *K, FILE *file);
+/* loads the image in the file name into a new state (see
+   klisp_newstate_image), returns NULL or an error message */
+const char *klispI_load(klisp_State *K, const char *name);
+
+#define klispI_inimage(g_, p_)                              \
+    ((char *) (p_) >= (g_)->image &&                        \
+     (char *) (p_) < (g_)->image + (g_)->image_size)
+
+#endif
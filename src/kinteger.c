@@ -317,3 +317,67 @@ TValue kinteger_new_uint64(klisp_State *K, uint64_t x)
         return res;
     }
 }
+
+TValue kinteger_new_int64(klisp_State *K, int64_t x)
+{
+    if (kfit_int32_t(x)) {
+        return i2tv((int32_t) x);
+    } else if (x > 0) {
+        return kinteger_new_uint64(K, (uint64_t) x);
+    } else {
+        /* the unsigned negation also works for INT64_MIN, and the
+           result is always a new bigint, so it's safe to modify it */
+        TValue res = kinteger_new_uint64(K, -((uint64_t) x));
+        UNUSED(mp_int_neg(K, tv2bigint(res), tv2bigint(res)));
+        return res;
+    }
+}
+
+/* the absolute value of a bigint of at most two digits */
+static inline uint64_t kbigint_abs_uint64(Bigint *b)
+{
+    klisp_assert(MP_USED(b) <= 2);
+    uint64_t res = MP_DIGITS(b)[0];
+    if (MP_USED(b) == 2)
+        res |= ((uint64_t) MP_DIGITS(b)[1]) << 32;
+    return res;
+}
+
+bool kinteger_to_uint64(TValue n, uint64_t *x)
+{
+    if (ttisfixint(n)) {
+        if (ivalue(n) < 0)
+            return false;
+        *x = (uint64_t) ivalue(n);
+        return true;
+    }
+    klisp_assert(ttisbigint(n));
+    Bigint *b = tv2bigint(n);
+    if (MP_SIGN(b) == MP_NEG || MP_USED(b) > 2)
+        return false;
+    *x = kbigint_abs_uint64(b);
+    return true;
+}
+
+bool kinteger_to_int64(TValue n, int64_t *x)
+{
+    if (ttisfixint(n)) {
+        *x = ivalue(n);
+        return true;
+    }
+    klisp_assert(ttisbigint(n));
+    Bigint *b = tv2bigint(n);
+    if (MP_USED(b) > 2)
+        return false;
+    uint64_t abs = kbigint_abs_uint64(b);
+    if (MP_SIGN(b) == MP_NEG) {
+        if (abs > ((uint64_t) INT64_MAX) + 1)
+            return false;
+        *x = (abs == ((uint64_t) INT64_MAX) + 1)? INT64_MIN : -(int64_t) abs;
+    } else {
+        if (abs > (uint64_t) INT64_MAX)
+            return false;
+        *x = (int64_t) abs;
+    }
+    return true;
+}
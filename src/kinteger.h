@@ -133,7 +133,13 @@ TValue kbigint_abs(klisp_State *K, TValue tv_bigint);
 TValue kbigint_gcd(klisp_State *K, TValue n1, TValue n2);
 TValue kbigint_lcm(klisp_State *K, TValue n1, TValue n2);
 
-/* conversion from uint64_t */
+/* conversion from uint64_t & int64_t */
 TValue kinteger_new_uint64(klisp_State *K, uint64_t x);
+TValue kinteger_new_int64(klisp_State *K, int64_t x);
+
+/* conversion to uint64_t & int64_t, n should be an exact integer,
+   these return false if n doesn't fit in the result type */
+bool kinteger_to_uint64(TValue n, uint64_t *x);
+bool kinteger_to_int64(TValue n, int64_t *x);
 
 #endif
@@ -14,14 +14,9 @@
 /* for immutable table */
 #include "kstring.h" 
 
-static uint32_t get_keyword_hash(const char *buf, uint32_t size)
+uint32_t kkeyword_hash(klisp_State *K, const char *buf, uint32_t size)
 {
-    uint32_t h = size; /* seed */
-    size_t step = (size>>5)+1; /* if string is too long, don't hash all 
-                                  its chars */
-    size_t size1;
-    for (size1 = size; size1 >= step; size1 -= step)  /* compute hash */
-        h = h ^ ((h<<5)+(h>>2)+ ((unsigned char) buf[size1-1]));
+    uint32_t h = klispS_hash(buf, size, G(K)->seed);
 
     h ^= (uint32_t) 0x55555555; 
     /* keyword hash should be different from string & symbol hash
@@ -35,21 +30,25 @@ static uint32_t get_keyword_hash(const char *buf, uint32_t size)
 static Keyword *search_in_keyword_table(klisp_State *K, const char *buf, 
 					uint32_t size, uint32_t h)
 {
-    for (GCObject *o = G(K)->strt.hash[lmod(h, G(K)->strt.size)]; o != NULL; 
-         o = o->gch.next) {
-        klisp_assert(o->gch.tt == K_TKEYWORD || o->gch.tt == K_TSYMBOL || 
-                     o->gch.tt == K_TSTRING || o->gch.tt == K_TBYTEVECTOR);
-		        
-        if (o->gch.tt != K_TKEYWORD) continue;
-
-        String *ts = tv2str(((Keyword *) o)->str);
-        if (ts->size == size && (memcmp(buf, ts->b, size) == 0)) {
-            /* keyword and/or string may be dead */
-            if (isdead(G(K), o)) changewhite(o);
-            if (isdead(G(K), (GCObject *) ts)) changewhite((GCObject *) ts);
-            return (Keyword *) o;
-        }
-    } 
+    GCObject *chains[2];
+    klispS_chains(K, h, chains);
+    for (int32_t i = 0; i < 2; i++) {
+        for (GCObject *o = chains[i]; o != NULL; o = o->gch.next) {
+            klisp_assert(o->gch.tt == K_TKEYWORD || o->gch.tt == K_TSYMBOL || 
+                         o->gch.tt == K_TSTRING || o->gch.tt == K_TBYTEVECTOR);
+
+            if (o->gch.tt != K_TKEYWORD || ((Keyword *) o)->hash != h) continue;
+
+            String *ts = tv2str(((Keyword *) o)->str);
+            if (ts->size == size && (memcmp(buf, ts->b, size) == 0)) {
+                /* keyword and/or string may be dead */
+                if (isdead(G(K), o)) changewhite(o);
+                if (isdead(G(K), (GCObject *) ts)) 
+                    changewhite((GCObject *) ts);
+                return (Keyword *) o;
+            }
+        } 
+    }
     /* If it exits the loop, it means it wasn't found */
     return NULL;
 }
@@ -58,7 +57,7 @@ static Keyword *search_in_keyword_table(klisp_State *K, const char *buf,
 TValue kkeyword_new_bs(klisp_State *K, const char *buf, uint32_t size)
 {
     /* First calculate the hash */
-    uint32_t h = get_keyword_hash(buf, size);
+    uint32_t h = kkeyword_hash(K, buf, size);
 
     /* look for it in the table */
     Keyword *new_keyw = search_in_keyword_table(K, buf, size, h);
@@ -87,17 +86,9 @@ TValue kkeyword_new_bs(klisp_State *K, const char *buf, uint32_t size)
     new_keyw->hash = h;
 
     /* add to the string/keyword table (and link it) */
-    stringtable *tb;
-    tb = &G(K)->strt;
-    h = lmod(h, tb->size);
-    new_keyw->next = tb->hash[h];  /* chain new entry */
-    tb->hash[h] = (GCObject *)(new_keyw);
-    tb->nuse++;
-    if (tb->nuse > ((uint32_t) tb->size) && tb->size <= INT32_MAX / 2) {
-        krooted_tvs_push(K, ret_tv); /* save in case of gc */
-        klispS_resize(K, tb->size*2);  /* too crowded */
-        krooted_tvs_pop(K);
-    }
+    krooted_tvs_push(K, ret_tv); /* save in case of gc */
+    klispS_add(K, (GCObject *) new_keyw, h);
+    krooted_tvs_pop(K);
     return ret_tv;
 }
 
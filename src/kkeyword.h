@@ -21,6 +21,8 @@ TValue kkeyword_new_bs(klisp_State *K, const char *buf, uint32_t size);
 TValue kkeyword_new_b(klisp_State *K, const char *buf);
 /* copies str if not immutable */
 TValue kkeyword_new_str(klisp_State *K, TValue str);
+/* the hash of the keyword with name buf (depends on G(K)->seed) */
+uint32_t kkeyword_hash(klisp_State *K, const char *buf, uint32_t size);
 
 #define kkeyword_str(tv_) (tv2keyw(tv_)->str)
 #define kkeyword_buf(tv_) (kstring_buf(tv2keyw(tv_)->str))
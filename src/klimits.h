@@ -48,11 +48,44 @@
 */
 #define IntPoint(p)  ((uint32_t)(p))
 
+/* type for heap sizes, big enough to count all the memory that can
+   be allocated (lu_mem in lua) */
+typedef size_t kmem_t;
+
+#define MAX_KMEM	(~(kmem_t)0 - 2)
+
+/* when the memory limit is reached (see gc-set-limit!), this much
+   more memory may be allocated before aborting, so that the error 
+   can be signaled and handled */
+#ifndef KGC_LIMIT_RESERVE
+#define KGC_LIMIT_RESERVE	(1024 * 1024)
+#endif
+
 /* minimum size for the string table (must be power of 2) */
 #ifndef MINSTRTABSIZE
 #define MINSTRTABSIZE	32
 #endif
 
+/* starting size for the string table (must be power of 2), big
+   enough for the symbols & strings interned while building the 
+   ground environment, so that the table isn't resized at startup */
+#ifndef STARTSTRTABSIZE
+#define STARTSTRTABSIZE	2048
+#endif
+
+/* number of buckets moved on each addition to the string table while 
+   it's being resized, should be at least 2 for the resize to finish
+   before the table needs to grow again */
+#ifndef STRTREHASHSTEP
+#define STRTREHASHSTEP	4
+#endif
+
+/* minimum capacity of a vector after it grows (see kvector_push) is
+   twice this */
+#ifndef KVECTOR_MINGROWTH
+#define KVECTOR_MINGROWTH	4
+#endif
+
 /* minimum size for the name & cont_name tables (must be power of 2) */
 #ifndef MINNAMETABSIZE
 #define MINNAMETABSIZE	32
@@ -66,14 +99,50 @@
 #define MINTHREADTABSIZE	32
 #endif
 
+/* minimum size for the profiler sample table (must be power of 2) */
+#ifndef MINPROFTABSIZE
+#define MINPROFTABSIZE	64
+#endif
+
+/* the profiler records at most this many frames per sample (the 
+   outermost ones are dropped) and stack strings of at most this
+   many chars */
+#ifndef KPROFILE_MAXDEPTH
+#define KPROFILE_MAXDEPTH	64
+#endif
+
+#ifndef KPROFILE_MAXSTACK
+#define KPROFILE_MAXSTACK	4096
+#endif
+
+/* default sampling interval for the profiler (in microseconds) */
+#ifndef KPROFILE_INTERVAL
+#define KPROFILE_INTERVAL	1000
+#endif
+
+/* default mean bytes between samples for the heap profiler */
+#ifndef KPROFILE_HEAP_RATE
+#define KPROFILE_HEAP_RATE	(64*1024)
+#endif
+
+/* initial size of the heap profiler sample array */
+#ifndef KPROFILE_MINHEAPSAMPLES
+#define KPROFILE_MINHEAPSAMPLES	64
+#endif
+
 /* minimum size for the require table (must be power of 2) */
 #ifndef MINREQUIRETABSIZE
 #define MINREQUIRETABSIZE	32
 #endif
 
 /* starting size for ground environment hashtable */
-/* at last count, there were about 200 bindings in ground env */
-#define ENVTABSIZE	512
+/* at last count, there were about 500 bindings in ground env */
+#define GROUNDENVTABSIZE	1024
+
+/* starting size for the other table environments (standard 
+   environments, libraries, etc), these are usually small and the
+   table grows as needed */
+#define ENVTABSIZE	32
 
 /* starting size for string port buffers */
 #ifndef MINSTRINGPORTBUFFER
@@ -40,6 +40,8 @@
 #include "kerror.h"
 #include "krepl.h"
 #include "ksystem.h"
+#include "kprofile.h"
+#include "kimage.h"
 #include "kghelpers.h" /* for do_pass_value and do_seq, mark_root & mark_error */
 
 static const char *progname = KLISP_PROGNAME;
@@ -65,6 +67,15 @@ static void print_usage (void)
             "  -i          enter interactive mode after executing " 
             KLISP_QL("script") "\n"
             "  -v          show version information\n"
+            "  --profile=name  write a sampling profile to file "
+            KLISP_QL("name") "\n"
+            "  --heap-profile=name  write a heap profile to file "
+            KLISP_QL("name") "\n"
+            "  --image=name  start from the heap image in file "
+            KLISP_QL("name") "\n"
+            "  --dump-image=name  write a heap image to file "
+            KLISP_QL("name") " after\n"
+            "              executing the -e, -l & -r options\n"
             "  --          stop handling options\n"
             "  -           execute stdin and stop handling options\n"
             ,
@@ -487,7 +498,9 @@ static int handle_script(klisp_State *K, char **argv, int n)
 /* check that argument has no extra characters at the end */
 #define notail(x)	{if ((x)[2] != '\0') return -1;}
 
-static int collectargs (char **argv, bool *pi, bool *pv, bool *pe, bool *pl)
+static int collectargs (char **argv, bool *pi, bool *pv, bool *pe, bool *pl,
+                        const char **pprof, const char **pheap,
+                        const char **pdump)
 {
     int i;
     for (i = 1; argv[i] != NULL; i++) {
@@ -495,6 +508,30 @@ static int collectargs (char **argv, bool *pi, bool *pv, bool *pe, bool *pl)
             return i;
         switch (argv[i][1]) {  /* option */
         case '-':
+            if (strncmp(argv[i], "--profile=", 10) == 0) {
+                *pprof = argv[i] + 10;
+                if (**pprof == '\0')
+                    return -1;
+                break;
+            }
+            if (strncmp(argv[i], "--heap-profile=", 15) == 0) {
+                *pheap = argv[i] + 15;
+                if (**pheap == '\0')
+                    return -1;
+                break;
+            }
+            if (strncmp(argv[i], "--dump-image=", 13) == 0) {
+                *pdump = argv[i] + 13;
+                if (**pdump == '\0')
+                    return -1;
+                break;
+            }
+            if (strncmp(argv[i], "--image=", 8) == 0) {
+                /* the image was loaded in main (see find_image) */
+                if (argv[i][8] == '\0')
+                    return -1;
+                break;
+            }
             notail(argv[i]);
             return (argv[i+1] != NULL ? i+1 : 0);
         case '\0':
@@ -616,6 +653,43 @@ static void populate_argument_lists(klisp_State *K, char **argv, int argc,
     krooted_vars_pop(K);
 }
 
+/* reads a GC parameter from an environment variable, if defined 
+   (otherwise *val is left unchanged) */
+static bool get_gcparam(const char *var, unsigned long long max,
+                        unsigned long long *val)
+{
+    const char *str = getenv(var);
+    if (str == NULL)
+        return true;
+
+    char *end;
+    unsigned long long res = strtoull(str, &end, 10);
+    if (*str < '0' || *str > '9' || *end != '\0' || res > max) {
+        k_message(progname, "invalid value in GC environment variable");
+        return false;
+    }
+    *val = res;
+    return true;
+}
+
+static int handle_gcenv(klisp_State *K) 
+{
+    global_State *g = G(K);
+    unsigned long long pause = g->gcpause, stepmul = g->gcstepmul,
+        limit = g->gclimit;
+    if (!get_gcparam(KLISP_GCPAUSE, INT32_MAX, &pause) ||
+        !get_gcparam(KLISP_GCSTEPMUL, INT32_MAX, &stepmul) ||
+        !get_gcparam(KLISP_GCLIMIT, MAX_KMEM, &limit))
+        return STATUS_ERROR;
+
+    klisp_lock(K);
+    g->gcpause = (int32_t) pause;
+    g->gcstepmul = (int32_t) stepmul;
+    g->gclimit = (kmem_t) limit;
+    klisp_unlock(K);
+    return STATUS_CONTINUE;
+}
+
 static int handle_klispinit(klisp_State *K) 
 {
     const char *init = getenv(KLISP_INIT);
@@ -633,8 +707,33 @@ struct Smain {
     int argc;
     char **argv;
     int status; /* STATUS_ROOT, STATUS_ERROR, STATUS_CONTINUE */
+    const char *prof_file; /* NULL if not profiling */
+    const char *heap_file; /* NULL if not profiling the heap */
+    const char *dump_file; /* NULL if not writing a heap image */
 };
 
+/* the heap image is written after running the arguments, with the
+   standard environment in K->next_env */
+static int dump_image(klisp_State *K, const char *name)
+{
+    FILE *file = fopen(name, "wb");
+    if (file == NULL) {
+        k_message(progname, "cannot open image output file");
+        return STATUS_ERROR;
+    }
+    klisp_lock(K);
+    const char *msg = klispI_dump(K, file);
+    klisp_unlock(K);
+    if (fclose(file) != 0 && msg == NULL)
+        msg = "error writing the image file";
+    if (msg != NULL) {
+        k_message(progname, msg);
+        remove(name);
+        return STATUS_ERROR;
+    }
+    return STATUS_CONTINUE;
+}
+
 static void pmain(klisp_State *K) 
 {
     /* This is weird but was done to follow lua scheme */
@@ -660,20 +759,46 @@ static void pmain(klisp_State *K)
        Also by writing all in c it's easy to be consistent, especially with
        error messages */
 
+    /* initial GC parameters (KLISP_GCPAUSE, KLISP_GCSTEPMUL & 
+       KLISP_GCLIMIT) */
+    s->status = handle_gcenv(K);
+    if (s->status != STATUS_CONTINUE)
+        return;
+
     /* init (eval KLISP_INIT env variable contents) */
     s->status = handle_klispinit(K);
     if (s->status != STATUS_CONTINUE)
         return;
 
     bool has_i = false, has_v = false, has_e = false, has_l = false;
-    int script = collectargs(argv, &has_i, &has_v, &has_e, &has_l);
+    int script = collectargs(argv, &has_i, &has_v, &has_e, &has_l,
+                             &s->prof_file, &s->heap_file, &s->dump_file);
 
-    if (script < 0) { /* invalid args? */
+    /* the image is written instead of running a script or the repl */
+    if (script < 0 || (s->dump_file != NULL && (script > 0 || has_i))) {
         print_usage();
         s->status = STATUS_ERROR;
         return;
     }
 
+    if (s->prof_file != NULL) {
+        klisp_lock(K);
+        bool started = klispP_start(K, KPROFILE_INTERVAL);
+        klisp_unlock(K);
+        if (!started) {
+            k_message(progname, "profiling is not supported in this platform");
+            s->prof_file = NULL;
+            s->status = STATUS_ERROR;
+            return;
+        }
+    }
+
+    if (s->heap_file != NULL) {
+        klisp_lock(K);
+        klispP_heap_set_rate(K, KPROFILE_HEAP_RATE);
+        klisp_unlock(K);
+    }
+
     if (has_v)
         print_version();
 
@@ -688,6 +813,11 @@ static void pmain(klisp_State *K)
     if (s->status != STATUS_CONTINUE)
         return;
 
+    if (s->dump_file != NULL) {
+        s->status = dump_image(K, s->dump_file);
+        return;
+    }
+
     if (script > 0) {
         s->status = handle_script(K, argv, script);
     }
@@ -707,13 +837,36 @@ static void pmain(klisp_State *K)
     }
 }
 
+/* the heap image replaces the initialization of the state, so it is
+   looked for before handling the other options (see collectargs) */
+static const char *find_image(char **argv)
+{
+    const char *image = NULL;
+    for (int i = 1; argv[i] != NULL && argv[i][0] == '-'; i++) {
+        char opt = argv[i][1];
+        if (strncmp(argv[i], "--image=", 8) == 0) {
+            image = argv[i] + 8;
+        } else if (opt == '\0' || strcmp(argv[i], "--") == 0) {
+            break;
+        } else if ((opt == 'e' || opt == 'l' || opt == 'r') && 
+                   argv[i][2] == '\0' && argv[i+1] != NULL) {
+            i++; /* skip the argument of the option */
+        }
+    }
+    /* an empty name is reported by collectargs */
+    return (image != NULL && *image != '\0')? image : NULL;
+}
+
 int main(int argc, char *argv[]) 
 {
     struct Smain s;
-    klisp_State *K = klispL_newstate();
+    const char *image = find_image(argv);
+    const char *msg = "cannot create state: not enough memory";
+    klisp_State *K = (image != NULL)? klispL_newstate_image(image, &msg) :
+        klispL_newstate();
 
     if (K == NULL) {
-        k_message(argv[0], "cannot create state: not enough memory");
+        k_message(argv[0], msg);
         return EXIT_FAILURE;
     }
 
@@ -724,10 +877,38 @@ int main(int argc, char *argv[])
     /* This is weird but was done to follow lua scheme */
     s.argc = argc;
     s.argv = argv;
+    s.prof_file = NULL;
+    s.heap_file = NULL;
+    s.dump_file = NULL;
     K->next_value = p2tv(&s);
 
     pmain(K);
 
+    if (s.prof_file != NULL) {
+        klisp_lock(K);
+        TValue samples = klispP_stop(K);
+        FILE *file = fopen(s.prof_file, "w");
+        if (file == NULL) {
+            k_message(progname, "cannot open profile output file");
+        } else {
+            klispP_write_folded(K, samples, file);
+            fclose(file);
+        }
+        klisp_unlock(K);
+    }
+
+    if (s.heap_file != NULL) {
+        klisp_lock(K);
+        FILE *file = fopen(s.heap_file, "w");
+        if (file == NULL) {
+            k_message(progname, "cannot open heap profile output file");
+        } else {
+            klispP_write_heap(K, file);
+            fclose(file);
+        }
+        klisp_unlock(K);
+    }
+
     /* convert s.status to either EXIT_SUCCESS or EXIT_FAILURE */
     if (s.status == STATUS_CONTINUE || s.status == STATUS_ROOT) {
         /* must check value passed to the root continuation to
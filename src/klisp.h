@@ -37,6 +37,10 @@ typedef void (*klisp_CFunction) (struct klisp_State *K);
 ** state manipulation
 */
 klisp_State *klisp_newstate(klisp_Alloc f, void *ud);
+/* loads the heap image in file name (see kimage.h), on error returns
+   NULL and leaves a message in *msg */
+klisp_State *klisp_newstate_image(klisp_Alloc f, void *ud, const char *name,
+                                  const char **msg);
 void klisp_close(klisp_State *K);
 klisp_State *klisp_newthread(klisp_State *K);
 
@@ -78,11 +78,17 @@
   @* Klisp check to set its paths.
   @@ KLISP_INIT is the name of the environment variable that Klisp
   @* checks for initialization code.
+  @@ KLISP_GCPAUSE, KLISP_GCSTEPMUL and KLISP_GCLIMIT are the names of 
+  @* the environment variables that Klisp checks for the initial GC 
+  @* parameters.
   ** CHANGE them if you want different names.
   */
 #define KLISP_PATH           "KLISP_PATH"
 #define KLISP_CPATH          "KLISP_CPATH"
 #define KLISP_INIT	"KLISP_INIT"
+#define KLISP_GCPAUSE	"KLISP_GCPAUSE"
+#define KLISP_GCSTEPMUL	"KLISP_GCSTEPMUL"
+#define KLISP_GCLIMIT	"KLISP_GCLIMIT"
 
 
 /*
@@ -190,6 +196,11 @@
   #define KTRACK_MARKS true
 */
 
+/* Count calls, time & allocation per combiner and continuation type
+   (see kprofile.h & get-profile-stats). This slows down every call, so
+   it's off by default, build with -DKPROFILE to turn it on */
+/* #define KPROFILE 1 */
+
 /* TODO use this defines everywhere */
 #define KTRACK_NAMES true
 #define KTRACK_SI true
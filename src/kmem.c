@@ -16,6 +16,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
 
 #include "klisp.h"
 #include "kstate.h"
@@ -23,6 +24,8 @@
 #include "kmem.h"
 #include "kerror.h"
 #include "kgc.h"
+#include "kprofile.h"
+#include "kimage.h"
 
 #define MINSIZEARRAY	4
 
@@ -71,30 +74,91 @@ void *klispM_toobig (klisp_State *K) {
 }
 
 
+/*
+** hard memory limit (see gc-set-limit!)
+** The first time the limit is reached (and a collection doesn't help)
+** an error is signaled, after that up to KGC_LIMIT_RESERVE more bytes
+** can be allocated to handle it, until a collection brings the heap
+** under the limit again (see klispC_fullgc). 
+*/
+static void check_limit (klisp_State *K, size_t delta) {
+    global_State *g = G(K);
+    kmem_t reserve = g->gclimit_hit? KGC_LIMIT_RESERVE : 0;
+    if (g->totalbytes + delta <= g->gclimit + reserve)
+        return;
+
+    klispC_fullgc(K); /* try to make room first */
+    if (g->totalbytes + delta <= g->gclimit) {
+        g->gclimit_hit = false;
+    } else if (!g->gclimit_hit) {
+        g->gclimit_hit = true;
+        klispE_throw_simple(K, "memory limit exceeded");
+    } else if (g->totalbytes + delta > g->gclimit + KGC_LIMIT_RESERVE) {
+        /* the reserve wasn't enough to handle the error */
+        klisp_unlock_all(K);
+        fprintf(stderr, MEMERRMSG);
+        abort();
+    }
+}
+
+/*
+** The blocks of a heap image (see kimage.h) weren't allocated with
+** frealloc: they are never freed, and they are copied to a new block
+** when resized.
+*/
+static void *reallocblock (klisp_State *K, void *block, size_t osize, 
+                           size_t nsize) {
+    global_State *g = G(K);
+    if (block == NULL || !klispI_inimage(g, block))
+        return (*g->frealloc)(g->ud, block, osize, nsize);
+    if (nsize == 0)
+        return NULL;
+    void *newblock = (*g->frealloc)(g->ud, NULL, 0, nsize);
+    if (newblock != NULL)
+        memcpy(newblock, block, osize < nsize? osize : nsize);
+    return newblock;
+}
+
 /*
 ** generic allocation routine.
 */
 void *klispM_realloc_ (klisp_State *K, void *block, size_t osize, size_t nsize) {
     klisp_assert((osize == 0) == (block == NULL));
 
-    /* TEMP: for now only Stop the world GC */
-    /* TEMP: prevent recursive call of klispC_fullgc() */
+    /* the mark phase is done all at once, the sweep is done a little
+       at a time on each allocation until the cycle is over */
+    /* TEMP: prevent recursive call of the collector */
 #ifdef KUSE_GC
-    if (nsize > 0 && G(K)->totalbytes - osize + nsize >= G(K)->GCthreshold) {
+    if (nsize > 0 && !G(K)->gcrunning) {
+        if (klispC_sweeping(G(K))) {
+            klispC_sweepstep(K);
+        } else if (G(K)->totalbytes - osize + nsize >= G(K)->GCthreshold) {
 #ifdef KDEBUG_GC
-        printf("GC START, total_bytes: %d\n", G(K)->totalbytes);
+            printf("GC START, total_bytes: %lu\n", 
+                   (unsigned long) G(K)->totalbytes);
 #endif
-        klispC_fullgc(K);
+            klispC_lazygc(K);
 #ifdef KDEBUG_GC
-        printf("GC END, total_bytes: %d\n", G(K)->totalbytes);
+            printf("GC END, total_bytes: %lu\n", 
+                   (unsigned long) G(K)->totalbytes);
 #endif
+        }
     }
 #endif
+    /* don't check while collecting */
+    if (nsize > osize && G(K)->gclimit != 0 && !G(K)->gcrunning)
+        check_limit(K, nsize - osize);
 
-    block = (*G(K)->frealloc)(G(K)->ud, block, osize, nsize);
+    void *newblock = reallocblock(K, block, osize, nsize);
+
+    if (newblock == NULL && nsize > 0 && !G(K)->gcrunning) {
+        /* try to free some memory and retry */
+        klispC_fullgc(K);
+        newblock = reallocblock(K, block, osize, nsize);
+    }
+    block = newblock;
 
     if (block == NULL && nsize > 0) {
-        /* TEMP: try GC if there is no more mem */
         /* TODO: make this a catchable error */
         klisp_unlock_all(K);
         fprintf(stderr, MEMERRMSG);
@@ -102,5 +166,12 @@ void *klispM_realloc_ (klisp_State *K, void *block, size_t osize, size_t nsize)
     }
     klisp_assert((nsize == 0) == (block == NULL));
     G(K)->totalbytes = (G(K)->totalbytes - osize) + nsize;
+    if (nsize > osize) {
+        global_State *g = G(K);
+        g->gc_allocated += nsize - osize;
+        if (g->hprof_rate != 0 && 
+            (g->hprof_left -= (int64_t) (nsize - osize)) <= 0)
+            klispP_heap_due(g); /* sample the next object linked */
+    }
     return block;
 }
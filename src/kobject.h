@@ -518,12 +518,13 @@ typedef struct Node {
 typedef struct __attribute__ ((__packed__)) {
     CommonHeader;
     uint8_t lsizenode;  /* log2 of size of `node' array */
-    uint8_t t1padding; 
+    uint8_t kind; /* key equivalence: K_TABLE_EQ, K_TABLE_EQUAL... */
     uint16_t t2padding; /* to avoid disturbing the alignment */
     TValue *array;  /* array part */
     Node *node;
     Node *lastfree;  /* any free position is before this position */
     int32_t sizearray;  /* size of `array' array */
+    int32_t nremoved; /* removals since the last resize */
 } Table;
 
 /* The weak flags are in kflags */
@@ -547,11 +548,17 @@ typedef struct __attribute__ ((__packed__)) {
 } Bytevector;
 
 /* Vectors (heterogenous arrays) */
+/* Mutable vectors can grow (see kvector_push), the elements are kept 
+   in inlinearray until they don't fit there, after that in a separately 
+   allocated array */
 typedef struct __attribute__ ((__packed__)) {
     CommonHeader;
     TValue mark; /* for cycle/sharing aware algorithms */
-    uint32_t sizearray; /* number of elements in array[] */
-    TValue array[]; /* array of elements */
+    uint32_t sizearray; /* number of elements in array */
+    uint32_t capacity; /* number of elements that fit in array */
+    uint32_t sizeinline; /* number of elements that fit in inlinearray */
+    TValue *array; /* array of elements (may point to inlinearray) */
+    TValue inlinearray[];
 } Vector;
 
 /* Unlike symbols, keywords can be marked because they don't record
@@ -906,11 +913,15 @@ int32_t kmark_count;
 #define K_FLAG_WEAK_KEYS 0x01
 #define K_FLAG_WEAK_VALUES 0x02
 #define K_FLAG_WEAK_NOTHING 0x00
+/* with K_FLAG_WEAK_KEYS, values are only kept while their keys are */
+#define K_FLAG_EPHEMERON 0x04
 
 #define ktable_has_weak_keys(o_)                    \
     ((tv_get_kflags(o_) & K_FLAG_WEAK_KEYS) != 0)
 #define ktable_has_weak_values(o_)                  \
     ((tv_get_kflags(o_) & K_FLAG_WEAK_VALUES) != 0)
+#define ktable_is_ephemeron(o_)                     \
+    ((tv_get_kflags(o_) & K_FLAG_EPHEMERON) != 0)
 
 /* Macro to test the most basic equality on TValues */
 #define tv_equal(tv1_, tv2_) ((tv1_).raw == (tv2_).raw)
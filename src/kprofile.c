@@ -0,0 +1,587 @@
+/*
+** kprofile.c
+** Sampling profiler
+** See Copyright Notice in klisp.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "kprofile.h"
+#include "kobject.h"
+#include "kstate.h"
+#include "kpair.h"
+#include "kstring.h"
+#include "ksymbol.h"
+#include "kvector.h"
+#include "ktable.h"
+#include "kenvironment.h"
+#include "ksystem.h"
+#include "kinteger.h"
+#include "kgc.h"
+#include "kmem.h"
+
+volatile sig_atomic_t klispP_sample_pending = 0;
+
+/* LOCK: All these functions should be called with the GIL already acquired */
+bool klispP_start(klisp_State *K, int32_t usecs)
+{
+    ksystem_stop_prof_timer(K);
+    klispP_sample_pending = 0;
+    G(K)->prof_samples = klispH_new(K, 0, MINPROFTABSIZE,
+                                    K_FLAG_WEAK_NOTHING);
+    if (!ksystem_start_prof_timer(K, usecs)) {
+        G(K)->prof_samples = KINERT;
+        return false;
+    }
+    return true;
+}
+
+TValue klispP_stop(klisp_State *K)
+{
+    TValue samples = G(K)->prof_samples;
+    ksystem_stop_prof_timer(K);
+    klispP_sample_pending = 0;
+    G(K)->prof_samples = KINERT;
+    return samples;
+}
+
+/*
+** Stack strings
+** These are built in a C buffer, without allocating any klisp object
+*/
+typedef struct {
+    char *p;
+    char *end;
+} SBuf;
+
+/* ';' separates frames & the last ' ' separates the count, so
+   replace the former and any line breaks */
+static void sbuf_puts(SBuf *sb, const char *s)
+{
+    while (*s != '\0' && sb->p < sb->end) {
+        char ch = *s++;
+        *sb->p++ = (ch == ';' || ch == '\n' || ch == '\r')? '_' : ch;
+    }
+}
+
+static void sbuf_putsi(SBuf *sb, klisp_State *K, TValue si)
+{
+    const char *filename;
+    int32_t line;
+
+    if (ttisfixint(si)) {
+        int32_t packed = ivalue(si);
+        int32_t file_id = packed >> (KSI_LINE_BITS + KSI_COL_BITS);
+        filename = kstring_buf(kvector_buf(G(K)->si_files)[file_id]);
+        line = (packed >> KSI_COL_BITS) & KSI_MAX_LINE;
+    } else if (ttispair(si) && ttisstring(kcar(si)) && ttispair(kcdr(si))) {
+        filename = kstring_buf(kcar(si));
+        line = ivalue(kcadr(si));
+    } else {
+        return;
+    }
+
+    char num[16];
+    sprintf(num, ":%d", line);
+    sbuf_puts(sb, " @ ");
+    sbuf_puts(sb, filename);
+    sbuf_puts(sb, num);
+}
+
+static void sbuf_putframe(SBuf *sb, klisp_State *K, TValue obj, TValue si)
+{
+    if (ttiscontinuation(obj)) {
+        Continuation *cont = tv2cont(obj);
+        /* name the continuation by the combiner that created it, if
+           any, and by its type */
+        if (khas_name(cont->comb)) {
+            sbuf_puts(sb, ksymbol_buf(kget_name(K, cont->comb)));
+            sbuf_puts(sb, " ");
+        }
+        const TValue *node = klispH_get(K, tv2table(G(K)->cont_name_table),
+                                        p2tv(cont->fn));
+        sbuf_puts(sb, "(");
+        sbuf_puts(sb, node == &kfree? "?" : kstring_buf(*node));
+        sbuf_puts(sb, ")");
+    } else if (khas_name(obj)) {
+        sbuf_puts(sb, ksymbol_buf(kget_name(K, obj)));
+    } else if (ttisoperative(obj)) {
+        sbuf_puts(sb, "#[operative]");
+    } else {
+        sbuf_puts(sb, "?");
+    }
+    sbuf_putsi(sb, K, si);
+}
+
+void klispP_sample(klisp_State *K)
+{
+    klispP_sample_pending = 0;
+    if (!klispP_runningp(K))
+        return;
+
+    /* collect the frames from innermost to outermost, the innermost is
+       the operative or continuation about to be run (see
+       klispT_apply_cc & klispT_tail_call) */
+    TValue frames[KPROFILE_MAXDEPTH];
+    int32_t depth = 0;
+    if (ttisoperative(K->next_obj) || ttiscontinuation(K->next_obj))
+        frames[depth++] = K->next_obj;
+
+    TValue cont = K->curr_cont;
+    while (ttiscontinuation(cont) && depth < KPROFILE_MAXDEPTH) {
+        frames[depth++] = cont;
+        cont = tv2cont(cont)->parent;
+    }
+
+    char buf[KPROFILE_MAXSTACK];
+    SBuf sb = { buf, buf + sizeof(buf) };
+    if (ttiscontinuation(cont))
+        sbuf_puts(&sb, "...;"); /* dropped outermost frames */
+
+    for (int32_t i = depth - 1; i >= 0; --i) {
+        TValue obj = frames[i];
+        /* for the innermost frame use the si of the current call */
+        TValue si = (i == 0 && tv_equal(obj, K->next_obj))?
+            K->next_si : ktry_get_si(K, obj);
+        sbuf_putframe(&sb, K, obj, si);
+        if (i > 0)
+            sbuf_puts(&sb, ";");
+    }
+    if (sb.p == buf)
+        return;
+
+    /* the string is interned, so equal stacks are counted together */
+    TValue str = kstring_new_bs_imm(K, buf, sb.p - buf);
+    krooted_tvs_push(K, str);
+    TValue *node = klispH_set(K, tv2table(G(K)->prof_samples), str);
+    *node = ttisfixint(*node)? i2tv(ivalue(*node) + 1) : i2tv(1);
+    krooted_tvs_pop(K);
+}
+
+TValue klispP_samples_list(klisp_State *K, TValue samples)
+{
+    TValue res = KNIL;
+    if (ttisinert(samples))
+        return res;
+
+    TValue key = KFREE, data;
+    TValue elt = KINERT;
+    Table *t = tv2table(samples);
+    krooted_tvs_push(K, samples);
+    krooted_vars_push(K, &res);
+    krooted_vars_push(K, &elt);
+    while (klispH_next(K, t, &key, &data)) {
+        elt = kcons(K, key, data);
+        res = kcons(K, elt, res);
+    }
+    krooted_vars_pop(K);
+    krooted_vars_pop(K);
+    krooted_tvs_pop(K);
+    return res;
+}
+
+void klispP_write_folded(klisp_State *K, TValue samples, FILE *file)
+{
+    if (ttisinert(samples))
+        return;
+
+    TValue key = KFREE, data;
+    Table *t = tv2table(samples);
+    while (klispH_next(K, t, &key, &data)) {
+        fprintf(file, "%s %d\n", kstring_buf(key), (int) ivalue(data));
+    }
+}
+
+/*
+** Heap profiler
+*/
+
+/* random stride, uniform in [1, 2*rate - 1] so that the mean is rate 
+   (the random numbers are from a xorshift64* generator) */
+static kmem_t next_stride(global_State *g)
+{
+    uint64_t x = g->hprof_rand;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    g->hprof_rand = x;
+    x *= UINT64_C(0x2545F4914F6CDD1D);
+    return (kmem_t) (1 + (x >> 1) % (2 * (uint64_t) g->hprof_rate - 1));
+}
+
+kmem_t klispP_heap_set_rate(klisp_State *K, kmem_t rate)
+{
+    global_State *g = G(K);
+    kmem_t old = g->hprof_rate;
+    klisp_assert(rate <= MAX_KMEM / 2);
+    g->hprof_rate = rate;
+    g->hprof_weight = 0;
+    if (rate == 0) {
+        if (g->hprof_samples != NULL)
+            (*g->frealloc)(g->ud, g->hprof_samples, g->hprof_size * 
+                           sizeof(klisp_HeapSample), 0);
+        g->hprof_samples = NULL;
+        g->hprof_nsamples = 0;
+        g->hprof_size = 0;
+        g->hprof_stride = 0;
+        g->hprof_left = 0;
+    } else {
+        if (g->hprof_rand == 0) /* should be non zero */
+            g->hprof_rand = ((uint64_t) g->seed << 1) | 1;
+        g->hprof_stride = next_stride(g);
+        g->hprof_left = g->hprof_stride;
+    }
+    return old;
+}
+
+void klispP_heap_due(global_State *g)
+{
+    /* all the bytes since the last sample (including the ones after 
+       the end of the stride) are accounted to the next object */
+    klisp_assert(g->hprof_left <= 0);
+    g->hprof_weight += g->hprof_stride + (kmem_t) (-g->hprof_left);
+    g->hprof_stride = next_stride(g);
+    g->hprof_left = g->hprof_stride;
+}
+
+/* the name of the combiner being run (a string), without allocating */
+static TValue heap_site_name(klisp_State *K, TValue obj)
+{
+    TValue name = KINERT;
+    if (ttiscontinuation(obj)) {
+        Continuation *cont = tv2cont(obj);
+        if (khas_name(cont->comb)) {
+            name = kget_name(K, cont->comb);
+        } else {
+            const TValue *node = 
+                klispH_get(K, tv2table(G(K)->cont_name_table), 
+                           p2tv(cont->fn));
+            if (node != &kfree)
+                name = *node;
+        }
+    } else if (khas_name(obj)) {
+        name = kget_name(K, obj);
+    }
+    /* symbols with the same name may be different objects */
+    return ttissymbol(name)? ksymbol_str(name) : name;
+}
+
+void klispP_heap_sample(klisp_State *K, GCObject *o, uint8_t tt)
+{
+    global_State *g = G(K);
+    kmem_t bytes = g->hprof_weight;
+    g->hprof_weight = 0;
+
+    if (g->hprof_nsamples >= g->hprof_size) {
+        /* o isn't rooted yet, so this can't use klispM_growvector, a
+           collection would free it */
+        if (g->hprof_size > 
+            INT32_MAX / 2 / (int32_t) sizeof(klisp_HeapSample))
+            return; /* drop the sample */
+        int32_t newsize = g->hprof_size == 0? 
+            KPROFILE_MINHEAPSAMPLES : 2 * g->hprof_size;
+        void *block = (*g->frealloc)(g->ud, g->hprof_samples, 
+                                     g->hprof_size * sizeof(klisp_HeapSample),
+                                     newsize * sizeof(klisp_HeapSample));
+        if (block == NULL)
+            return; /* drop the sample */
+        g->hprof_samples = (klisp_HeapSample *) block;
+        g->hprof_size = newsize;
+    }
+
+    klisp_HeapSample *sample = &g->hprof_samples[g->hprof_nsamples++];
+    sample->obj = o;
+    sample->si = K->next_si;
+    sample->name = heap_site_name(K, K->next_obj);
+    sample->bytes = bytes;
+    sample->tt = tt;
+}
+
+typedef struct {
+    TValue si;
+    TValue name;
+    uint64_t bytes;
+    int32_t count;
+    uint8_t tt;
+} HeapSite;
+
+static int site_cmp(const void *a, const void *b)
+{
+    const HeapSite *s1 = (const HeapSite *) a;
+    const HeapSite *s2 = (const HeapSite *) b;
+    if (s1->tt != s2->tt)
+        return s1->tt < s2->tt? -1 : 1;
+    if (!tv_equal(s1->si, s2->si))
+        return s1->si.raw < s2->si.raw? -1 : 1;
+    if (!tv_equal(s1->name, s2->name))
+        return s1->name.raw < s2->name.raw? -1 : 1;
+    return 0;
+}
+
+static int site_bytes_cmp(const void *a, const void *b)
+{
+    const HeapSite *s1 = (const HeapSite *) a;
+    const HeapSite *s2 = (const HeapSite *) b;
+    if (s1->bytes != s2->bytes)
+        return s1->bytes > s2->bytes? -1 : 1;
+    return site_cmp(a, b);
+}
+
+/* adds up the first n samples by site in sites (which should have
+   room for n), sorted by decreasing bytes, returns the number of
+   sites. This doesn't allocate */
+static int32_t heap_sites(global_State *g, HeapSite *sites, int32_t n)
+{
+    for (int32_t i = 0; i < n; i++) {
+        klisp_HeapSample *sample = &g->hprof_samples[i];
+        sites[i].si = sample->si;
+        sites[i].name = sample->name;
+        sites[i].bytes = sample->bytes;
+        sites[i].count = 1;
+        sites[i].tt = sample->tt;
+    }
+    qsort(sites, n, sizeof(HeapSite), site_cmp);
+
+    int32_t nsites = 0;
+    for (int32_t i = 0; i < n; i++) {
+        if (nsites > 0 && site_cmp(&sites[nsites-1], &sites[i]) == 0) {
+            sites[nsites-1].bytes += sites[i].bytes;
+            sites[nsites-1].count++;
+        } else {
+            sites[nsites++] = sites[i];
+        }
+    }
+    qsort(sites, nsites, sizeof(HeapSite), site_bytes_cmp);
+    return nsites;
+}
+
+/* "type in name @ file:line" */
+static void sbuf_putsite(SBuf *sb, klisp_State *K, HeapSite *site)
+{
+    const char *type = klispC_type_names[site->tt];
+    sbuf_puts(sb, type != NULL? type : "?");
+    if (ttisstring(site->name)) {
+        sbuf_puts(sb, " in ");
+        sbuf_puts(sb, kstring_buf(site->name));
+    }
+    sbuf_putsi(sb, K, site->si);
+}
+
+TValue klispP_heap_profile(klisp_State *K)
+{
+    global_State *g = G(K);
+    int32_t size = g->hprof_nsamples;
+    if (size == 0)
+        return KNIL;
+
+    /* allocate everything before collecting, the number of samples 
+       only decreases in a collection */
+    HeapSite *sites = klispM_newvector(K, size, HeapSite);
+    TValue keep = kvector_new_sf(K, 2 * size, KINERT);
+    krooted_tvs_push(K, keep);
+    klispC_fullgc(K);
+    int32_t n = g->hprof_nsamples < size? g->hprof_nsamples : size;
+    int32_t nsites = heap_sites(g, sites, n);
+    /* the samples may be dropped while making the list, so keep their
+       source info & names alive */
+    for (int32_t i = 0; i < nsites; i++) {
+        kvector_buf(keep)[2*i] = sites[i].si;
+        kvector_buf(keep)[2*i+1] = sites[i].name;
+    }
+
+    TValue res = KNIL, str = KINERT, bytes = KINERT;
+    krooted_vars_push(K, &res);
+    krooted_vars_push(K, &str);
+    krooted_vars_push(K, &bytes);
+    char buf[KPROFILE_MAXSTACK];
+    for (int32_t i = nsites - 1; i >= 0; --i) {
+        SBuf sb = { buf, buf + sizeof(buf) };
+        sbuf_putsite(&sb, K, &sites[i]);
+        str = kstring_new_bs(K, buf, sb.p - buf);
+        bytes = kinteger_new_uint64(K, sites[i].bytes);
+        str = klist(K, 3, str, bytes, i2tv(sites[i].count));
+        res = kcons(K, str, res);
+    }
+    krooted_vars_pop(K);
+    krooted_vars_pop(K);
+    krooted_vars_pop(K);
+    krooted_tvs_pop(K);
+    klispM_freearray(K, sites, size, HeapSite);
+    return res;
+}
+
+void klispP_write_heap(klisp_State *K, FILE *file)
+{
+    global_State *g = G(K);
+    int32_t size = g->hprof_nsamples;
+    if (size == 0)
+        return;
+
+    HeapSite *sites = klispM_newvector(K, size, HeapSite);
+    klispC_fullgc(K);
+    int32_t n = g->hprof_nsamples < size? g->hprof_nsamples : size;
+    int32_t nsites = heap_sites(g, sites, n);
+    char buf[KPROFILE_MAXSTACK];
+    for (int32_t i = 0; i < nsites; i++) {
+        SBuf sb = { buf, buf + sizeof(buf) };
+        sbuf_putsite(&sb, K, &sites[i]);
+        fprintf(file, "%llu %d %.*s\n", 
+                (unsigned long long) sites[i].bytes, (int) sites[i].count,
+                (int) (sb.p - buf), buf);
+    }
+    klispM_freearray(K, sites, size, HeapSite);
+}
+
+#ifdef KPROFILE
+/*
+** Deterministic counters
+*/
+
+/* The name to report a counter with, a string (without allocating).
+   It is kept in the counter, because prof_index has weak keys and the
+   operative may be collected before the stats are asked for. */
+static TValue counter_name(klisp_State *K, TValue key)
+{
+    TValue name = KINERT;
+    if (!iscollectable(key)) { /* a continuation fn */
+        const TValue *node = klispH_get(K, tv2table(G(K)->cont_name_table),
+                                        key);
+        if (node != &kfree)
+            name = *node;
+    } else if (khas_name(key)) {
+        name = kget_name(K, key);
+    }
+    return ttissymbol(name)? ksymbol_str(name) : name;
+}
+
+void klispP_count(klisp_State *K, TValue key)
+{
+    global_State *g = G(K);
+    if (ttisinert(g->prof_index)) { /* still initializing */
+        K->prof_curr = -1;
+        return;
+    }
+
+    const TValue *node = klispH_get(K, tv2table(g->prof_index), key);
+    int32_t i;
+    if (node == &kfree) {
+        klispM_growvector(K, g->prof_counters, g->prof_ncounters, 
+                          g->prof_size, klisp_ProfCounter, INT32_MAX, 
+                          "too many profile counters");
+        i = g->prof_ncounters++;
+        g->prof_counters[i].calls = 0;
+        g->prof_counters[i].nsecs = 0;
+        g->prof_counters[i].bytes = 0;
+        g->prof_counters[i].name = counter_name(K, key);
+        /* key is either next_obj or a c function, no need to root it */
+        *klispH_set(K, tv2table(g->prof_index), key) = i2tv(i);
+    } else {
+        i = ivalue(*node);
+    }
+    g->prof_counters[i].calls++;
+    K->prof_curr = i;
+}
+
+void klispP_step(klisp_State *K)
+{
+    global_State *g = G(K);
+    /* the step may change prof_curr (and the counters array) */
+    int32_t i = K->prof_curr;
+    uint64_t start = ksystem_prof_clock(K);
+    uint64_t start_bytes = g->gc_allocated;
+
+    (*(K->next_func))(K);
+
+    /* NOTE: steps that throw aren't measured */
+    if (i >= 0) {
+        g->prof_counters[i].nsecs += ksystem_prof_clock(K) - start;
+        g->prof_counters[i].bytes += g->gc_allocated - start_bytes;
+    }
+}
+
+/* GC: assumes unknown is rooted */
+static TValue stats_key(klisp_State *K, klisp_ProfCounter *c, TValue obj,
+                        TValue unknown)
+{
+    if (ttisstring(c->name)) {
+        /* use an interned symbol, the name may come from different
+           symbols (with source info) */
+        return ksymbol_new_b(K, kstring_buf(c->name), KNIL);
+    } else if (!ttisinert(obj)) {
+        return obj; /* an unnamed operative that is still alive */
+    } else {
+        return unknown;
+    }
+}
+
+TValue klispP_get_stats(klisp_State *K)
+{
+    global_State *g = G(K);
+    TValue res = klispH_new(K, 0, MINPROFTABSIZE, K_FLAG_WEAK_NOTHING);
+    krooted_tvs_push(K, res);
+
+    /* first add up the counters with the same name (in sums, indexed
+       by the fixints stored in res), then replace them by lists */
+    int32_t n = g->prof_ncounters;
+    int32_t nsums = 0;
+    klisp_ProfCounter *sums = klispM_newvector(K, n, klisp_ProfCounter);
+    /* the unnamed operatives that haven't been collected, by counter */
+    TValue objs = kvector_new_sf(K, n, KINERT);
+    krooted_tvs_push(K, objs);
+    TValue key = KFREE, data;
+    while (klispH_next(K, tv2table(g->prof_index), &key, &data)) {
+        if (iscollectable(key) && 
+            ttisinert(g->prof_counters[ivalue(data)].name))
+            kvector_buf(objs)[ivalue(data)] = key;
+    }
+    TValue unknown = kstring_new_b_imm(K, "?");
+    krooted_tvs_push(K, unknown);
+
+    TValue name = KINERT;
+    krooted_vars_push(K, &name);
+    for (int32_t i = 0; i < n; i++) {
+        klisp_ProfCounter *c = &g->prof_counters[i];
+        name = stats_key(K, c, kvector_buf(objs)[i], unknown);
+        TValue *node = klispH_set(K, tv2table(res), name);
+        klisp_ProfCounter *s;
+        if (ttisfixint(*node)) {
+            s = &sums[ivalue(*node)];
+        } else {
+            *node = i2tv(nsums);
+            s = &sums[nsums++];
+            s->calls = s->nsecs = s->bytes = 0;
+        }
+        s->calls += c->calls;
+        s->nsecs += c->nsecs;
+        s->bytes += c->bytes;
+    }
+
+    TValue calls = KINERT, nsecs = KINERT, bytes = KINERT;
+    krooted_vars_push(K, &calls);
+    krooted_vars_push(K, &nsecs);
+    krooted_vars_push(K, &bytes);
+    key = KFREE;
+    while (klispH_next(K, tv2table(res), &key, &data)) {
+        klisp_ProfCounter *s = &sums[ivalue(data)];
+        /* key is rooted in res */
+        calls = kinteger_new_uint64(K, s->calls);
+        nsecs = kinteger_new_uint64(K, s->nsecs);
+        bytes = kinteger_new_uint64(K, s->bytes);
+        *klispH_set(K, tv2table(res), key) = klist(K, 3, calls, nsecs, bytes);
+    }
+    krooted_vars_pop(K);
+    krooted_vars_pop(K);
+    krooted_vars_pop(K);
+    krooted_vars_pop(K);
+
+    klispM_freearray(K, sums, n, klisp_ProfCounter);
+    krooted_tvs_pop(K);
+    krooted_tvs_pop(K);
+    krooted_tvs_pop(K);
+    return res;
+}
+#endif /* KPROFILE */
@@ -0,0 +1,92 @@
+/*
+** kprofile.h
+** Sampling profiler
+** See Copyright Notice in klisp.h
+*/
+
+#ifndef kprofile_h
+#define kprofile_h
+
+#include <stdio.h>
+#include <signal.h>
+
+#include "kobject.h"
+#include "kstate.h"
+
+/*
+** The profiler is driven by a timer (see ksystem.h). The signal
+** handler only sets klispP_sample_pending, the flag is checked in
+** klispT_run between steps, and the sample is taken there, where it is
+** safe to allocate. Each sample is the continuation chain at that
+** point (plus the combiner or continuation about to be run), written
+** as a folded stack string: frames from outermost to innermost
+** separated by ';'. Equal stacks are counted in a table (in
+** G(K)->prof_samples) keyed by the (interned) stack string.
+*/
+
+extern volatile sig_atomic_t klispP_sample_pending;
+
+#define klispP_runningp(K_) (!ttisinert(G(K_)->prof_samples))
+
+/* LOCK: All these functions should be called with the GIL already acquired */
+/* starts sampling every usecs microseconds, discarding any previous
+   samples, returns false if there is no timer in this platform */
+bool klispP_start(klisp_State *K, int32_t usecs);
+/* stops sampling & returns the sample table (#inert if not running) */
+TValue klispP_stop(klisp_State *K);
+/* called from klispT_run when klispP_sample_pending is set */
+void klispP_sample(klisp_State *K);
+/* returns a list of (stack . count) pairs */
+TValue klispP_samples_list(klisp_State *K, TValue samples);
+/* writes the samples in folded format ("stack count" lines) */
+void klispP_write_folded(klisp_State *K, TValue samples, FILE *file);
+
+/*
+** Heap profiler
+** When it's running, klispM_realloc_ counts the bytes allocated and 
+** about every hprof_rate bytes (the strides are random, to avoid 
+** aliasing with regular allocation patterns) the next object linked by
+** klispC_link is sampled: its type, the source info of the call being
+** run and the name of the combiner being run are recorded, and the
+** bytes allocated since the last sample are accounted to it. The
+** samples are kept in a C array outside of the klisp heap (so that
+** sampling never allocates nor collects), the collector marks their
+** source info & names, and drops the samples of dead objects after 
+** each mark phase, so what is left are the live sampled objects.
+*/
+/* sets the mean bytes between samples & returns the previous value,
+   0 stops the heap profiler & discards the samples */
+kmem_t klispP_heap_set_rate(klisp_State *K, kmem_t rate);
+/* called from klispM_realloc_ when hprof_left reaches 0 */
+void klispP_heap_due(global_State *g);
+/* called from klispC_link when hprof_weight isn't 0 */
+void klispP_heap_sample(klisp_State *K, GCObject *o, uint8_t tt);
+/* does a full collection and returns a list of (site bytes samples)
+   lists, one per allocation site (type, combiner name & source info),
+   sorted by decreasing live bytes */
+TValue klispP_heap_profile(klisp_State *K);
+/* same, but writes "bytes samples site" lines, this doesn't allocate
+   any klisp object */
+void klispP_write_heap(klisp_State *K, FILE *file);
+
+#ifdef KPROFILE
+/*
+** Deterministic counters (build with -DKPROFILE)
+** klispT_tail_call_si & klispT_apply_cc count each call in a counter
+** per operative (or per type for continuations, see klispP_count in
+** kstate.h) and klispT_run runs each step with klispP_step, which
+** charges the time & memory allocated during the step to the counter
+** of the operative/continuation being run. Because of the CPS
+** evaluator, this is the time spent in the combiner itself, calls
+** to other combiners are separate steps.
+*/
+void klispP_step(klisp_State *K);
+/* returns a new table, name -> (calls nsecs bytes). Operatives are
+   named by kget_name (counters with the same name are added) or
+   keyed by themselves if they don't have one, continuations by
+   their type string. Unnamed operatives that were collected are
+   added up under "?" */
+TValue klispP_get_stats(klisp_State *K);
+#endif
+
+#endif
@@ -81,11 +81,11 @@ void kread_error_g(klisp_State *K, char *str, bool extra, TValue extra_value)
     TValue irritants;
     if (extra) {
         krooted_tvs_push(K, extra_value); /* will be popped by throw */
-        TValue si = ktok_get_source_info(K);
+        TValue si = kexpand_si(K, ktok_get_source_info(K));
         krooted_tvs_push(K, si); /* will be popped by throw */
         irritants = klist_g(K, false, 2, si, extra_value);
     } else {
-        irritants = ktok_get_source_info(K);
+        irritants = kexpand_si(K, ktok_get_source_info(K));
     }
     krooted_tvs_push(K, irritants); /* will be popped by throw */
     klispE_throw_with_irritants(K, str, irritants);
@@ -332,7 +332,8 @@ TValue kread_fsm(klisp_State *K, bool listp)
                         return KINERT;
                     case ST_SEXP_COMMENT:
                         kread_error_extra(K, "unmatched closing paren found in "
-                                          "sexp comment", last_sexp_comment_si);
+                                          "sexp comment", 
+                                          kexpand_si(K, last_sexp_comment_si));
                         /* avoid warning */
                         return KINERT;
                     case ST_READ:
@@ -373,7 +374,8 @@ TValue kread_fsm(klisp_State *K, bool listp)
                         return KINERT;
                     case ST_SEXP_COMMENT:
                         kread_error_extra(K, "dot found outside list in sexp "
-                                          "comment", last_sexp_comment_si);
+                                          "comment", 
+                                          kexpand_si(K, last_sexp_comment_si));
                         /* avoid warning */
                         return KINERT;
                     case ST_READ:
@@ -469,7 +471,8 @@ TValue kread_fsm(klisp_State *K, bool listp)
                 switch (get_state(K)) {
                 case ST_SEXP_COMMENT:
                     kread_error_extra(K, "EOF found while reading sexp "
-                                      " comment", last_sexp_comment_si);
+                                      " comment", 
+                                      kexpand_si(K, last_sexp_comment_si));
                     /* avoid warning */
                     return KINERT;		    
                 case ST_FIRST_EOF_LIST: {
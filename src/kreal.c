@@ -10,6 +10,7 @@
 #include <inttypes.h>
 #include <ctype.h> 
 #include <math.h>
+#include <float.h> /* for FLT_EVAL_METHOD */
 #include <fenv.h> /* for setting round direction */
 
 #include "kreal.h"
@@ -560,6 +561,342 @@ bool dtoa(klisp_State *K, double d, char *buf, int32_t upoint, int32_t *out_h,
 }
 
 
+/*
+** Fast shortest printing
+** SOURCE NOTE: This is the Grisu3 algorithm described in "Printing 
+** Floating-Point Numbers Quickly and Accurately with Integers" by 
+** Florian Loitsch.  It uses only 64 bit integer arithmetic (no bigints
+** and no allocation) and either produces the shortest correctly rounded
+** digit sequence or reports that it can't guarantee it (about 0.5% of 
+** doubles), in which case the exact algorithm above should be used.
+*/
+
+/* "Do it yourself" floating point: f * 2^e */
+typedef struct {
+    uint64_t f;
+    int32_t e;
+} kdiyfp;
+
+#define KDIYFP_SIZE 64
+#define KDOUBLE_SIGNIFICAND_SIZE 52
+#define KDOUBLE_HIDDEN_BIT (UINT64_C(1) << KDOUBLE_SIGNIFICAND_SIZE)
+#define KDOUBLE_SIGNIFICAND_MASK (KDOUBLE_HIDDEN_BIT - 1)
+#define KDOUBLE_EXPONENT_BIAS (0x3FF + KDOUBLE_SIGNIFICAND_SIZE)
+#define KDOUBLE_DENORMAL_EXPONENT (-KDOUBLE_EXPONENT_BIAS + 1)
+
+/* the scaled numbers should have a binary exponent in this range */
+#define KGRISU_MIN_TARGET_EXP (-60)
+#define KGRISU_MAX_TARGET_EXP (-32)
+
+/* normalized powers of ten: 10^dec_exp ~= f * 2^bin_exp,
+   for dec_exp in [-348, 340] step 8 */
+static const struct {
+    uint64_t f;
+    int16_t bin_exp;
+    int16_t dec_exp;
+} kcached_powers[] = {
+    {UINT64_C(0xfa8fd5a0081c0288), -1220, -348},
+    {UINT64_C(0xbaaee17fa23ebf76), -1193, -340},
+    {UINT64_C(0x8b16fb203055ac76), -1166, -332},
+    {UINT64_C(0xcf42894a5dce35ea), -1140, -324},
+    {UINT64_C(0x9a6bb0aa55653b2d), -1113, -316},
+    {UINT64_C(0xe61acf033d1a45df), -1087, -308},
+    {UINT64_C(0xab70fe17c79ac6ca), -1060, -300},
+    {UINT64_C(0xff77b1fcbebcdc4f), -1034, -292},
+    {UINT64_C(0xbe5691ef416bd60c), -1007, -284},
+    {UINT64_C(0x8dd01fad907ffc3c), -980, -276},
+    {UINT64_C(0xd3515c2831559a83), -954, -268},
+    {UINT64_C(0x9d71ac8fada6c9b5), -927, -260},
+    {UINT64_C(0xea9c227723ee8bcb), -901, -252},
+    {UINT64_C(0xaecc49914078536d), -874, -244},
+    {UINT64_C(0x823c12795db6ce57), -847, -236},
+    {UINT64_C(0xc21094364dfb5637), -821, -228},
+    {UINT64_C(0x9096ea6f3848984f), -794, -220},
+    {UINT64_C(0xd77485cb25823ac7), -768, -212},
+    {UINT64_C(0xa086cfcd97bf97f4), -741, -204},
+    {UINT64_C(0xef340a98172aace5), -715, -196},
+    {UINT64_C(0xb23867fb2a35b28e), -688, -188},
+    {UINT64_C(0x84c8d4dfd2c63f3b), -661, -180},
+    {UINT64_C(0xc5dd44271ad3cdba), -635, -172},
+    {UINT64_C(0x936b9fcebb25c996), -608, -164},
+    {UINT64_C(0xdbac6c247d62a584), -582, -156},
+    {UINT64_C(0xa3ab66580d5fdaf6), -555, -148},
+    {UINT64_C(0xf3e2f893dec3f126), -529, -140},
+    {UINT64_C(0xb5b5ada8aaff80b8), -502, -132},
+    {UINT64_C(0x87625f056c7c4a8b), -475, -124},
+    {UINT64_C(0xc9bcff6034c13053), -449, -116},
+    {UINT64_C(0x964e858c91ba2655), -422, -108},
+    {UINT64_C(0xdff9772470297ebd), -396, -100},
+    {UINT64_C(0xa6dfbd9fb8e5b88f), -369, -92},
+    {UINT64_C(0xf8a95fcf88747d94), -343, -84},
+    {UINT64_C(0xb94470938fa89bcf), -316, -76},
+    {UINT64_C(0x8a08f0f8bf0f156b), -289, -68},
+    {UINT64_C(0xcdb02555653131b6), -263, -60},
+    {UINT64_C(0x993fe2c6d07b7fac), -236, -52},
+    {UINT64_C(0xe45c10c42a2b3b06), -210, -44},
+    {UINT64_C(0xaa242499697392d3), -183, -36},
+    {UINT64_C(0xfd87b5f28300ca0e), -157, -28},
+    {UINT64_C(0xbce5086492111aeb), -130, -20},
+    {UINT64_C(0x8cbccc096f5088cc), -103, -12},
+    {UINT64_C(0xd1b71758e219652c), -77, -4},
+    {UINT64_C(0x9c40000000000000), -50, 4},
+    {UINT64_C(0xe8d4a51000000000), -24, 12},
+    {UINT64_C(0xad78ebc5ac620000), 3, 20},
+    {UINT64_C(0x813f3978f8940984), 30, 28},
+    {UINT64_C(0xc097ce7bc90715b3), 56, 36},
+    {UINT64_C(0x8f7e32ce7bea5c70), 83, 44},
+    {UINT64_C(0xd5d238a4abe98068), 109, 52},
+    {UINT64_C(0x9f4f2726179a2245), 136, 60},
+    {UINT64_C(0xed63a231d4c4fb27), 162, 68},
+    {UINT64_C(0xb0de65388cc8ada8), 189, 76},
+    {UINT64_C(0x83c7088e1aab65db), 216, 84},
+    {UINT64_C(0xc45d1df942711d9a), 242, 92},
+    {UINT64_C(0x924d692ca61be758), 269, 100},
+    {UINT64_C(0xda01ee641a708dea), 295, 108},
+    {UINT64_C(0xa26da3999aef774a), 322, 116},
+    {UINT64_C(0xf209787bb47d6b85), 348, 124},
+    {UINT64_C(0xb454e4a179dd1877), 375, 132},
+    {UINT64_C(0x865b86925b9bc5c2), 402, 140},
+    {UINT64_C(0xc83553c5c8965d3d), 428, 148},
+    {UINT64_C(0x952ab45cfa97a0b3), 455, 156},
+    {UINT64_C(0xde469fbd99a05fe3), 481, 164},
+    {UINT64_C(0xa59bc234db398c25), 508, 172},
+    {UINT64_C(0xf6c69a72a3989f5c), 534, 180},
+    {UINT64_C(0xb7dcbf5354e9bece), 561, 188},
+    {UINT64_C(0x88fcf317f22241e2), 588, 196},
+    {UINT64_C(0xcc20ce9bd35c78a5), 614, 204},
+    {UINT64_C(0x98165af37b2153df), 641, 212},
+    {UINT64_C(0xe2a0b5dc971f303a), 667, 220},
+    {UINT64_C(0xa8d9d1535ce3b396), 694, 228},
+    {UINT64_C(0xfb9b7cd9a4a7443c), 720, 236},
+    {UINT64_C(0xbb764c4ca7a44410), 747, 244},
+    {UINT64_C(0x8bab8eefb6409c1a), 774, 252},
+    {UINT64_C(0xd01fef10a657842c), 800, 260},
+    {UINT64_C(0x9b10a4e5e9913129), 827, 268},
+    {UINT64_C(0xe7109bfba19c0c9d), 853, 276},
+    {UINT64_C(0xac2820d9623bf429), 880, 284},
+    {UINT64_C(0x80444b5e7aa7cf85), 907, 292},
+    {UINT64_C(0xbf21e44003acdd2d), 933, 300},
+    {UINT64_C(0x8e679c2f5e44ff8f), 960, 308},
+    {UINT64_C(0xd433179d9c8cb841), 986, 316},
+    {UINT64_C(0x9e19db92b4e31ba9), 1013, 324},
+    {UINT64_C(0xeb96bf6ebadf77d9), 1039, 332},
+    {UINT64_C(0xaf87023b9bf0ee6b), 1066, 340},
+};
+
+#define KCACHED_POWERS_OFFSET 348
+#define KCACHED_POWERS_DEC_DIST 8
+#define KD_1_LOG2_10 0.30102999566398114 /* 1 / log2(10) */
+
+static inline kdiyfp kdiyfp_make(uint64_t f, int32_t e)
+{
+    kdiyfp res = { .f = f, .e = e };
+    return res;
+}
+
+/* both must have the same exponent and x.f >= y.f */
+static inline kdiyfp kdiyfp_minus(kdiyfp x, kdiyfp y)
+{
+    klisp_assert(x.e == y.e && x.f >= y.f);
+    return kdiyfp_make(x.f - y.f, x.e);
+}
+
+/* rounded 64x64 -> 64 (high part) multiplication */
+static kdiyfp kdiyfp_times(kdiyfp x, kdiyfp y)
+{
+    uint64_t m32 = UINT64_C(0xFFFFFFFF);
+    uint64_t a = x.f >> 32, b = x.f & m32;
+    uint64_t c = y.f >> 32, d = y.f & m32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+    tmp += UINT64_C(1) << 31; /* round */
+    return kdiyfp_make(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32),
+                       x.e + y.e + KDIYFP_SIZE);
+}
+
+static kdiyfp kdiyfp_normalize(kdiyfp x)
+{
+    klisp_assert(x.f != 0);
+    while ((x.f & (UINT64_C(1) << 63)) == 0) {
+        x.f <<= 1;
+        --x.e;
+    }
+    return x;
+}
+
+/* d should be positive & finite. w gets d normalized, m_minus & m_plus
+   get the boundaries between d and its neighbours, with the same 
+   exponent as m_plus */
+static void kdiyfp_from_double(double d, kdiyfp *w, kdiyfp *m_minus, 
+                               kdiyfp *m_plus)
+{
+    union { double d; uint64_t u; } bits;
+    bits.d = d;
+    uint64_t significand = bits.u & KDOUBLE_SIGNIFICAND_MASK;
+    int32_t biased_e = (int32_t) ((bits.u >> KDOUBLE_SIGNIFICAND_SIZE) 
+                                  & 0x7FF);
+    kdiyfp v;
+    if (biased_e == 0) { /* denormal */
+        v = kdiyfp_make(significand, KDOUBLE_DENORMAL_EXPONENT);
+    } else {
+        v = kdiyfp_make(significand + KDOUBLE_HIDDEN_BIT,
+                        biased_e - KDOUBLE_EXPONENT_BIAS);
+    }
+    *w = kdiyfp_normalize(v);
+
+    kdiyfp mp = kdiyfp_normalize(kdiyfp_make((v.f << 1) + 1, v.e - 1));
+    kdiyfp mm;
+    /* the lower boundary is closer if d is a power of two (but 
+       not for the smallest normal) */
+    if (significand == 0 && biased_e > 1)
+        mm = kdiyfp_make((v.f << 2) - 1, v.e - 2);
+    else
+        mm = kdiyfp_make((v.f << 1) - 1, v.e - 1);
+    mm.f <<= mm.e - mp.e;
+    mm.e = mp.e;
+
+    *m_minus = mm;
+    *m_plus = mp;
+}
+
+/* get a cached power of ten c = 10^dec_exp such that
+   KGRISU_MIN_TARGET_EXP <= c.e + e + 64 <= KGRISU_MAX_TARGET_EXP */
+static kdiyfp kcached_power(int32_t e, int32_t *dec_exp)
+{
+    int32_t min_e = KGRISU_MIN_TARGET_EXP - (e + KDIYFP_SIZE);
+    double k = ceil((min_e + KDIYFP_SIZE - 1) * KD_1_LOG2_10);
+    int32_t idx = (KCACHED_POWERS_OFFSET + (int32_t) k - 1) / 
+        KCACHED_POWERS_DEC_DIST + 1;
+    klisp_assert(idx >= 0 && idx < (int32_t) (sizeof(kcached_powers) / 
+                                              sizeof(kcached_powers[0])));
+    *dec_exp = kcached_powers[idx].dec_exp;
+    return kdiyfp_make(kcached_powers[idx].f, kcached_powers[idx].bin_exp);
+}
+
+/* returns false if the last digit can't be safely corrected to produce
+   the closest representation */
+static bool kgrisu_round_weed(char *digits, int32_t len, uint64_t dist_high_w,
+                              uint64_t unsafe_interval, uint64_t rest, 
+                              uint64_t ten_kappa, uint64_t unit)
+{
+    uint64_t small_dist = dist_high_w - unit;
+    uint64_t big_dist = dist_high_w + unit;
+
+    while (rest < small_dist && unsafe_interval - rest >= ten_kappa &&
+           (rest + ten_kappa < small_dist ||
+            small_dist - rest >= rest + ten_kappa - small_dist)) {
+        --digits[len-1];
+        rest += ten_kappa;
+    }
+
+    if (rest < big_dist && unsafe_interval - rest >= ten_kappa &&
+        (rest + ten_kappa < big_dist ||
+         big_dist - rest > rest + ten_kappa - big_dist))
+        return false;
+
+    return (2 * unit <= rest) && (rest <= unsafe_interval - 4 * unit);
+}
+
+/* generate the shortest digits in [low, high], returns false if unsure */
+static bool kgrisu_digit_gen(kdiyfp low, kdiyfp w, kdiyfp high, 
+                             char *digits, int32_t *len, int32_t *kappa)
+{
+    klisp_assert(low.e == w.e && w.e == high.e);
+    uint64_t unit = 1;
+    kdiyfp too_low = kdiyfp_make(low.f - unit, low.e);
+    kdiyfp too_high = kdiyfp_make(high.f + unit, high.e);
+    uint64_t unsafe_interval = kdiyfp_minus(too_high, too_low).f;
+    int32_t shift = -w.e;
+    uint64_t one = UINT64_C(1) << shift;
+    uint32_t integrals = (uint32_t) (too_high.f >> shift);
+    uint64_t fractionals = too_high.f & (one - 1);
+
+    /* biggest power of ten <= integrals */
+    uint32_t divisor;
+    if (integrals == 0) {
+        divisor = 0;
+        *kappa = 0;
+    } else {
+        divisor = 1;
+        *kappa = 1;
+        while (divisor <= integrals / 10) {
+            divisor *= 10;
+            ++(*kappa);
+        }
+    }
+
+    *len = 0;
+    while (*kappa > 0) {
+        digits[(*len)++] = '0' + (char) (integrals / divisor);
+        integrals %= divisor;
+        --(*kappa);
+        uint64_t rest = ((uint64_t) integrals << shift) + fractionals;
+        if (rest < unsafe_interval) {
+            return kgrisu_round_weed(digits, *len, 
+                                     kdiyfp_minus(too_high, w).f, 
+                                     unsafe_interval, rest, 
+                                     (uint64_t) divisor << shift, unit);
+        }
+        divisor /= 10;
+    }
+
+    while (true) {
+        fractionals *= 10;
+        unit *= 10;
+        unsafe_interval *= 10;
+        digits[(*len)++] = '0' + (char) (fractionals >> shift);
+        fractionals &= one - 1;
+        --(*kappa);
+        if (fractionals < unsafe_interval) {
+            return kgrisu_round_weed(digits, *len, 
+                                     kdiyfp_minus(too_high, w).f * unit, 
+                                     unsafe_interval, fractionals, one, unit);
+        }
+    }
+}
+
+/* Same interface as dtoa: returns false if the fast algorithm can't
+   guarantee the shortest correctly rounded output, in that case
+   nothing is written to buf */
+static bool fast_dtoa(double d, char *buf, int32_t upoint, int32_t *out_h, 
+                      int32_t *out_k)
+{
+    klisp_assert(d > 0.0);
+
+    kdiyfp w, m_minus, m_plus;
+    kdiyfp_from_double(d, &w, &m_minus, &m_plus);
+    klisp_assert(w.e == m_plus.e);
+
+    int32_t mk;
+    kdiyfp ten_mk = kcached_power(w.e, &mk);
+    
+    kdiyfp scaled_w = kdiyfp_times(w, ten_mk);
+    kdiyfp scaled_minus = kdiyfp_times(m_minus, ten_mk);
+    kdiyfp scaled_plus = kdiyfp_times(m_plus, ten_mk);
+
+    /* at most 17 digits are needed for any double */
+    char digits[18];
+    int32_t len, kappa;
+    if (!kgrisu_digit_gen(scaled_minus, scaled_w, scaled_plus, digits, 
+                          &len, &kappa))
+        return false;
+
+    /* d ~= digits * 10^(kappa - mk) */
+    int32_t k = kappa - mk;
+    int32_t h = k + len - 1;
+    /* NOTE: digits are reversed, like in dtoa */
+    for (int32_t i = 0; i < len; i++)
+        buf[digit_pos(h - i, upoint)] = digits[i];
+
+    *out_h = h;
+    *out_k = k;
+    /* add '\0' to both sides */
+    buf[digit_pos(k-1, upoint)] = '\0';
+    buf[digit_pos(h+1, upoint)] = '\0';
+    return true;
+}
+
+
 /* TEMP: this is a stub for now, always return sufficiently large 
    number */
 int32_t kdouble_print_size(TValue tv_double)
@@ -597,7 +934,10 @@ void kdouble_print_string(klisp_State *K, TValue tv_double,
     else d = od;
 
     /* XXX this doesn't check limit, it should be large enough */
-    UNUSED(dtoa(K, d, buf, upoint, &h, &k));
+    /* try the fast algorithm first, the exact one is only needed
+       in the (rare) cases where the fast one can't decide */
+    if (!fast_dtoa(d, buf, upoint, &h, &k))
+        UNUSED(dtoa(K, d, buf, upoint, &h, &k));
 
     klisp_assert(upoint + k >= 0 && upoint + h + 1 < limit);
 
@@ -662,6 +1002,158 @@ void kdouble_print_string(klisp_State *K, TValue tv_double,
     return;
 }
 
+/*
+** Fast path for reading decimals
+** SOURCE NOTE: This is the fast path from "How to Read Floating Point 
+** Numbers Accurately" by William D. Clinger. If the significand and the
+** power of ten are both exactly representable as doubles, a single 
+** (correctly rounded) multiplication or division gives the closest
+** double, so there is no need to construct a bigrat.
+*/
+
+/* all powers of ten up to 10^22 are exact doubles */
+static const double kexact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define KMAX_EXACT_POWER_OF_TEN 22
+#define KMAX_EXACT_SIGNIFICAND (UINT64_C(1) << 53)
+
+/*
+** With excess precision (FLT_EVAL_METHOD 2, e.g. the x87 fpu in -m32
+** builds) the operation would be rounded twice, first to 64 bits and then
+** to 53 when stored. On x87 with gcc the precision control is set to 53
+** bits for the single operation, which makes it correctly rounded (the
+** extended exponent range doesn't matter because the operands and the
+** result are well within the range of normal doubles). On any other
+** excess precision target only exact products are allowed.
+*/
+#if FLT_EVAL_METHOD == 0 || FLT_EVAL_METHOD == 1
+#define KFAST_DECIMAL_ROUNDED 1
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define KFAST_DECIMAL_ROUNDED 1
+#define KFAST_DECIMAL_X87 1
+#endif
+
+#ifdef KFAST_DECIMAL_ROUNDED
+/* a single correctly rounded multiplication (or division if !mulp) */
+static double kdouble_rounded_op(double a, double b, bool mulp)
+{
+#ifdef KFAST_DECIMAL_X87
+    /* volatiles and the memory clobbers keep the operation and the store
+       between the two fldcw */
+    volatile double va = a, vb = b, res;
+    uint16_t old_cw, cw;
+    __asm__ __volatile__ ("fnstcw %0" : "=m" (old_cw) : : "memory");
+    cw = (old_cw & ~0x300) | 0x200; /* precision control: 53 bits */
+    __asm__ __volatile__ ("fldcw %0" : : "m" (cw) : "memory");
+    res = mulp? va * vb : va / vb;
+    __asm__ __volatile__ ("fldcw %0" : : "m" (old_cw) : "memory");
+    return res;
+#else
+    return mulp? a * b : a / b;
+#endif
+}
+#endif
+
+/* Only the plain decimal format is handled: [sign] digits '.' digits 
+   [exponent-marker [sign] digits]. Returns false if the number isn't in
+   this format or if the fast path doesn't apply, in which case 
+   krational_read_decimal should be used. end gets the first char 
+   not read */
+bool kdouble_read_decimal(char *buf, char **end, double *out)
+{
+    char *ch = buf;
+    bool negp = false;
+    if (*ch == '+' || *ch == '-')
+        negp = (*ch++ == '-');
+
+    uint64_t significand = 0;
+    int32_t sig_digits = 0;
+    int32_t exp10 = 0;
+
+    char *start = ch;
+    for (; isdigit((unsigned char) *ch); ch++) {
+        if (significand > 0 || *ch != '0')
+            ++sig_digits;
+        if (sig_digits > 17) /* won't fit, stop now to avoid overflow */
+            return false;
+        significand = significand * 10 + (*ch - '0');
+    }
+    if (ch == start || *ch != '.')
+        return false;
+
+    start = ++ch;
+    for (; isdigit((unsigned char) *ch); ch++) {
+        if (significand > 0 || *ch != '0')
+            ++sig_digits;
+        if (sig_digits > 17)
+            return false;
+        significand = significand * 10 + (*ch - '0');
+        --exp10;
+    }
+    if (ch == start)
+        return false;
+
+    char el = tolower((unsigned char) *ch);
+    /* NOTE: in klisp all exponent letters map to double */
+    if (el == 'e' || el == 's' || el == 'f' || el == 'd' || el == 'l') {
+        ++ch;
+        bool exp_negp = false;
+        if (*ch == '+' || *ch == '-')
+            exp_negp = (*ch++ == '-');
+        start = ch;
+        int32_t exp_exp = 0;
+        for (; isdigit((unsigned char) *ch); ch++) {
+            /* anything this big is outside the fast path anyways */
+            if (exp_exp < 10000)
+                exp_exp = exp_exp * 10 + (*ch - '0');
+        }
+        if (ch == start)
+            return false;
+        exp10 += exp_negp? -exp_exp : exp_exp;
+    }
+    *end = ch;
+
+    double d;
+    if (significand == 0) {
+        d = 0.0;
+    } else if (significand > KMAX_EXACT_SIGNIFICAND || 
+               exp10 < -KMAX_EXACT_POWER_OF_TEN || 
+               exp10 > KMAX_EXACT_POWER_OF_TEN) {
+        return false;
+    } else if (exp10 >= 0) {
+#ifdef KFAST_DECIMAL_ROUNDED
+        d = kdouble_rounded_op((double) significand,
+                               kexact_powers_of_ten[exp10], true);
+#else
+        /* the product could be rounded twice, so only allow exact
+           results */
+        uint64_t pow10 = 1;
+        for (int32_t i = 0; i < exp10; i++) {
+            if (pow10 > KMAX_EXACT_SIGNIFICAND)
+                return false;
+            pow10 *= 10;
+        }
+        if (significand > KMAX_EXACT_SIGNIFICAND / pow10)
+            return false;
+        d = (double) significand * kexact_powers_of_ten[exp10];
+#endif
+    } else {
+#ifdef KFAST_DECIMAL_ROUNDED
+        d = kdouble_rounded_op((double) significand,
+                               kexact_powers_of_ten[-exp10], false);
+#else
+        /* see above, a quotient is never exact here */
+        return false;
+#endif
+    }
+    
+    *out = negp? -d : d;
+    return true;
+}
+
 double kdouble_div_mod(double n, double d, double *res_mod) 
 {
     double div = floor(n / d);
@@ -34,5 +34,7 @@ TValue kdouble_to_integer(klisp_State *K, TValue tv_double, kround_mode mode);
 int32_t kdouble_print_size(TValue tv_double);
 void  kdouble_print_string(klisp_State *K, TValue tv_double,
                            char *buf, int32_t limit);
+/* fast path for reading decimals, false if it doesn't apply */
+bool kdouble_read_decimal(char *buf, char **end, double *out);
 
 #endif
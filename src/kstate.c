@@ -38,6 +38,9 @@
 #include "ktable.h"
 #include "kbytevector.h"
 #include "kvector.h"
+#include "kprofile.h"
+#include "kimage.h"
+#include "ksystem.h"
 
 #include "kghelpers.h" /* for creating list_app & memoize_app */
 #include "kgerrors.h" /* for creating error hierarchy */
@@ -45,6 +48,15 @@
 #include "kgc.h" /* for memory freeing & gc init */
 
 
+/*
+** a macro to help the creation of a unique random seed when a state is
+** created; the seed is used to randomize hashes.
+*/
+#if !defined(klispi_makeseed)
+#include <time.h>
+#define klispi_makeseed()		cast(uint32_t, time(NULL))
+#endif
+
 /* in lua state size can have an extra space here to save
    some user data, for now we don't have that in klisp */
 #define state_size(x) (sizeof(x) + 0)
@@ -59,6 +71,29 @@ typedef struct KG {
   global_State g;
 } KG;
 
+/*
+** SOURCE NOTE: this is from lua 5.2.
+** Mix the time with the addresses of a heap object, a local variable,
+** a global variable and a function. With address space layout 
+** randomization this is different on each run.
+*/
+#define addbuff(b,p,e)                                                  \
+    { size_t t = cast(size_t, e);                                       \
+        memcpy(buff + p, &t, sizeof(t)); p += sizeof(t); }
+
+static uint32_t makeseed (klisp_State *K) 
+{
+    char buff[4 * sizeof(size_t)];
+    uint32_t h = klispi_makeseed();
+    int32_t p = 0;
+    addbuff(buff, p, K);  /* heap variable */
+    addbuff(buff, p, &h);  /* local variable */
+    addbuff(buff, p, &knil);  /* global variable */
+    addbuff(buff, p, &klisp_newstate);  /* public function */
+    klisp_assert(p == sizeof(buff));
+    return klispS_hash(buff, p, h);
+}
+
 /*
 ** open parts that may cause memory-allocation errors
 */
@@ -66,7 +101,7 @@ typedef struct KG {
 static void f_klispopen (klisp_State *K, void *ud) {
     global_State *g = G(K);
     UNUSED(ud);
-    klispS_resize(K, MINSTRTABSIZE);  /* initial size of string table */
+    klispS_resize(K, STARTSTRTABSIZE);  /* initial size of string table */
 
     void *s = (*g->frealloc)(ud, NULL, 0, KS_ISSIZE * sizeof(TValue));
     if (s == NULL) { 
@@ -109,6 +144,9 @@ static void preinit_state (klisp_State *K, global_State *g) {
     K->next_env = KNIL;
     K->next_xparams = NULL;
     K->next_si = KNIL;
+#ifdef KPROFILE
+    K->prof_curr = -1;
+#endif
 
     /* current input and output */
     K->curr_port = KINERT; /* set on each call to read/write */
@@ -130,6 +168,7 @@ static void preinit_state (klisp_State *K, global_State *g) {
     K->ktok_source_info.filename = KINERT; 
     K->ktok_source_info.line = 1; 
     K->ktok_source_info.col = 0;
+    K->ktok_source_info.file_id = -1;
 
     K->ktok_nested_comments = 0;
 
@@ -159,12 +198,20 @@ static void close_state(klisp_State *K)
     klispC_freeall(K);
     klisp_assert(g->rootgc == obj2gco(K));
     klisp_assert(g->strt.nuse == 0);
+    /* the objects from the image are already accounted as freed */
+    if (g->image != NULL)
+        ksystem_unmap_file(K, g->image, g->image_size);
 
     /* free helper buffers */
     klispM_freemem(K, ks_sbuf(K), ks_ssize(K) * sizeof(TValue));
     klispM_freemem(K, ks_tbuf(K), ks_tbsize(K));
     /* free string/symbol table */
     klispM_freearray(K, g->strt.hash, g->strt.size, GCObject *);
+    if (g->strt.oldhash != NULL)
+        klispM_freearray(K, g->strt.oldhash, g->strt.oldsize, GCObject *);
+#ifdef KPROFILE
+    klispM_freearray(K, g->prof_counters, g->prof_size, klisp_ProfCounter);
+#endif
 
     /* destroy the GIL */
     pthread_mutex_destroy(&g->gil);
@@ -178,7 +225,9 @@ static void close_state(klisp_State *K)
 /*
 ** State creation and destruction
 */
-klisp_State *klisp_newstate(klisp_Alloc f, void *ud)
+
+/* creates the main thread & the global state, without any objects */
+static klisp_State *new_bare_state(klisp_Alloc f, void *ud)
 {
     klisp_State *K;
     global_State *g;
@@ -201,22 +250,47 @@ klisp_State *klisp_newstate(klisp_Alloc f, void *ud)
     ktok_init(K); /* initialize tokenizer tables */
     g->frealloc = f;
     g->ud = ud;
+    g->image = NULL;
+    g->image_size = 0;
     g->mainthread = K;
 
     g->GCthreshold = 0;  /* mark it as unfinished state */
 
+    g->seed = makeseed(K);
+
     /* these will be properly initialized later */
     g->strt.size = 0;
     g->strt.nuse = 0;
     g->strt.hash = NULL;
+    g->strt.oldhash = NULL;
+    g->strt.oldsize = 0;
+    g->strt.rehashidx = 0;
     g->name_table = KINERT;
     g->cont_name_table = KINERT;
     g->thread_table = KINERT;
+    g->guarded = KINERT;
 
     g->empty_string = KINERT;
     g->empty_bytevector = KINERT;
     g->empty_vector = KINERT;
 
+    g->si_files = KINERT;
+    g->prof_samples = KINERT;
+    g->hprof_rate = 0;
+    g->hprof_stride = 0;
+    g->hprof_left = 0;
+    g->hprof_weight = 0;
+    g->hprof_rand = 0;
+    g->hprof_samples = NULL;
+    g->hprof_nsamples = 0;
+    g->hprof_size = 0;
+#ifdef KPROFILE
+    g->prof_index = KINERT;
+    g->prof_counters = NULL;
+    g->prof_ncounters = 0;
+    g->prof_size = 0;
+#endif
+
     g->ktok_lparen = KINERT;
     g->ktok_rparen = KINERT;
     g->ktok_dot = KINERT;
@@ -257,11 +331,22 @@ klisp_State *klisp_newstate(klisp_Alloc f, void *ud)
     g->gcpause = KLISPI_GCPAUSE;
     g->gcstepmul = KLISPI_GCMUL;
     g->gcdept = 0;
+    g->gclimit = 0;
+    g->gclimit_hit = false;
+    g->gcrunning = false;
+    g->gc_allocated = 0;
+    g->gc_count = 0;
+    g->gc_nsecs = 0;
+    g->gc_max_nsecs = 0;
+    g->gc_freed_strings = 0;
+    g->gc_freed_objects = 0;
+    memset(g->gc_live, 0, sizeof(g->gc_live));
+    memset(g->gc_freed, 0, sizeof(g->gc_freed));
 
     /* GC */
     g->totalbytes = state_size(KG) + KS_ISSIZE * sizeof(TValue) +
         KS_ITBSIZE;
-    g->GCthreshold = UINT32_MAX; /* we still have a lot of allocation
+    g->GCthreshold = MAX_KMEM; /* we still have a lot of allocation
                                     to do, put a very high value to 
                                     avoid collection */
     g->estimate = 0; /* doesn't matter, it is set by gc later */
@@ -276,9 +361,39 @@ klisp_State *klisp_newstate(klisp_Alloc f, void *ud)
      luaD_rawrunprotected */
     f_klispopen(K, NULL); /* this touches GCthreshold */
 
-    g->GCthreshold = UINT32_MAX; /* we still have a lot of allocation
+    g->GCthreshold = MAX_KMEM; /* we still have a lot of allocation
                                     to do, put a very high value to 
                                     avoid collection */
+    return K;
+}
+
+/* creates the objects that aren't saved in heap images (see kimage.h) */
+static void init_transient_objects(klisp_State *K)
+{
+    global_State *g = G(K);
+#ifdef KPROFILE
+    /* the keys are weak, the counters keep their own names */
+    g->prof_index = klispH_new(K, 0, MINPROFTABSIZE, K_FLAG_WEAK_KEYS);
+#endif
+
+    /* the require path */
+    char *str = getenv(KLISP_PATH);
+    if (str == NULL)
+        str = KLISP_PATH_DEFAULT;
+	
+    g->require_path = kstring_new_b_imm(K, str);
+    /* replace dirsep with forward slashes,
+       windows will happily accept forward slashes */
+    str = kstring_buf(g->require_path);
+    while ((str = strchr(str, *KLISP_DIRSEP)) != NULL)
+        *str++ = '/';
+}
+
+klisp_State *klisp_newstate(klisp_Alloc f, void *ud)
+{
+    klisp_State *K = new_bare_state(f, ud);
+    if (K == NULL) return NULL;
+    global_State *g = G(K);
 
     /* TEMP: err */
     /* THIS MAY CRASH THE INTERPRETER IF THERE IS AN ERROR IN THE INIT */
@@ -297,6 +412,8 @@ klisp_State *klisp_newstate(klisp_Alloc f, void *ud)
     /* here the keys are uncollectable */
     g->thread_table = klispH_new(K, 0, MINTHREADTABSIZE,
                                  K_FLAG_WEAK_NOTHING);
+    /* objects registered in guardians, the keys are weak */
+    g->guarded = klispH_new(K, 0, 0, K_FLAG_WEAK_KEYS);
 
     /* Empty string */
     /* MAYBE: fix it so we can remove empty_string from roots */
@@ -312,6 +429,9 @@ klisp_State *klisp_newstate(klisp_Alloc f, void *ud)
     /* MAYBE: see above */
     g->empty_vector = kvector_new_bs_g(K, false, NULL, 0);
 
+    /* Compact source info file table */
+    g->si_files = kvector_new_c(K, 16);
+
     /* Special Tokens */
     g->ktok_lparen = kcons(K, ch2tv('('), KNIL);
     g->ktok_rparen = kcons(K, ch2tv(')'), KNIL);
@@ -319,18 +439,7 @@ klisp_State *klisp_newstate(klisp_Alloc f, void *ud)
     g->ktok_sexp_comment = kcons(K, ch2tv(';'), KNIL);
 
     /* initialize require facilities */ 
-    {
-        char *str = getenv(KLISP_PATH);
-        if (str == NULL)
-            str = KLISP_PATH_DEFAULT;
-	
-        g->require_path = kstring_new_b_imm(K, str);
-        /* replace dirsep with forward slashes,
-           windows will happily accept forward slashes */
-        str = kstring_buf(g->require_path);
-        while ((str = strchr(str, *KLISP_DIRSEP)) != NULL)
-            *str++ = '/';
-    }
+    init_transient_objects(K);
     g->require_table = klispH_new(K, 0, MINREQUIRETABSIZE, 0);
 
     /* initialize library facilities */
@@ -379,7 +488,7 @@ klisp_State *klisp_newstate(klisp_Alloc f, void *ud)
     kset_source_info(K, kunwrap(g->memoize_app), si);
 #endif
     /* ground environment has a hashtable for bindings */
-    g->ground_env = kmake_table_environment(K, KNIL);
+    g->ground_env = kmake_table_environment_s(K, KNIL, GROUNDENVTABSIZE);
 //    g->ground_env = kmake_empty_environment(K);
 
     /* MAYBE: fix it so we can remove module_params_sym from roots */
@@ -403,6 +512,26 @@ klisp_State *klisp_newstate(klisp_Alloc f, void *ud)
     return K;
 }
 
+klisp_State *klisp_newstate_image(klisp_Alloc f, void *ud, const char *name,
+                                  const char **msg)
+{
+    klisp_State *K = new_bare_state(f, ud);
+    if (K == NULL) {
+        *msg = "not enough memory";
+        return NULL;
+    }
+    /* the objects are loaded with GCthreshold at MAX_KMEM, as above */
+    *msg = klispI_load(K, name);
+    if (*msg != NULL) {
+        close_state(K);
+        return NULL;
+    }
+    init_transient_objects(K);
+
+    G(K)->GCthreshold = 4*G(K)->totalbytes;
+    return K;
+}
+
 /* this is in api.c in lua */
 klisp_State *klisp_newthread(klisp_State *K)
 {
@@ -466,6 +595,9 @@ void klisp_close (klisp_State *K)
     K = G(K)->mainthread;  /* only the main thread can be closed */
 
     klisp_lock(K);
+    /* don't leave the timer running after the state is gone */
+    klispP_stop(K);
+    klispP_heap_set_rate(K, 0); /* free the heap samples */
 /* XXX lua does the following */
 #if 0 
     lua_lock(L); 
@@ -485,6 +617,70 @@ void klisp_close (klisp_State *K)
     close_state(K);
 }
 
+/*
+** Compact source info (see kstate.h)
+*/
+
+/* LOCK: All these functions should be called with the GIL already acquired */
+int32_t klispT_si_file_id(klisp_State *K, TValue filename)
+{
+    if (!ttisstring(filename))
+        return -1;
+
+    TValue files = G(K)->si_files;
+    int32_t n = kvector_size(files);
+    TValue *buf = kvector_buf(files);
+    /* there are usually only a few files, a linear search is enough */
+    for (int32_t i = 0; i < n; ++i) {
+        if (kstring_equalp(buf[i], filename))
+            return i;
+    }
+    if (n >= KSI_MAX_FILES)
+        return -1;
+
+    /* keep an immutable copy, in case filename is mutated later */
+    TValue imm = kstring_immutablep(filename)? filename :
+        kstring_new_bs_imm(K, kstring_buf(filename), kstring_size(filename));
+    krooted_tvs_push(K, imm);
+    kvector_push(K, files, imm);
+    krooted_tvs_pop(K);
+    return n;
+}
+
+TValue klispT_make_si(klisp_State *K, TValue filename, int32_t file_id,
+                      int32_t line, int32_t col)
+{
+    if (file_id >= 0 && line >= 0 && line <= KSI_MAX_LINE && 
+        col >= 0 && col <= KSI_MAX_COL) {
+        return i2tv((file_id << (KSI_LINE_BITS + KSI_COL_BITS)) | 
+                    (line << KSI_COL_BITS) | col);
+    }
+    TValue pos = kcons(K, i2tv(line), i2tv(col));
+    krooted_tvs_push(K, pos);
+    TValue res = kcons(K, filename, pos);
+    krooted_tvs_pop(K);
+    return res;
+}
+
+TValue klispT_expand_si(klisp_State *K, TValue si)
+{
+    if (!ttisfixint(si))
+        return si;
+
+    int32_t packed = ivalue(si);
+    int32_t col = packed & KSI_MAX_COL;
+    int32_t line = (packed >> KSI_COL_BITS) & KSI_MAX_LINE;
+    int32_t file_id = packed >> (KSI_LINE_BITS + KSI_COL_BITS);
+    klisp_assert(file_id < kvector_size(G(K)->si_files));
+    /* the filename is rooted in si_files */
+    TValue filename = kvector_buf(G(K)->si_files)[file_id];
+    TValue pos = kcons(K, i2tv(line), i2tv(col));
+    krooted_tvs_push(K, pos);
+    TValue res = kcons(K, filename, pos);
+    krooted_tvs_pop(K);
+    return res;
+}
+
 /*
 ** Stacks memory management
 */
@@ -615,8 +811,14 @@ void klispT_run(klisp_State *K)
             while (K->next_func) {
                 /* next_func is either operative or continuation
                    but in any case the call is the same */
+#ifdef KPROFILE
+                klispP_step(K);
+#else
                 (*(K->next_func))(K);
+#endif
                 klispi_threadyield(K);
+                if (klispP_sample_pending && K->next_func)
+                    klispP_sample(K);
             }
             /* K->next_func is NULL, this means we should exit already */
             klisp_unlock(K);
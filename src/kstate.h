@@ -31,6 +31,10 @@ typedef struct {
     
     int32_t saved_line;
     int32_t saved_col;
+
+    /* index of filename in the compact source info file table 
+       (see klispT_si_file_id), or -1 if it has none */
+    int32_t file_id;
 } ksource_info_t;
 
 /* in klisp this has both the immutable strings & the symbols */
@@ -38,10 +42,37 @@ typedef struct stringtable {
     GCObject **hash;
     uint32_t nuse;  /* number of elements */
     int32_t size;
+    /* while resizing, elements not yet moved are still in oldhash
+       (see klispS_resize) */
+    GCObject **oldhash; /* NULL if there's no resize in progress */
+    int32_t oldsize;
+    int32_t rehashidx; /* next bucket of oldhash to move */
 } stringtable;
 
+/* heap profiler sample (see kprofile.h) */
+typedef struct {
+    GCObject *obj; /* the sampled object, dropped by the GC when it dies */
+    TValue si; /* source info of the call being run when it was allocated */
+    TValue name; /* name of the combiner being run, or #inert */
+    kmem_t bytes; /* allocated bytes accounted to this sample */
+    uint8_t tt; /* type of obj */
+} klisp_HeapSample;
+
+#ifdef KPROFILE
+/* per combiner/continuation type counters (see kprofile.h) */
+typedef struct {
+    uint64_t calls;
+    uint64_t nsecs; /* time spent in the fn itself */
+    uint64_t bytes; /* bytes allocated by the fn itself */
+    TValue name; /* string, or #inert if unnamed (see klispP_count) */
+} klisp_ProfCounter;
+#endif
+
 #define GC_PROTECT_SIZE 32
 
+/* type tags of collectable objects are below this (see gc_live) */
+#define KGC_NTYPES 64
+
 /* NOTE: when adding TValues here, remember to add them to
    markroot in kgc.c!! */
 
@@ -54,13 +85,19 @@ typedef struct stringtable {
 typedef struct global_State {
     /* Global tables */
     stringtable strt;  /* hash table for immutable strings & symbols */
+    uint32_t seed; /* randomized seed for hashes (see klispS_hash) */
     TValue name_table; /* hash tables for naming objects */
     TValue cont_name_table; /* hash tables for naming continuation functions */
     TValue thread_table; /* hash table for all live (non done/error) threads */
+    TValue guarded; /* weak hash table for guardians (see kgc.c) */
 
     /* Memory allocator */
     klisp_Alloc frealloc;  /* function to reallocate memory */
     void *ud;            /* auxiliary data to `frealloc' */
+    /* mapped heap image the state was loaded from, the objects in it 
+       weren't allocated with frealloc (see kimage.h) */
+    char *image; /* NULL if the state wasn't loaded from an image */
+    size_t image_size;
 
     /* GC */
     uint16_t currentwhite; /* the one of the two whites that is in use in
@@ -73,12 +110,37 @@ typedef struct global_State {
     GCObject *grayagain;  /* list of objects to be traversed atomically */
     GCObject *weak;  /* list of weak tables (to be cleared) */
     GCObject *tmudata;  /* last element of list of userdata to be GC */
-    uint32_t GCthreshold;
-    uint32_t totalbytes;  /* number of bytes currently allocated */
-    uint32_t estimate;  /* an estimate of number of bytes actually in use */
-    uint32_t gcdept;  /* how much GC is `behind schedule' */
+    kmem_t GCthreshold;
+    kmem_t totalbytes;  /* number of bytes currently allocated */
+    kmem_t estimate;  /* an estimate of number of bytes actually in use */
+    kmem_t gcdept;  /* how much GC is `behind schedule' */
     int32_t gcpause;  /* size of pause between successive GCs */
     int32_t gcstepmul;  /* GC `granularity' */
+    kmem_t gclimit; /* hard limit for totalbytes, or 0 for no limit */
+    bool gclimit_hit; /* the limit was reached & the error signaled */
+    bool gcrunning; /* a collection or sweep step is in progress */
+
+    /* cumulative GC statistics (see gc-stats) */
+    uint64_t gc_allocated; /* bytes allocated, never decreases */
+    uint64_t gc_count; /* number of complete collections */
+    uint64_t gc_nsecs; /* total time spent collecting */
+    uint64_t gc_max_nsecs; /* longest single pause */
+    uint64_t gc_freed_strings; /* bytes freed in the sweepstring phase */
+    uint64_t gc_freed_objects; /* bytes freed in the sweep phase */
+    uint32_t gc_live[KGC_NTYPES]; /* objects per type left by last sweep */
+    uint64_t gc_freed[KGC_NTYPES]; /* objects freed per type */
+
+    /* heap profiler (see kprofile.h) */
+    kmem_t hprof_rate; /* mean bytes between samples, 0 if not running */
+    kmem_t hprof_stride; /* bytes between the last sample & the next */
+    int64_t hprof_left; /* bytes left until the next sample */
+    kmem_t hprof_weight; /* bytes to account to the next object linked */
+    uint64_t hprof_rand; /* state for choosing the strides */
+    /* samples of objects that were alive after the last mark phase,
+       this is allocated outside of the klisp heap */
+    klisp_HeapSample *hprof_samples;
+    int32_t hprof_nsamples; /* used samples */
+    int32_t hprof_size; /* allocated samples */
 
     /* Basic Continuation objects */
     TValue root_cont; 
@@ -94,6 +156,20 @@ typedef struct global_State {
     /* Vectors */
     TValue empty_vector;
     
+    /* compact source info, file id -> immutable filename string */
+    TValue si_files; /* growable vector */
+
+    /* profiler samples, stack string -> count (see kprofile.h) */
+    TValue prof_samples; /* table, or #inert if not profiling */
+
+#ifdef KPROFILE
+    /* call counters, combiner/continuation fn -> index in prof_counters */
+    TValue prof_index; /* table */
+    klisp_ProfCounter *prof_counters;
+    int32_t prof_ncounters; /* used counters */
+    int32_t prof_size; /* allocated counters */
+#endif
+
     /* tokenizer */
     /* special tokens, see ktoken.c for rationale */
     TValue ktok_lparen;
@@ -174,6 +250,9 @@ struct klisp_State {
     TValue *next_xparams; 
     /* TODO replace with GCObject *next_si */
     TValue next_si; /* the source code info for this call */
+#ifdef KPROFILE
+    int32_t prof_curr; /* counter of next_obj, or -1 (see kprofile.h) */
+#endif
 
     /* TEMP: error handling */
     jmp_buf error_jb;
@@ -438,7 +517,25 @@ static inline void krooted_vars_clear(klisp_State *K) { K->rooted_vars_top = 0;
 /*
 ** Source code tracking
 ** MAYBE: add source code tracking to symbols
+**
+** Source info is either a list (filename line . col) or, if it fits, 
+** a non negative fixint packing the line, the column and the index of
+** the filename in G(K)->si_files. The reader uses the packed form to 
+** avoid allocating two pairs per datum read, use kexpand_si to get 
+** the list form of either one. The packed form is kept in the si
+** field of the header shifted one bit to the left and with the low 
+** bit set, so it can't be confused with a pointer.
 */
+#define KSI_COL_BITS 7
+#define KSI_LINE_BITS 14
+#define KSI_FILE_BITS 10
+
+#define KSI_MAX_COL ((1 << KSI_COL_BITS) - 1)
+#define KSI_MAX_LINE ((1 << KSI_LINE_BITS) - 1)
+#define KSI_MAX_FILES (1 << KSI_FILE_BITS)
+
+#define ksi_packedp(gco_) ((((uintptr_t) (gco_)) & 1) != 0)
+
 /* LOCK: All these functions should be called with the GIL already acquired */
 #if KTRACK_SI
 static inline TValue kget_source_info(klisp_State *K, TValue obj)
@@ -447,27 +544,30 @@ static inline TValue kget_source_info(klisp_State *K, TValue obj)
     klisp_assert(khas_si(obj));
     GCObject *si = gcvalue(obj)->gch.si;
     klisp_assert(si != NULL);
-    return gc2pair(si);
+    return ksi_packedp(si)? i2tv((int32_t) (((uintptr_t) si) >> 1)) :
+        gc2pair(si);
 }
 
 static inline void kset_source_info(klisp_State *K, TValue obj, TValue si)
 {
     UNUSED(K);
     klisp_assert(kcan_have_si(obj));
-    klisp_assert(ttisnil(si) || ttispair(si));
+    klisp_assert(ttisnil(si) || ttispair(si) || 
+                 (ttisfixint(si) && ivalue(si) >= 0));
     if (ttisnil(si)) {
         gcvalue(obj)->gch.si = NULL;
         gcvalue(obj)->gch.kflags &= ~(K_FLAG_HAS_SI);
     } else {
-        gcvalue(obj)->gch.si = gcvalue(si);
+        gcvalue(obj)->gch.si = ttisfixint(si)? 
+            (GCObject *) ((((uintptr_t) ivalue(si)) << 1) | 1) : 
+            gcvalue(si);
         gcvalue(obj)->gch.kflags |= K_FLAG_HAS_SI;
     }
 }
 
 static inline TValue ktry_get_si(klisp_State *K, TValue obj)
 {
-    UNUSED(K);
-    return (khas_si(obj))? gc2pair(gcvalue(obj)->gch.si) : KNIL;
+    return (khas_si(obj))? kget_source_info(K, obj) : KNIL;
 }
 
 static inline TValue kget_csi(klisp_State *K)
@@ -480,6 +580,13 @@ static inline TValue kget_csi(klisp_State *K)
 ** Functions to manipulate the current continuation and calling 
 ** operatives
 */
+#ifdef KPROFILE
+/* in kprofile.c, counts a call to the operative or continuation type 
+   key & makes it the current counter. 
+   GC: may allocate, assumes the next_xxx fields are already set */
+void klispP_count(klisp_State *K, TValue key);
+#endif
+
 static inline void klispT_apply_cc(klisp_State *K, TValue val)
 {
     /* TODO write barriers */
@@ -498,6 +605,10 @@ static inline void klispT_apply_cc(klisp_State *K, TValue val)
     K->next_xparams = cont->extra;
     K->curr_cont = cont->parent;
     K->next_si = ktry_get_si(K, K->next_obj);
+#ifdef KPROFILE
+    /* continuations are counted by type */
+    klispP_count(K, p2tv(cont->fn));
+#endif
 }
 
 #define kapply_cc(K_, val_) klispT_apply_cc((K_), (val_)); return
@@ -533,6 +644,9 @@ static inline void klispT_tail_call_si(klisp_State *K, TValue top, TValue ptree,
     K->next_env = env;
     K->next_xparams = op->extra;
     K->next_si = si;
+#ifdef KPROFILE
+    klispP_count(K, top);
+#endif
 }
 
 #define ktail_call_si(K_, op_, p_, e_, si_)                             \
@@ -552,6 +666,19 @@ static inline void klispT_tail_call_si(klisp_State *K, TValue top, TValue ptree,
         klispT_tail_call_si(K__, G(K__)->eval_op, p__, (e_), si__);     \
         return; }
 
+/* compact source info */
+/* returns the index of filename in G(K)->si_files (adding it if 
+   necessary), or -1 if filename isn't a string or the table is full */
+int32_t klispT_si_file_id(klisp_State *K, TValue filename);
+/* returns the packed source info if possible, or a new list otherwise,
+   GC: assumes filename is rooted */
+TValue klispT_make_si(klisp_State *K, TValue filename, int32_t file_id,
+                      int32_t line, int32_t col);
+/* returns the list form of si (nil stays nil) */
+TValue klispT_expand_si(klisp_State *K, TValue si);
+
+#define kexpand_si(K_, si_) (klispT_expand_si((K_), (si_)))
+
 void do_interception(klisp_State *K);
 void kcall_cont(klisp_State *K, TValue dst_cont, TValue obj);
 void klispT_init_repl(klisp_State *K);
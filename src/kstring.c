@@ -8,6 +8,10 @@
 
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#ifdef KDEBUG_GC
+#include <stdio.h>
+#endif
 
 #include "kstring.h"
 #include "kobject.h"
@@ -15,7 +19,73 @@
 #include "kmem.h"
 #include "kgc.h"
 
-/* for immutable string/symbols/bytevector table */
+/*
+** Resizing of the immutable string/symbols/bytevector table
+** To avoid long pauses with big tables, the elements are moved to the
+** new array incrementally: while a resize is in progress both arrays are 
+** kept and the elements that haven't been moved yet are in oldhash. 
+** A few buckets are moved on each addition to the table, and the bucket
+** corresponding to a hash is moved before looking for that hash, so that 
+** searches only need to look in the new array.
+*/
+
+/* imm string, imm bytevectors & symbols aren't chained with 
+   all other objs, but with each other in strt */
+static inline uint32_t get_strt_hash(GCObject *p)
+{
+    klisp_assert(p->gch.tt == K_TKEYWORD || p->gch.tt == K_TSYMBOL || 
+                 p->gch.tt == K_TSTRING || p->gch.tt == K_TBYTEVECTOR);
+
+    switch(p->gch.tt) {
+    case K_TSYMBOL:
+        return ((Symbol *) p)->hash;
+    case K_TSTRING:
+        return ((String *) p)->hash;
+    case K_TBYTEVECTOR:
+        return ((Bytevector *) p)->hash;
+    case K_TKEYWORD:
+        return ((Keyword *) p)->hash;
+    default:
+        klisp_assert(0);
+        return 0;
+    }
+}
+
+/* move all elements in bucket i of the old array to the new array */
+static void move_bucket(stringtable *tb, int32_t i)
+{
+    GCObject *p = tb->oldhash[i];
+    while (p) {  /* for each node in the list */
+        GCObject *next = p->gch.next;  /* save next */
+        uint32_t h = get_strt_hash(p);
+        int32_t h1 = lmod(h, tb->size);  /* new position */
+        klisp_assert((int32_t) (h%tb->size) == lmod(h, tb->size));
+        p->gch.next = tb->hash[h1];  /* chain it */
+        tb->hash[h1] = p;
+        p = next;
+    }
+    tb->oldhash[i] = NULL;
+}
+
+/* move at most n buckets of a resize in progress, this doesn't allocate */
+void klispS_rehash_step (klisp_State *K, int32_t n)
+{
+    stringtable *tb = &G(K)->strt;
+    if (tb->oldhash == NULL || G(K)->gcstate == GCSsweepstring)
+        return; /* nothing to do or in the middle of a GC traverse */
+
+    while (n-- > 0 && tb->rehashidx < tb->oldsize)
+        move_bucket(tb, tb->rehashidx++);
+
+    if (tb->rehashidx >= tb->oldsize) { /* done */
+        klispM_freearray(K, tb->oldhash, tb->oldsize, GCObject *);
+        tb->oldhash = NULL;
+        tb->oldsize = 0;
+        tb->rehashidx = 0;
+    }
+}
+
+/* start a resize of the table, any pending resize is finished first */
 void klispS_resize (klisp_State *K, int32_t newsize)
 {
     GCObject **newhash;
@@ -23,45 +93,143 @@ void klispS_resize (klisp_State *K, int32_t newsize)
     int32_t i;
     if (G(K)->gcstate == GCSsweepstring)
         return;  /* cannot resize during GC traverse */
-    newhash = klispM_newvector(K, newsize, GCObject *);
     tb = &G(K)->strt;
-    for (i = 0; i < newsize; i++) newhash[i] = NULL;
-    /* rehash */
-    for (i = 0; i < tb->size; i++) {
-        GCObject *p = tb->hash[i];
-        while (p) {  /* for each node in the list */
-            /* imm string, imm bytevectors & symbols aren't chained with 
-               all other objs, but with each other in strt */
-            GCObject *next = p->gch.next;  /* save next */
-            uint32_t h = 0;
-            klisp_assert(p->gch.tt == K_TKEYWORD || p->gch.tt == K_TSYMBOL || 
-                         p->gch.tt == K_TSTRING || p->gch.tt == K_TBYTEVECTOR);
-
-            switch(p->gch.tt) {
-            case K_TSYMBOL:
-                h = ((Symbol *) p)->hash;
-                break;
-            case K_TSTRING:
-                h = ((String *) p)->hash;
-                break;
-            case K_TBYTEVECTOR:
-                h = ((Bytevector *) p)->hash;
-                break;
-            case K_TKEYWORD:
-                h = ((Keyword *) p)->hash;
-                break;
-            }
-
-            int32_t h1 = lmod(h, newsize);  /* new position */
-            klisp_assert((int32_t) (h%newsize) == lmod(h, newsize));
-            p->gch.next = newhash[h1];  /* chain it */
-            newhash[h1] = p;
-            p = next;
+    klispS_rehash_step(K, tb->oldsize);
+    klisp_assert(tb->oldhash == NULL);
+#ifdef KDEBUG_GC
+    {
+        /* chain length statistics, to check the quality of the hash */
+        int32_t used = 0, max_chain = 0;
+        for (i = 0; i < tb->size; i++) {
+            int32_t chain = 0;
+            for (GCObject *p = tb->hash[i]; p != NULL; p = p->gch.next)
+                ++chain;
+            if (chain > 0)
+                ++used;
+            if (chain > max_chain)
+                max_chain = chain;
         }
+        printf("STRT RESIZE, size: %d, elements: %d, used buckets: %d, "
+               "longest chain: %d\n", tb->size, tb->nuse, used, max_chain);
     }
-    klispM_freearray(K, tb->hash, tb->size, GCObject *);
+#endif
+    newhash = klispM_newvector(K, newsize, GCObject *);
+    for (i = 0; i < newsize; i++) newhash[i] = NULL;
+    /* the elements will be moved later (see klispS_rehash_step) */
+    tb->oldhash = tb->hash;
+    tb->oldsize = tb->size;
+    tb->rehashidx = 0;
     tb->size = newsize;
     tb->hash = newhash;
+    /* this frees the old array if it was empty */
+    klispS_rehash_step(K, 0);
+}
+
+/* sets chains[0] to the chain where an element with hash h should be, 
+   and chains[1] to the bucket of the old array if a resize is in 
+   progress and it can't be moved now (or NULL) */
+void klispS_chains (klisp_State *K, uint32_t h, GCObject **chains)
+{
+    stringtable *tb = &G(K)->strt;
+    chains[1] = NULL;
+    if (tb->oldhash != NULL) {
+        int32_t i = lmod(h, tb->oldsize);
+        if (G(K)->gcstate == GCSsweepstring)
+            /* in the middle of a GC traverse, moving the elements to 
+               buckets that were already swept would skip them */
+            chains[1] = tb->oldhash[i];
+        else
+            move_bucket(tb, i);
+    }
+    chains[0] = tb->hash[lmod(h, tb->size)];
+}
+
+/* add a new element to the table, this may allocate, so o should be
+   rooted */
+void klispS_add (klisp_State *K, GCObject *o, uint32_t h)
+{
+    stringtable *tb = &G(K)->strt;
+    h = lmod(h, tb->size);
+    o->gch.next = tb->hash[h];  /* chain new entry */
+    tb->hash[h] = o;
+    tb->nuse++;
+    klispS_rehash_step(K, STRTREHASHSTEP);
+    if (tb->nuse > ((uint32_t) tb->size) && tb->size <= INT32_MAX / 2)
+        klispS_resize(K, tb->size*2);  /* too crowded */
+}
+
+/*
+** Hash function for immutable strings, symbols, keywords & bytevectors
+** SOURCE NOTE: This is xxHash32 by Yann Collet. Unlike the sampled lua
+** hash, all bytes are hashed so that long strings sharing prefixes
+** and suffixes don't collide. The seed is randomized per state (see
+** klisp_newstate) to make it difficult to force collisions.
+*/
+#define KHASH_PRIME1 UINT32_C(0x9E3779B1)
+#define KHASH_PRIME2 UINT32_C(0x85EBCA77)
+#define KHASH_PRIME3 UINT32_C(0xC2B2AE3D)
+#define KHASH_PRIME4 UINT32_C(0x27D4EB2F)
+#define KHASH_PRIME5 UINT32_C(0x165667B1)
+
+#define khash_rotl(x_, r_) (((x_) << (r_)) | ((x_) >> (32 - (r_))))
+
+/* NOTE: memcpy avoids unaligned reads, it is optimized away by gcc */
+static inline uint32_t khash_read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v; /* XXX only little endian for now (see kobject.h) */
+}
+
+static inline uint32_t khash_round(uint32_t acc, uint32_t input)
+{
+    acc += input * KHASH_PRIME2;
+    acc = khash_rotl(acc, 13);
+    return acc * KHASH_PRIME1;
+}
+
+uint32_t klispS_hash(const void *buf, uint32_t size, uint32_t seed)
+{
+    const uint8_t *p = (const uint8_t *) buf;
+    const uint8_t *end = p + size;
+    uint32_t h;
+
+    if (size >= 16) {
+        const uint8_t *limit = end - 16;
+        uint32_t v1 = seed + KHASH_PRIME1 + KHASH_PRIME2;
+        uint32_t v2 = seed + KHASH_PRIME2;
+        uint32_t v3 = seed;
+        uint32_t v4 = seed - KHASH_PRIME1;
+        do {
+            v1 = khash_round(v1, khash_read32(p)); p += 4;
+            v2 = khash_round(v2, khash_read32(p)); p += 4;
+            v3 = khash_round(v3, khash_read32(p)); p += 4;
+            v4 = khash_round(v4, khash_read32(p)); p += 4;
+        } while (p <= limit);
+        h = khash_rotl(v1, 1) + khash_rotl(v2, 7) + khash_rotl(v3, 12) + 
+            khash_rotl(v4, 18);
+    } else {
+        h = seed + KHASH_PRIME5;
+    }
+
+    h += size;
+
+    for (; p + 4 <= end; p += 4) {
+        h += khash_read32(p) * KHASH_PRIME3;
+        h = khash_rotl(h, 17) * KHASH_PRIME4;
+    }
+    for (; p < end; p++) {
+        h += (*p) * KHASH_PRIME5;
+        h = khash_rotl(h, 11) * KHASH_PRIME1;
+    }
+
+    /* final mix */
+    h ^= h >> 15;
+    h *= KHASH_PRIME2;
+    h ^= h >> 13;
+    h *= KHASH_PRIME3;
+    h ^= h >> 16;
+    return h;
 }
 
 /* General constructor for strings */
@@ -76,16 +244,10 @@ TValue kstring_new_bs_g(klisp_State *K, bool m, const char *buf,
 ** Constructors for immutable strings
 */
 
-static uint32_t get_string_hash(const char *buf, uint32_t size)
+static inline uint32_t get_string_hash(klisp_State *K, const char *buf, 
+                                       uint32_t size)
 {
-    uint32_t h = size; /* seed */
-    size_t step = (size>>5)+1; /* if string is too long, don't hash all 
-                                  its chars */
-    size_t size1;
-    for (size1 = size; size1 >= step; size1 -= step)  /* compute hash */
-        h = h ^ ((h<<5)+(h>>2)+ ((unsigned char) buf[size1-1]));
-
-    return h;
+    return klispS_hash(buf, size, G(K)->seed);
 }
 
 /* Looks for a string in the stringtable and returns a pointer
@@ -93,20 +255,24 @@ static uint32_t get_string_hash(const char *buf, uint32_t size)
 static String *search_in_string_table(klisp_State *K, const char *buf,
 				      uint32_t size, uint32_t h)
 {
-    for (GCObject *o = G(K)->strt.hash[lmod(h, G(K)->strt.size)];
-         o != NULL; o = o->gch.next) {
-        klisp_assert(o->gch.tt == K_TKEYWORD || o->gch.tt == K_TSYMBOL || 
-                     o->gch.tt == K_TSTRING || o->gch.tt == K_TBYTEVECTOR);
-
-        if (o->gch.tt != K_TSTRING) continue;
-
-        String *ts = (String *) o;
-        if (ts->size == size && (memcmp(buf, ts->b, size) == 0)) {
-            /* string may be dead */
-            if (isdead(G(K), o)) changewhite(o);
-            return ts;
-        }
-    } 
+    GCObject *chains[2];
+    klispS_chains(K, h, chains);
+    for (int32_t i = 0; i < 2; i++) {
+        for (GCObject *o = chains[i]; o != NULL; o = o->gch.next) {
+            klisp_assert(o->gch.tt == K_TKEYWORD || o->gch.tt == K_TSYMBOL || 
+                         o->gch.tt == K_TSTRING || o->gch.tt == K_TBYTEVECTOR);
+
+            if (o->gch.tt != K_TSTRING) continue;
+
+            String *ts = (String *) o;
+            if (ts->hash == h && ts->size == size && 
+                (memcmp(buf, ts->b, size) == 0)) {
+                /* string may be dead */
+                if (isdead(G(K), o)) changewhite(o);
+                return ts;
+            }
+        } 
+    }
 
     /* If it exits the loop, it means it wasn't found */
     return NULL;
@@ -116,7 +282,7 @@ static String *search_in_string_table(klisp_State *K, const char *buf,
 /* main constructor for immutable strings */
 TValue kstring_new_bs_imm(klisp_State *K, const char *buf, uint32_t size)
 {
-    uint32_t h = get_string_hash(buf, size);
+    uint32_t h = get_string_hash(K, buf, size);
     
     /* first check to see if it's in the stringtable */
     String *new_str  = search_in_string_table(K, buf, size, h);
@@ -147,18 +313,10 @@ TValue kstring_new_bs_imm(klisp_State *K, const char *buf, uint32_t size)
     new_str->b[size] = '\0'; /* final 0 for printing */
 
     /* add to the string/symbol table (and link it) */
-    stringtable *tb;
-    tb = &G(K)->strt;
-    h = lmod(h, tb->size);
-    new_str->next = tb->hash[h];  /* chain new entry */
-    tb->hash[h] = (GCObject *)(new_str);
-    tb->nuse++;
     TValue ret_tv = gc2str(new_str);
-    if (tb->nuse > ((uint32_t) tb->size) && tb->size <= INT32_MAX / 2) {
-        krooted_tvs_push(K, ret_tv); /* save in case of gc */
-        klispS_resize(K, tb->size*2);  /* too crowded */
-        krooted_tvs_pop(K);
-    }
+    krooted_tvs_push(K, ret_tv); /* save in case of gc */
+    klispS_add(K, (GCObject *) new_str, h);
+    krooted_tvs_pop(K);
     
     return ret_tv;
 }
@@ -233,7 +391,15 @@ bool kstring_equalp(TValue obj1, TValue obj2)
     String *str1 = tv2str(obj1);
     String *str2 = tv2str(obj2);
 
-    if (str1->size == str2->size) {
+    if (str1 == str2) {
+        return true;
+    } else if (kis_immutable(obj1) && kis_immutable(obj2)) {
+        /* all immutable strings are in the string table, so two
+           different ones can't have the same contents */
+        klisp_assert(str1->size != str2->size ||
+                     memcmp(str1->b, str2->b, str1->size) != 0);
+        return false;
+    } else if (str1->size == str2->size) {
         return (str1->size == 0) ||
             (memcmp(str1->b, str2->b, str1->size) == 0);
     } else {
@@ -16,6 +16,15 @@
 
 /* for immutable string table */
 void klispS_resize (klisp_State *K, int32_t newsize);
+void klispS_rehash_step (klisp_State *K, int32_t n);
+/* chains where an element with hash h should be searched (the second
+   one may be NULL) */
+void klispS_chains (klisp_State *K, uint32_t h, GCObject **chains);
+/* add a new element to the table, o should be rooted */
+void klispS_add (klisp_State *K, GCObject *o, uint32_t h);
+/* hash for the immutable string table (strings, symbols, keywords & 
+   bytevectors), seed should be G(K)->seed */
+uint32_t klispS_hash(const void *buf, uint32_t size, uint32_t seed);
 
 /* General constructor for strings */
 TValue kstring_new_bs_g(klisp_State *K, bool m, const char *buf, 
@@ -23,14 +23,9 @@
 ** Interned symbols are only the ones that don't have source info 
 ** (like those created with string->symbol) 
 */
-static uint32_t get_symbol_hash(const char *buf, uint32_t size)
+uint32_t ksymbol_hash(klisp_State *K, const char *buf, uint32_t size)
 {
-    uint32_t h = size; /* seed */
-    size_t step = (size>>5)+1; /* if string is too long, don't hash all 
-                                  its chars */
-    size_t size1;
-    for (size1 = size; size1 >= step; size1 -= step)  /* compute hash */
-        h = h ^ ((h<<5)+(h>>2)+ ((unsigned char) buf[size1-1]));
+    uint32_t h = klispS_hash(buf, size, G(K)->seed);
 
     h = ~h; /* symbol hash should be different from string hash
                otherwise symbols and their respective immutable string
@@ -43,20 +38,24 @@ static uint32_t get_symbol_hash(const char *buf, uint32_t size)
 static Symbol *search_in_symbol_table(klisp_State *K, const char *buf, 
 				      uint32_t size, uint32_t h)
 {
-    for (GCObject *o = G(K)->strt.hash[lmod(h, G(K)->strt.size)];
-         o != NULL; o = o->gch.next) {
-        klisp_assert(o->gch.tt == K_TKEYWORD || o->gch.tt == K_TSYMBOL || 
-  	  	 o->gch.tt == K_TSTRING || o->gch.tt == K_TBYTEVECTOR);
-
-        if (o->gch.tt != K_TSYMBOL) continue;
-
-	String *ts = tv2str(((Symbol *) o)->str);
-	if (ts->size == size && (memcmp(buf, ts->b, size) == 0)) {
-	    /* symbol and/or string may be dead */
-	    if (isdead(G(K), o)) changewhite(o);
-	    if (isdead(G(K), (GCObject *) ts)) changewhite((GCObject *) ts);
-	    return (Symbol *) o;
-	}
+    GCObject *chains[2];
+    klispS_chains(K, h, chains);
+    for (int32_t i = 0; i < 2; i++) {
+        for (GCObject *o = chains[i]; o != NULL; o = o->gch.next) {
+            klisp_assert(o->gch.tt == K_TKEYWORD || o->gch.tt == K_TSYMBOL || 
+                         o->gch.tt == K_TSTRING || o->gch.tt == K_TBYTEVECTOR);
+
+            if (o->gch.tt != K_TSYMBOL || ((Symbol *) o)->hash != h) continue;
+
+            String *ts = tv2str(((Symbol *) o)->str);
+            if (ts->size == size && (memcmp(buf, ts->b, size) == 0)) {
+                /* symbol and/or string may be dead */
+                if (isdead(G(K), o)) changewhite(o);
+                if (isdead(G(K), (GCObject *) ts)) 
+                    changewhite((GCObject *) ts);
+                return (Symbol *) o;
+            }
+        }
     }
 
     /* If it exits the loop, it means it wasn't found */
@@ -66,7 +65,7 @@ static Symbol *search_in_symbol_table(klisp_State *K, const char *buf,
 TValue ksymbol_new_bs(klisp_State *K, const char *buf, uint32_t size, TValue si)
 {
     /* First calculate the hash */
-    uint32_t h = get_symbol_hash(buf, size);
+    uint32_t h = ksymbol_hash(K, buf, size);
   
     /* look for it in the table only if it doesn't have source info */
     if (ttisnil(si)) {
@@ -98,17 +97,9 @@ TValue ksymbol_new_bs(klisp_State *K, const char *buf, uint32_t size, TValue si)
         new_sym->hash = h;
 
         /* add to the string/symbol table (and link it) */
-        stringtable *tb;
-        tb = &G(K)->strt;
-        h = lmod(h, tb->size);
-        new_sym->next = tb->hash[h];  /* chain new entry */
-        tb->hash[h] = (GCObject *)(new_sym);
-        tb->nuse++;
-        if (tb->nuse > ((uint32_t) tb->size) && tb->size <= INT32_MAX / 2) {
-            krooted_tvs_push(K, ret_tv); /* save in case of gc */
-            klispS_resize(K, tb->size*2);  /* too crowded */
-            krooted_tvs_pop(K);
-        }
+        krooted_tvs_push(K, ret_tv); /* save in case of gc */
+        klispS_add(K, (GCObject *) new_sym, h);
+        krooted_tvs_pop(K);
     } else { /* non nil source info */
         /* link it with regular objects and save source info */
         /* header + gc_fields */
@@ -26,6 +26,8 @@ TValue ksymbol_new_bs(klisp_State *K, const char *buf, uint32_t size,
 TValue ksymbol_new_b(klisp_State *K, const char *buf, TValue si);
 /* copies str if not immutable */
 TValue ksymbol_new_str(klisp_State *K, TValue str, TValue si);
+/* the hash of the symbol with name buf (depends on G(K)->seed) */
+uint32_t ksymbol_hash(klisp_State *K, const char *buf, uint32_t size);
 
 #define ksymbol_str(tv_) (tv2sym(tv_)->str)
 #define ksymbol_buf(tv_) (kstring_buf(tv2sym(tv_)->str))
@@ -66,3 +66,69 @@ bool ksystem_isatty(klisp_State *K, TValue port)
 }
 
 #endif /* HAVE_PLATFORM_ISATTY */
+
+#ifndef HAVE_PLATFORM_PROF_TIMER
+
+bool ksystem_start_prof_timer(klisp_State *K, int32_t usecs)
+{
+    UNUSED(K);
+    UNUSED(usecs);
+    return false;
+}
+
+void ksystem_stop_prof_timer(klisp_State *K)
+{
+    UNUSED(K);
+}
+
+#endif /* HAVE_PLATFORM_PROF_TIMER */
+
+#ifndef HAVE_PLATFORM_PROF_CLOCK
+
+#include <time.h>
+
+/* TEMP for now use the processor time */
+uint64_t ksystem_prof_clock(klisp_State *K)
+{
+    UNUSED(K);
+    return (uint64_t) clock() * (1000000000 / CLOCKS_PER_SEC);
+}
+
+#endif /* HAVE_PLATFORM_PROF_CLOCK */
+
+#ifndef HAVE_PLATFORM_MAP_FILE
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* TEMP without mmap, just read the whole file */
+void *ksystem_map_file(klisp_State *K, const char *name, size_t *size)
+{
+    UNUSED(K);
+    FILE *file = fopen(name, "rb");
+    if (file == NULL)
+        return NULL;
+
+    void *p = NULL;
+    long len;
+    if (fseek(file, 0, SEEK_END) == 0 && (len = ftell(file)) > 0 &&
+        fseek(file, 0, SEEK_SET) == 0 && (p = malloc((size_t) len)) != NULL) {
+        if (fread(p, 1, (size_t) len, file) == (size_t) len) {
+            *size = (size_t) len;
+        } else {
+            free(p);
+            p = NULL;
+        }
+    }
+    fclose(file);
+    return p;
+}
+
+void ksystem_unmap_file(klisp_State *K, void *p, size_t size)
+{
+    UNUSED(K);
+    UNUSED(size);
+    free(p);
+}
+
+#endif /* HAVE_PLATFORM_MAP_FILE */
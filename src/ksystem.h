@@ -12,6 +12,17 @@
 TValue ksystem_current_jiffy(klisp_State *K);
 TValue ksystem_jiffies_per_second(klisp_State *K);
 bool ksystem_isatty(klisp_State *K, TValue port);
+/* profiler timer, sets klispP_sample_pending every usecs microseconds
+   of cpu time, start returns false if not available */
+bool ksystem_start_prof_timer(klisp_State *K, int32_t usecs);
+void ksystem_stop_prof_timer(klisp_State *K);
+/* a monotonic clock in nanoseconds, for measuring intervals */
+uint64_t ksystem_prof_clock(klisp_State *K);
+/* maps the contents of the file in memory (for heap images, see kimage.h),
+   writes to the memory are private and aren't saved to the file, returns
+   NULL on error */
+void *ksystem_map_file(klisp_State *K, const char *name, size_t *size);
+void ksystem_unmap_file(klisp_State *K, void *p, size_t size);
 
 #endif
 
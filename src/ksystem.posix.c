@@ -6,16 +6,27 @@
 
 #include <stdio.h>
 #include <sys/time.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "kobject.h"
 #include "kstate.h"
 #include "kinteger.h"
 #include "kport.h"
 #include "ksystem.h"
+#include "kprofile.h"
 
 /* declare implemented functionality */
 
 #define HAVE_PLATFORM_JIFFIES
 #define HAVE_PLATFORM_ISATTY
+#define HAVE_PLATFORM_PROF_TIMER
+#define HAVE_PLATFORM_PROF_CLOCK
+#define HAVE_PLATFORM_MAP_FILE
 
 /* jiffies */
 
@@ -51,3 +62,102 @@ bool ksystem_isatty(klisp_State *K, TValue port)
     return ttisfport(port) && kport_is_open(port)
         && isatty(fileno(kfport_file(port)));
 }
+
+/* profiler timer */
+
+/* the handler should do as little as possible, the sample is taken
+   later by klispT_run (see kprofile.h) */
+static void prof_handler(int sig)
+{
+    UNUSED(sig);
+    klispP_sample_pending = 1;
+}
+
+static bool prof_timer_on = false;
+static struct sigaction prof_old_action;
+
+bool ksystem_start_prof_timer(klisp_State *K, int32_t usecs)
+{
+    UNUSED(K);
+    klisp_assert(!prof_timer_on);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = prof_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+#ifdef SA_RESTART
+    /* the timer only counts cpu time, but don't interrupt io anyways */
+    sa.sa_flags |= SA_RESTART;
+#endif
+    if (sigaction(SIGPROF, &sa, &prof_old_action) != 0)
+        return false;
+
+    struct itimerval it;
+    it.it_interval.tv_sec = usecs / 1000000;
+    it.it_interval.tv_usec = usecs % 1000000;
+    it.it_value = it.it_interval;
+    if (setitimer(ITIMER_PROF, &it, NULL) != 0) {
+        sigaction(SIGPROF, &prof_old_action, NULL);
+        return false;
+    }
+    prof_timer_on = true;
+    return true;
+}
+
+void ksystem_stop_prof_timer(klisp_State *K)
+{
+    UNUSED(K);
+    if (!prof_timer_on)
+        return;
+
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, NULL);
+    sigaction(SIGPROF, &prof_old_action, NULL);
+    prof_timer_on = false;
+}
+
+uint64_t ksystem_prof_clock(klisp_State *K)
+{
+    UNUSED(K);
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    /* TEMP: see ksystem_current_jiffy */
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000000 + (uint64_t) tv.tv_usec * 1000;
+}
+
+/* file mapping */
+
+void *ksystem_map_file(klisp_State *K, const char *name, size_t *size)
+{
+    UNUSED(K);
+    int fd = open(name, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    void *p = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        p = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, 
+                 MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+            p = NULL;
+        else
+            *size = (size_t) st.st_size;
+    }
+    /* the mapping stays valid after closing the file */
+    close(fd);
+    return p;
+}
+
+void ksystem_unmap_file(klisp_State *K, void *p, size_t size)
+{
+    UNUSED(K);
+    munmap(p, size);
+}
@@ -38,6 +38,9 @@
 #include "kapplicative.h"
 #include "kghelpers.h" /* for eq2p */
 #include "kstring.h"
+#include "kbytevector.h"
+#include "kvector.h"
+#include "kpair.h"
 
 /*
 ** max size of array part is 2^MAXBITS
@@ -45,11 +48,18 @@
 #define MAXBITS		26
 #define MAXASIZE	(1 << MAXBITS)
 
+/*
+** tables with less than this many slots are never shrunk
+*/
+#define MINSHRINKSIZE	64
+
 
 #define hashpow2(t,n)         (gnode(t, lmod((n), sizenode(t))))
   
 #define hashstr(t,str)  hashpow2(t, (str)->hash)
 #define hashsym(t,sym)  hashpow2(t, (sym)->hash)
+#define hashbb(t,bb)  hashpow2(t, (bb)->hash)
+#define hashkeyw(t,keyw)  hashpow2(t, (keyw)->hash)
 #define hashboolean(t,p)           hashpow2(t, p? 1 : 0)
 
 
@@ -62,9 +72,9 @@
 
 #define hashpointer(t,p)	hashmod(t, IntPoint(p))
 
-#define dummynode		(&dummynode_)
+#define dummynode		klispH_dummynode
 
-static const Node dummynode_ = {
+const Node klispH_dummynode_ = {
     .i_val = KFREE_,
     .i_key = { .nk = { .this = KFREE_, .next = NULL}} 
 };
@@ -90,11 +100,117 @@ static Node *hashbigint (const Table *t, Bigint *b) {
     return hashmod(t, n);
 }
 
+/*
+** Structural hash, for tables compared with equal? & string=?
+** Objects that are equal? should have the same hash, so strings and
+** bytevectors are hashed by contents (whether they are immutable or not),
+** using the same hash as the string table, so that the hash cached in
+** immutable (interned) strings & bytevectors can be used, and pairs &
+** vectors by the hash of their elements. To avoid looping in cyclic
+** structures (and long times with big ones), only the first KHASHBUDGET
+** objects found in a depth first traversal are considered.
+*/
+#define KHASHBUDGET 32
+
+#define hashcombine(h, n) ((h) ^ ((n) + 0x9e3779b9u + ((h) << 6) + ((h) >> 2)))
+
+static uint32_t hashequal (klisp_State *K, TValue key, int32_t *budget) 
+{
+    if (*budget <= 0) /* don't look any further */
+        return ttype(key);
+    --(*budget);
+
+    switch (ttype(key)) {
+    case K_TNIL:
+    case K_TIGNORE:
+    case K_TINERT:
+    case K_TEOF:
+    case K_TFIXINT:
+    case K_TEINF:
+        return (uint32_t) ivalue(key);
+    case K_TCHAR:
+        return (uint32_t) chvalue(key);
+    case K_TBOOLEAN:
+        return bvalue(key)? 1 : 0;
+    case K_TBIGINT: {
+        Bigint *b = tv2bigint(key);
+        uint32_t n = (b->sign == 0)? 0 : 1;
+        for (uint32_t i = 0; i < b->used; i++) 
+            n += b->digits[i];
+        return n;
+    }
+    case K_TBIGRAT: /* these are eq? if they have the same value */
+        return K_TBIGRAT;
+    case K_TDOUBLE: 
+        return (uint32_t) (key.raw ^ (key.raw >> 32));
+    case K_TSTRING:
+        return kstring_immutablep(key)? tv2str(key)->hash :
+            klispS_hash(kstring_buf(key), kstring_size(key), G(K)->seed);
+    case K_TBYTEVECTOR: {
+        uint32_t h = kbytevector_immutablep(key)? tv2bytevector(key)->hash :
+            klispS_hash(kbytevector_buf(key), kbytevector_size(key), 
+                        G(K)->seed);
+        /* don't collide with strings with the same contents */
+        return hashcombine(K_TBYTEVECTOR, h);
+    }
+    case K_TSYMBOL:
+        return tv2sym(key)->hash;
+    case K_TKEYWORD:
+        return tv2keyw(key)->hash;
+    case K_TPAIR: {
+        uint32_t h = K_TPAIR;
+        while(ttispair(key) && *budget > 0) {
+            h = hashcombine(h, hashequal(K, kcar(key), budget));
+            key = kcdr(key);
+        }
+        return hashcombine(h, hashequal(K, key, budget));
+    }
+    case K_TVECTOR: {
+        uint32_t size = kvector_size(key);
+        TValue *array = kvector_buf(key);
+        uint32_t h = hashcombine(K_TVECTOR, size);
+        for (uint32_t i = 0; i < size && *budget > 0; i++)
+            h = hashcombine(h, hashequal(K, array[i], budget));
+        return h;
+    }
+    case K_TUSER:
+        return IntPoint(pvalue(key));
+    case K_TAPPLICATIVE: 
+        while(ttisapplicative(key)) {
+            key = kunwrap(key);
+        }
+        /* fall through */
+    default:
+        return IntPoint(gcvalue(key));
+    }
+}
+
+uint32_t klispH_equalhash (klisp_State *K, TValue key)
+{
+    int32_t budget = KHASHBUDGET;
+    return hashequal(K, key, &budget);
+}
+
 /*
 ** returns the `main' position of an element in a table (that is, the index
 ** of its hash value)
 */
-static Node *mainposition (const Table *t, TValue key) {
+static Node *mainposition (klisp_State *K, const Table *t, TValue key) {
+    if (t->kind != K_TABLE_EQ) {
+        /* only these are compared differently than with eq?, the rest
+           should go to the same place as in eq? tables (see klispH_get) */
+        switch (ttype(key)) {
+        case K_TSTRING:
+            return hashmod(t, klispH_equalhash(K, key));
+        case K_TBYTEVECTOR:
+        case K_TPAIR:
+        case K_TVECTOR:
+            if (t->kind == K_TABLE_EQUAL)
+                return hashmod(t, klispH_equalhash(K, key));
+            break;
+        }
+    }
+
     switch (ttype(key)) {
     case K_TNIL:
     case K_TIGNORE:
@@ -116,6 +232,14 @@ static Node *mainposition (const Table *t, TValue key) {
             return hashpointer(t, gcvalue(key));
     case K_TSYMBOL:
         return hashsym(t, tv2sym(key));
+    case K_TBYTEVECTOR:
+        /* immutable bytevectors are interned, like immutable strings */
+        if (kbytevector_immutablep(key))
+            return hashbb(t, tv2bytevector(key));
+        else 
+            return hashpointer(t, gcvalue(key));
+    case K_TKEYWORD:
+        return hashkeyw(t, tv2keyw(key));
     case K_TUSER:
         return hashpointer(t, pvalue(key));
     case K_TAPPLICATIVE: 
@@ -154,7 +278,7 @@ static int32_t findindex (klisp_State *K, Table *t, TValue key)
     if (0 <= i && i < t->sizearray)  /* is `key' inside array part? */
         return i;  /* yes; that's the index */
     else {
-        Node *n = mainposition(t, key);
+        Node *n = mainposition(K, t, key);
         do {  /* check whether `key' is somewhere in the chain */
             /* key may be dead already, but it is ok to use it in `next' */
 /* klisp: i'm not so sure about this... */
@@ -223,11 +347,13 @@ static int32_t computesizes (int32_t nums[], int32_t *narray)
 }
 
 
+/* klisp: array indexes start at 0, so key k is counted as if it were
+   k+1 in lua (nums is also used that way in numusearray) */
 static int32_t countint (const TValue key, int32_t *nums) 
 {
     int32_t k = arrayindex(key);
-    if (0 < k && k <= MAXASIZE) {  /* is `key' an appropriate array index? */
-        nums[ceillog2(k)]++;  /* count as such */
+    if (0 <= k && k < MAXASIZE) {  /* is `key' an appropriate array index? */
+        nums[ceillog2(k+1)]++;  /* count as such */
         return 1;
     }
     else
@@ -348,6 +474,7 @@ static void resize (klisp_State *K, Table *t, int32_t nasize, int32_t nhsize)
     }
     if (nold != dummynode)
         klispM_freearray(K, nold, twoto(oldhsize), Node);  /* free old array */
+    t->nremoved = 0;
 }
 
 
@@ -358,6 +485,7 @@ void klispH_resizearray (klisp_State *K, Table *t, int32_t nasize)
 }
 
 
+/* klisp: ek may be free if there is no extra key, see klispH_remove */
 static void rehash (klisp_State *K, Table *t, const TValue ek) {
     int32_t nasize, na;
     int32_t nums[MAXBITS+1];  /* nums[i] = number of keys between 2^(i-1) and 2^i */
@@ -368,8 +496,10 @@ static void rehash (klisp_State *K, Table *t, const TValue ek) {
     totaluse = nasize;  /* all those keys are integer keys */
     totaluse += numusehash(t, nums, &nasize);  /* count keys in hash part */
     /* count extra key */
-    nasize += countint(ek, nums);
-    totaluse++;
+    if (!ttisfree(ek)) {
+        nasize += countint(ek, nums);
+        totaluse++;
+    }
     /* compute new size for array part */
     na = computesizes(nums, &nasize);
     /* resize the table to new computed sizes */
@@ -382,17 +512,31 @@ static void rehash (klisp_State *K, Table *t, const TValue ek) {
 ** }=============================================================
 */
 
-/* wflags should be either or both of K_FLAG_WEAK_KEYS or K_FLAG_WEAK VALUES */
+/* wflags should be either or both of K_FLAG_WEAK_KEYS or K_FLAG_WEAK VALUES,
+   or K_FLAG_WEAK_KEYS | K_FLAG_EPHEMERON */
 TValue klispH_new (klisp_State *K, int32_t narray, int32_t nhash, 
                    int32_t wflags)  
 {
-    klisp_assert((wflags & (K_FLAG_WEAK_KEYS | K_FLAG_WEAK_VALUES)) ==
-                 wflags);
+    return klispH_newkind(K, narray, nhash, wflags, K_TABLE_EQ);
+}
+
+/* kind should be one of K_TABLE_EQ, K_TABLE_EQUAL or K_TABLE_STRING */
+TValue klispH_newkind (klisp_State *K, int32_t narray, int32_t nhash, 
+                       int32_t wflags, int32_t kind)
+{
+    klisp_assert((wflags & (K_FLAG_WEAK_KEYS | K_FLAG_WEAK_VALUES | 
+                            K_FLAG_EPHEMERON)) == wflags);
+    klisp_assert((wflags & K_FLAG_EPHEMERON) == 0 || 
+                 wflags == (K_FLAG_WEAK_KEYS | K_FLAG_EPHEMERON));
+    klisp_assert(kind == K_TABLE_EQ || kind == K_TABLE_EQUAL || 
+                 kind == K_TABLE_STRING);
     Table *t = klispM_new(K, Table);
     klispC_link(K, (GCObject *) t, K_TTABLE, wflags);
+    t->kind = (uint8_t) kind;
     /* temporary values (kept only if some malloc fails) */
     t->array = NULL;
     t->sizearray = 0;
+    t->nremoved = 0;
     t->lsizenode = 0;
     t->node = cast(Node *, dummynode);
     /* root in case gc is run while allocating array or nodes */
@@ -434,7 +578,7 @@ static Node *getfreepos (Table *t)
 */
 static TValue *newkey (klisp_State *K, Table *t, TValue key) 
 {
-    Node *mp = mainposition(t, key);
+    Node *mp = mainposition(K, t, key);
     if (!ttisfree(gval(mp)) || mp == dummynode) {
         Node *othern;
         Node *n = getfreepos(t);  /* get a free place */
@@ -443,7 +587,7 @@ static TValue *newkey (klisp_State *K, Table *t, TValue key)
             return klispH_set(K, t, key);  /* re-insert key into grown table */
         }
         klisp_assert(n != dummynode);
-        othern = mainposition(t, key2tval(mp));
+        othern = mainposition(K, t, key2tval(mp));
         if (othern != mp) {  /* is colliding node out of its main position? */
             /* yes; move colliding node into free position */
             while (gnext(othern) != mp) othern = gnext(othern);  /* find previous */
@@ -489,6 +633,7 @@ const TValue *klispH_getfixint (Table *t, int32_t key)
 */
 const TValue *klispH_getstr (Table *t, String *key) {
     klisp_assert(kstring_immutablep(gc2str(key)));
+    klisp_assert(t->kind == K_TABLE_EQ);
     Node *n = hashstr(t, key);
     do {  /* check whether `key' is somewhere in the chain */
         if (ttisstring(gkey(n)->this) && tv2str(gkey(n)->this) == key)
@@ -514,25 +659,52 @@ const TValue *klispH_getsym (Table *t, Symbol *key) {
 }
 
 
+/*
+** compare keys with the equivalence predicate of the table
+*/
+static inline bool keyequal (klisp_State *K, const Table *t, TValue k1, 
+                             TValue k2)
+{
+    switch(t->kind) {
+    case K_TABLE_EQUAL:
+        /* equal? is only different for these, and it's a lot more 
+           expensive than eq? */
+        if (ttype(k1) != ttype(k2))
+            break;
+        else if (ttisstring(k1))
+            return kstring_equalp(k1, k2);
+        else if (ttisbytevector(k1))
+            return kbytevector_equalp(K, k1, k2);
+        else if (ttispair(k1) || ttisvector(k1))
+            return equal2p(K, k1, k2);
+        break;
+    case K_TABLE_STRING:
+        if (ttisstring(k1) && ttisstring(k2))
+            return kstring_equalp(k1, k2);
+        break;
+    }
+    /* XXX: for some reason eq2p takes klisp_State but 
+       doesn't use it */
+    return eq2p(K, k1, k2);
+}
+
 /*
 ** main search function
 */
-const TValue *klispH_get (Table *t, TValue key) 
+const TValue *klispH_get (klisp_State *K, Table *t, TValue key) 
 {
     switch (ttype(key)) {
     case K_TFREE: return &kfree;
     case K_TSYMBOL: return klispH_getsym(t, tv2sym(key));
     case K_TFIXINT: return klispH_getfixint(t, ivalue(key));
     case K_TSTRING: 
-        if (kstring_immutablep(key))
+        if (t->kind == K_TABLE_EQ && kstring_immutablep(key))
             return klispH_getstr(t, tv2str(key));
         /* else fall through */
     default: {
-        Node *n = mainposition(t, key);
+        Node *n = mainposition(K, t, key);
         do {  /* check whether `key' is somewhere in the chain */
-            /* XXX: for some reason eq2p takes klisp_State but 
-               doesn't use it */
-            if (eq2p((klisp_State *)NULL, key2tval(n), key))
+            if (!ttisfree(gkey(n)->this) && keyequal(K, t, key2tval(n), key))
                 return &gval(n);  /* that's it */
             else n = gnext(n);
         } while (n);
@@ -544,7 +716,7 @@ const TValue *klispH_get (Table *t, TValue key)
 
 TValue *klispH_set (klisp_State *K, Table *t, TValue key) 
 {
-    const TValue *p = klispH_get(t, key);
+    const TValue *p = klispH_get(K, t, key);
     if (p != &kfree)
         return cast(TValue *, p);
     else {
@@ -572,6 +744,7 @@ TValue *klispH_setfixint (klisp_State *K, Table *t, int32_t key)
 TValue *klispH_setstr (klisp_State *K, Table *t, String *key)
 {
     klisp_assert(kstring_immutablep(gc2str(key)));
+    klisp_assert(t->kind == K_TABLE_EQ);
     const TValue *p = klispH_getstr(t, key);
     if (p != &kfree)
         return cast(TValue *, p);
@@ -592,6 +765,33 @@ TValue *klispH_setsym (klisp_State *K, Table *t, Symbol *key)
 }
 
 
+/*
+** Removes the binding of key, if any. Returns true if it was present.
+** klisp: The table is shrunk if it is mostly empty. To avoid counting
+** the elements on each removal, this is only checked after a number
+** of removals proportional to the size of the table.
+*/
+bool klispH_remove (klisp_State *K, Table *t, TValue key)
+{
+    TValue *p = cast(TValue *, klispH_get(K, t, key));
+    if (p == &kfree || ttisfree(*p))
+        return false;
+    *p = KFREE; /* the key itself stays until the next rehash */
+
+    int32_t size = t->sizearray + 
+        ((t->node == dummynode)? 0 : sizenode(t));
+    if (size >= MINSHRINKSIZE && ++t->nremoved >= size/4) {
+        /* count again only after another size/4 removals, so that 
+           the check is amortized O(1) */
+        if (klispH_numuse(t) < size/4)
+            rehash(K, t, KFREE);
+        else
+            t->nremoved = 0;
+    }
+    return true;
+}
+
+
 /* klisp: Untested, may have off by one errors, check before using */
 static int32_t unbound_search (Table *t, int32_t j) {
     int32_t i = j;  /* i -1 or a present index */
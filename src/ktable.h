@@ -22,16 +22,29 @@
 
 #define key2tval(n)	((n)->i_key.tvk)
 
+/* the empty hash part shared by all tables without one */
+extern const Node klispH_dummynode_;
+#define klispH_dummynode (cast(Node *, &klispH_dummynode_))
+
+/* equivalence predicate used to compare keys */
+#define K_TABLE_EQ 0 /* eq? */
+#define K_TABLE_EQUAL 1 /* equal? */
+#define K_TABLE_STRING 2 /* string=?, all keys should be strings */
+
 const TValue *klispH_getfixint (Table *t, int32_t key);
 TValue *klispH_setfixint (klisp_State *K, Table *t, int32_t key);
 const TValue *klispH_getstr (Table *t, String *key);
 TValue *klispH_setstr (klisp_State *K, Table *t, String *key);
 const TValue *klispH_getsym (Table *t, Symbol *key);
 TValue *klispH_setsym (klisp_State *K, Table *t, Symbol *key);
-const TValue *klispH_get (Table *t, TValue key);
+const TValue *klispH_get (klisp_State *K, Table *t, TValue key);
 TValue *klispH_set (klisp_State *K, Table *t, TValue key);
+bool klispH_remove (klisp_State *K, Table *t, TValue key);
 TValue klispH_new (klisp_State *K, int32_t narray, int32_t nhash, 
                    int32_t wflags);
+TValue klispH_newkind (klisp_State *K, int32_t narray, int32_t nhash, 
+                       int32_t wflags, int32_t kind);
+uint32_t klispH_equalhash (klisp_State *K, TValue key);
 void klispH_resizearray (klisp_State *K, Table *t, int32_t nasize);
 void klispH_free (klisp_State *K, Table *t);
 int32_t klispH_next (klisp_State *K, Table *t, TValue *key, TValue *data);
@@ -150,11 +150,11 @@ void ktok_error_g(klisp_State *K, char *str, bool extra, TValue extra_value)
     TValue irritants;
     if (extra) {
         krooted_tvs_push(K, extra_value); /* will be popped by throw */
-        TValue si = ktok_get_source_info(K);
+        TValue si = kexpand_si(K, ktok_get_source_info(K));
         krooted_tvs_push(K, si); /* will be popped by throw */
         irritants = klist_g(K, false, 2, si, extra_value);
     } else {
-        irritants = ktok_get_source_info(K);
+        irritants = kexpand_si(K, ktok_get_source_info(K));
     }
     krooted_tvs_push(K, irritants); /* will be popped by throw */
     klispE_throw_with_irritants(K, str, irritants);
@@ -290,21 +290,25 @@ void ktok_save_source_info(klisp_State *K)
     K->ktok_source_info.saved_col = K->ktok_source_info.col;
 }
 
+/* this returns the compact form if possible (see kstate.h), it should
+   be expanded with kexpand_si before showing it to the user */
 TValue ktok_get_source_info(klisp_State *K)
 {
-    /* TEMP: for now, lines and column names are fixints */
-    TValue pos = kcons(K, i2tv(K->ktok_source_info.saved_line),
-                       i2tv(K->ktok_source_info.saved_col));
-    krooted_tvs_push(K, pos);
     /* the filename is rooted in the port */
-    TValue res = kcons(K, K->ktok_source_info.filename, pos);
-    krooted_tvs_pop(K);
-    return res;
+    return klispT_make_si(K, K->ktok_source_info.filename, 
+                          K->ktok_source_info.file_id,
+                          K->ktok_source_info.saved_line,
+                          K->ktok_source_info.saved_col);
 }
 
 void ktok_set_source_info(klisp_State *K, TValue filename, int32_t line,
                           int32_t col)
 {
+    /* this is called on every read, avoid the search if possible */
+    if (!tv_equal(filename, K->ktok_source_info.filename) ||
+        K->ktok_source_info.file_id < 0) {
+        K->ktok_source_info.file_id = klispT_si_file_id(K, filename);
+    }
     K->ktok_source_info.filename = filename;
     K->ktok_source_info.line = line;
     K->ktok_source_info.col = col;
@@ -522,7 +526,8 @@ eof_error:
     ktok_save_source_info(K);
     UNUSED(ktok_getc(K));
     krooted_vars_pop(K);
-    ktok_error_extra(K, "unterminated multi line comment", last_nested_comment_si);
+    ktok_error_extra(K, "unterminated multi line comment", 
+                     kexpand_si(K, last_nested_comment_si));
 }
 
 void ktok_ignore_whitespace(klisp_State *K)
@@ -583,6 +588,15 @@ TValue ktok_read_number(klisp_State *K, char *buf, int32_t len,
     UNUSED(len); /* not needed really, buf ends with '\0' */
     TValue n;
     if (radix == 10) {
+        /* try the fast path for decimals first, these are inexact
+           unless there is an explicit #e */
+        double d;
+        char *end;
+        if ((!has_exactp || !exactp) && 
+            kdouble_read_decimal(buf, &end, &d) && *end == '\0') {
+            ks_tbclear(K);
+            return ktag_double(d);
+        }
         /* only allow decimals with radix 10 */
         bool decimalp = false;
         if (!krational_read_decimal(K, buf, radix, &n, NULL, &decimalp)) {
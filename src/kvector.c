@@ -31,12 +31,20 @@ static Vector *kvector_alloc(klisp_State *K, bool m, uint32_t length)
                 (m? 0 : K_FLAG_IMMUTABLE));
     new_vector->mark = KFALSE;
     new_vector->sizearray = length;
+    new_vector->capacity = length;
+    new_vector->sizeinline = length;
+    new_vector->array = new_vector->inlinearray;
 
     return new_vector;
 }
 
+/* the empty vector is always immutable, like the empty string */
 TValue kvector_new_sf(klisp_State *K, uint32_t length, TValue fill)
 {
+    if (length == 0) {
+        klisp_assert(ttisvector(G(K)->empty_vector));
+        return G(K)->empty_vector;
+    }
     Vector *v = kvector_alloc(K, true, length);
     for (int i = 0; i < length; i++)
         v->array[i] = fill;
@@ -46,11 +54,79 @@ TValue kvector_new_sf(klisp_State *K, uint32_t length, TValue fill)
 TValue kvector_new_bs_g(klisp_State *K, bool m,
                         const TValue *buf, uint32_t length)
 {
+    if (length == 0 && (m || ttisvector(G(K)->empty_vector))) {
+        /* this is only created once, in the state initialization */
+        klisp_assert(ttisvector(G(K)->empty_vector));
+        return G(K)->empty_vector;
+    }
     Vector *v = kvector_alloc(K, m, length);
     memcpy(v->array, buf, sizeof(TValue) * length);
     return gc2vector(v);
 }
 
+/* mutable vector with no elements, but room for capacity elements 
+   (capacity should be greater than 0) */
+TValue kvector_new_c(klisp_State *K, uint32_t capacity)
+{
+    Vector *v = kvector_alloc(K, true, capacity);
+    v->sizearray = 0;
+    return gc2vector(v);
+}
+
+/*
+** Growth of mutable vectors 
+** When the elements no longer fit in the inline array, they are moved 
+** to a separately allocated array and the inline array is left unused.
+** The capacity is doubled on each growth so that kvector_push is 
+** amortized O(1).
+*/
+
+/* make room for at least capacity elements */
+void kvector_reserve(klisp_State *K, TValue v, uint32_t capacity)
+{
+    klisp_assert(kvector_mutablep(v));
+    Vector *vec = tv2vector(v);
+
+    if (capacity <= vec->capacity)
+        return;
+
+    if (capacity > (SIZE_MAX - sizeof(Vector)) / sizeof(TValue) ||
+        capacity > INT32_MAX)
+        klispM_toobig(K);
+
+    TValue *new_array = klispM_newvector(K, capacity, TValue);
+    memcpy(new_array, vec->array, vec->sizearray * sizeof(TValue));
+    if (vec->array != vec->inlinearray)
+        klispM_freearray(K, vec->array, vec->capacity, TValue);
+    vec->array = new_array;
+    vec->capacity = capacity;
+}
+
+void kvector_push(klisp_State *K, TValue v, TValue obj)
+{
+    klisp_assert(kvector_mutablep(v));
+    Vector *vec = tv2vector(v);
+
+    if (vec->sizearray == vec->capacity) {
+        uint32_t capacity = vec->capacity < KVECTOR_MINGROWTH? 
+            KVECTOR_MINGROWTH : vec->capacity;
+        kvector_reserve(K, v, capacity * 2);
+    }
+    vec->array[vec->sizearray++] = obj;
+}
+
+/* the vector should have at least one element */
+TValue kvector_pop(klisp_State *K, TValue v)
+{
+    UNUSED(K);
+    klisp_assert(kvector_mutablep(v));
+    Vector *vec = tv2vector(v);
+    klisp_assert(vec->sizearray > 0);
+    /* the rest of the array isn't traversed by the GC, so the element
+       doesn't need to be cleared */
+    return vec->array[--vec->sizearray];
+}
+
 bool kvectorp(TValue obj)
 {
     return ttisvector(obj);
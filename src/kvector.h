@@ -15,6 +15,14 @@
 TValue kvector_new_sf(klisp_State *K, uint32_t length, TValue fill);
 TValue kvector_new_bs_g(klisp_State *K, bool m,
                         const TValue *buf, uint32_t length);
+/* empty mutable vector with room for capacity (> 0) elements */
+TValue kvector_new_c(klisp_State *K, uint32_t capacity);
+
+/* growth (only for mutable vectors) */
+/* GC: all of these assume v (& obj) are rooted */
+void kvector_reserve(klisp_State *K, TValue v, uint32_t capacity);
+void kvector_push(klisp_State *K, TValue v, TValue obj);
+TValue kvector_pop(klisp_State *K, TValue v);
 
 /* predicates */
 
@@ -26,6 +34,7 @@ bool kmutable_vectorp(TValue obj);
 
 #define kvector_buf(tv_) (tv2vector(tv_)->array)
 #define kvector_size(tv_) (tv2vector(tv_)->sizearray)
+#define kvector_capacity(tv_) (tv2vector(tv_)->capacity)
 
 #define kvector_emptyp(tv_) (kvector_size(tv_) == 0)
 #define kvector_mutablep(tv_) (kis_mutable(tv_))
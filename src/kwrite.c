@@ -419,7 +419,8 @@ void kw_print_si(klisp_State *K, TValue obj)
 {
     /* should be an improper list of 2 pairs,
        with a string and 2 fixints */
-    TValue si = kget_source_info(K, obj);
+    TValue si = kexpand_si(K, kget_source_info(K, obj));
+    krooted_tvs_push(K, si);
     kw_printf(K, " @ ");
     /* this is a hack, would be better to change the interface of 
        kw_print_string */
@@ -433,6 +434,7 @@ void kw_print_si(klisp_State *K, TValue obj)
     kw_printf(K, " (line: %d, col: %d)", row, col);
 
     K->write_displayp = saved_displayp;
+    krooted_tvs_pop(K);
 }
 #endif /* KTRACK_SI */
 
@@ -446,7 +448,7 @@ void kw_print_cont_type(klisp_State *K, TValue obj)
     Continuation *cont = tv2cont(obj);
 
     /* XXX lock? */
-    const TValue *node = klispH_get(tv2table(G(K)->cont_name_table),
+    const TValue *node = klispH_get(K, tv2table(G(K)->cont_name_table),
                                     p2tv(cont->fn));
 
     char *type;
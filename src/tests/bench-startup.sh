@@ -0,0 +1,53 @@
+#! /bin/sh
+#
+# Startup time of the stand-alone interpreter, building the ground
+# environment and loading the given files vs. loading all of it from
+# a heap image (see --image).  RUNS sets the number of runs.
+#
+
+if [ $# -ge 1 ] ; then
+    KLISP="$1"
+    shift
+else
+    echo "usage: bench-startup.sh KLISP-EXECUTABLE [FILE...]" 1>&2
+    exit 1
+fi
+
+RUNS=${RUNS:-100}
+LOADS=""
+for f in "$@" ; do
+    LOADS="$LOADS -l $f"
+done
+
+IMAGE="bench-startup.img"
+
+# -- functions ----------------------------------------
+
+now()
+{
+    date +%s%N
+}
+
+bench()
+{
+    name="$1"
+    shift
+    start=`now`
+    i=0
+    while [ $i -lt $RUNS ] ; do
+        "$@" > /dev/null || exit 1
+        i=$((1 + $i))
+    done
+    end=`now`
+    echo "$name: $(( ($end - $start) / ($RUNS * 1000) )) us/run"
+}
+
+# -- benchmarks ---------------------------------------
+
+$KLISP $LOADS -e '#inert' "--dump-image=$IMAGE" || exit 1
+echo "image size: `wc -c < $IMAGE` bytes"
+
+bench "no image" $KLISP $LOADS -e '#inert'
+bench "image" $KLISP "--image=$IMAGE" -e '#inert'
+
+rm -f "$IMAGE"
@@ -22,6 +22,7 @@ GEN1_K="test-interpreter-gen1.k"
 GEN2_K="test-interpreter-gen2.k"
 GEN_DIR="./test-interpreter-dir"
 TMPERR="test-interpreter-err.log"
+IMAGE="test-interpreter.img"
 
 # -- functions ----------------------------------------
 
@@ -159,7 +160,7 @@ report()
 cleanup()
 {
     rm -fr "$GEN_DIR"
-    rm -f "$GEN1_K" "$GEN2_K" "$TMPERR"
+    rm -f "$GEN1_K" "$GEN2_K" "$TMPERR" "$IMAGE" "$IMAGE.2"
 }
 # -- tests --------------------------------------------
 
@@ -324,6 +325,52 @@ check_o "(\"$KLISP\" \"-e(write(get-interpreter-arguments))\" \"--\" \"/dev/null
 check_oe 'abc' '' $KLISP -e '(display "abc" (get-current-output-port))'
 check_oe '' 'abc' $KLISP -e '(display "abc" (get-current-error-port))'
 
+# options: --dump-image & --image
+# The definitions made by the -e, -l & -r options are in the image,
+# the script arguments, KLISP_INIT & KLISP_PATH are those of the
+# run that loads it.
+
+echo '($define! f ($lambda (x) (* x 2)))' > "$GEN1_K"
+check_o 'TTT' $KLISP -e '(display "TTT")' -l "$GEN1_K" \
+    "--dump-image=$IMAGE"
+check_o '84' $KLISP "--image=$IMAGE" -e '(display (f 42))'
+check_oi '84' '(display (f 42))' $KLISP "--image=$IMAGE"
+check_o '("/dev/null" "y")' $KLISP "--image=$IMAGE" \
+    -e '(write (get-script-arguments))' /dev/null y
+check_oe '' 'abc' $KLISP "--image=$IMAGE" \
+    -e '(display "abc" (get-current-error-port))'
+
+export KLISP_INIT='(display "init...")'
+check_o 'init...main' $KLISP "--image=$IMAGE" -e '(display "main")'
+unset KLISP_INIT
+
+export KLISP_PATH="$GEN_DIR/?.k"
+check_oi '1' '' $KLISP "--image=$IMAGE" -r a
+unset KLISP_PATH
+
+# required files aren't loaded again
+
+echo '(display "SSS")' > "$GEN2_K"
+check_o 'SSS' $KLISP -e '($define! x 1)' -r "$GEN2_K" -l "$GEN1_K" \
+    "--dump-image=$IMAGE"
+check_oi '' '' $KLISP "--image=$IMAGE" -r "$GEN2_K"
+
+# images with other images
+
+check_o '' $KLISP "--image=$IMAGE" -e '($define! y 2)' \
+    "--dump-image=$IMAGE.2"
+check_o '(1 2 4)' $KLISP "--image=$IMAGE.2" -e '(write (list x y (f 2)))'
+
+# errors
+
+check_oes '' '/.*usage.*/' 1 $KLISP "--dump-image=$IMAGE" "$GEN1_K"
+check_oes '' '/.*usage.*/' 1 $KLISP "--dump-image=$IMAGE" -i
+check_oes '' '/.*open file ports.*/' 1 $KLISP \
+    -e '($define! p (open-input-file "/dev/null"))' "--dump-image=$IMAGE"
+check_oes '' '/.*not a klisp image.*/' 1 $KLISP "--image=$GEN1_K" -e 1
+check_oes '' '/.*cannot read the image.*/' 1 $KLISP "--image=$GEN_DIR/c.img" \
+    -e 1
+
 # done
 
 report